@@ -0,0 +1,40 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+/**@file
+ * @brief Calculator benchmark helpers.
+ *
+ * The benchmarks are ztest suites. Results are printed as CSV lines:
+ * "BENCH,<suite>,<case>,<items>,<cycles>,<ns_per_item>", the replay of a task stream capture
+ * as "REPLAY,<key>,<value>" lines.
+ */
+
+#include <zephyr/types.h>
+
+/** @brief Print one benchmark result line.
+ *
+ * @param[in] suite Benchmark suite name.
+ * @param[in] name Case name.
+ * @param[in] items Number of processed items (tasks, bytes, ...).
+ * @param[in] cycles Elapsed hardware cycles.
+ */
+void bench_report(const char *suite, const char *name, uint32_t items, uint32_t cycles);
+
+/** @brief Connect the engine hooks to the pipeline of bench_engine.c (suite setup). */
+void bench_engine_init(void);
+
+/** @brief Results taken from result_msgq by the pipeline consumer thread.
+ *
+ * @param[out] last k_cycle_get_32() when the last one was taken.
+ *
+ * @retval Number of results since boot.
+ */
+uint32_t bench_results(uint32_t *last);
+
+#endif /* BENCH_H_ */
@@ -0,0 +1,109 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief Wire codec encode/decode throughput
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include <zephyr/sys/printk.h>
+#include "bench.h"
+#include "cds_codec.h"
+#include "fp16.h"
+
+#define BENCH_TASKS 40		// FP16 tasks in a 247-byte ATT MTU frame
+#define BENCH_ITERATIONS 1000
+
+static struct calculator_task tasks[BENCH_TASKS];
+static struct calculator_task decoded[BENCH_TASKS];
+static uint8_t frame[1 + BENCH_TASKS * CDS_CODEC_TASK_MAX_LEN];
+
+// Slowly varying operands, the typical sensor series the delta encoding is meant for
+static void bench_codec_fill(uint8_t mode)
+{
+	for (int i = 0; i < BENCH_TASKS; i++) {
+		tasks[i].operation = CALC_OP_ADD + (i % 4);
+		tasks[i].mode = mode;
+		tasks[i].flags = CDS_TASK_FLAG_BATCH;
+		tasks[i].job = 0;
+		if (mode == FIXED_MODE) {
+			tasks[i].q31_operand_1 = 0x10000000 + i * 37;
+			tasks[i].q31_operand_2 = 0x00400000 - i * 11;
+		} else {
+			tasks[i].f_operand_1 = fp16_to_float(0x3C00 + i);
+			tasks[i].f_operand_2 = fp16_to_float(0x4000 + 2 * i);
+		}
+	}
+}
+
+static void bench_codec_mode(const char *name, uint8_t mode)
+{
+	char case_name[32];
+	uint32_t start;
+	int len = 0;
+	int count = 0;
+
+	bench_codec_fill(mode);
+
+	start = k_cycle_get_32();
+	for (int i = 0; i < BENCH_ITERATIONS; i++) {
+		len = cds_codec_encode(tasks, BENCH_TASKS, frame, sizeof(frame));
+	}
+	snprintk(case_name, sizeof(case_name), "encode_%s", name);
+	bench_report("codec", case_name, BENCH_TASKS * BENCH_ITERATIONS, k_cycle_get_32() - start);
+
+	zassert_true(len > 0, "encode_%s failed (err %d)", name, len);
+
+	start = k_cycle_get_32();
+	for (int i = 0; i < BENCH_ITERATIONS; i++) {
+		count = cds_codec_decode(frame, len, decoded, BENCH_TASKS);
+	}
+	snprintk(case_name, sizeof(case_name), "decode_%s", name);
+	bench_report("codec", case_name, BENCH_TASKS * BENCH_ITERATIONS, k_cycle_get_32() - start);
+	zassert_equal(count, BENCH_TASKS, "decode_%s", name);
+
+	TC_PRINT("BENCH,codec,bytes_per_task_%s,%d.%02d\n", name, len / BENCH_TASKS,
+		 (len % BENCH_TASKS) * 100 / BENCH_TASKS);
+}
+
+ZTEST(bench_codec, test_float)
+{
+	bench_codec_mode("float", FLOAT_MODE);
+}
+
+ZTEST(bench_codec, test_q31)
+{
+	bench_codec_mode("q31", FIXED_MODE);
+}
+
+ZTEST(bench_codec, test_half)
+{
+	bench_codec_mode("half", HALF_MODE);
+}
+
+// Compatibility path, one 10-byte frame per task
+ZTEST(bench_codec, test_legacy)
+{
+	struct calculator_task_legacy legacy = {
+		.operation = CALC_OP_ADD,
+		.q31_operand_1 = 0x10000000,
+		.q31_operand_2 = 0x00400000,
+		.mode = FIXED_MODE,
+	};
+	uint32_t start = k_cycle_get_32();
+	int count = 0;
+
+	for (int i = 0; i < BENCH_ITERATIONS * BENCH_TASKS; i++) {
+		count = cds_codec_decode((const uint8_t *)&legacy, sizeof(legacy), decoded, 1);
+	}
+	bench_report("codec", "decode_legacy", BENCH_TASKS * BENCH_ITERATIONS,
+		     k_cycle_get_32() - start);
+	zassert_equal(count, 1);
+	zassert_equal(decoded[0].q31_operand_1, legacy.q31_operand_1);
+}
+
+ZTEST_SUITE(bench_codec, NULL, NULL, NULL, NULL, NULL);
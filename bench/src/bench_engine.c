@@ -0,0 +1,545 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief Calculator engine and pipeline benchmarks
+ *
+ * The engine is driven directly through my_cds_calculate_result() and q_div(), and through
+ * the same calculator_msgq -> engine thread -> result_msgq handoff as the application, with
+ * the BLE notification replaced by a counting consumer thread. One test per mode times the
+ * scalar (and complex) opcodes, the buffer tests time the vector, matrix, sort, FFT and filter
+ * operations in float and Q31, each checking its results once.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/atomic.h>
+#include "bench.h"
+#include "my_cds.h"
+#include "calc_vec.h"
+#include "calc_filter.h"
+#include "calc_io.h"
+#if defined(CONFIG_CDS_BENCH)
+#include "calc_bench.h"
+#endif
+#if defined(CONFIG_CDS_LATENCY)
+#include "calc_latency.h"
+#endif
+
+#define BENCH_ITERATIONS 1000
+#define BENCH_BUFFER_ITERATIONS 100  // Buffer operations, each one runs over all the elements
+#define BENCH_VEC_LEN 256
+#define BENCH_MAT_DIM 16
+#define BENCH_FILTER_TAPS 16
+#define BENCH_FILTER_STAGES 2
+#define BENCH_PIPELINE_TASKS 4096  // Tasks per batch size
+#define BENCH_STACKSIZE 2048
+#define BENCH_THREAD_PRIORITY 7  // Same as the application threads
+
+// Buffers of the buffer operation benchmarks
+#define BUF_A    0  // Vectors of BENCH_VEC_LEN elements, FFT and filter samples
+#define BUF_B    1
+#define BUF_DST  2
+#define BUF_MAT_A 3  // BENCH_MAT_DIM x BENCH_MAT_DIM matrices
+#define BUF_MAT_B 4
+#define BUF_MAT_DST 5
+#define BUF_COL  6  // BENCH_MAT_DIM x 1 vector, filter coefficients
+
+// Pipeline queues, named as in the application (my_cds.c and calc_jobs.c submit to calculator_msgq)
+K_MSGQ_DEFINE(calculator_msgq, sizeof(struct calculator_task), CONFIG_CDS_TASK_QUEUE_LEN, 4);
+K_MSGQ_DEFINE(result_msgq, sizeof(ReturnValue), CONFIG_CDS_RESULT_QUEUE_LEN, 4);
+K_MSGQ_DEFINE(bench_msgq, sizeof(struct calculator_task), 1, 4);
+
+static atomic_t pending;  // Results the pipeline benchmark waits for
+static K_SEM_DEFINE(pipeline_done, 0, 1);
+static atomic_t results;  // Results consumed
+static atomic_t last_result;  // k_cycle_get_32() of the last result consumed
+
+static const struct {
+	const char *name;
+	uint8_t operation;
+} ops[] = {
+	{ "add", CALC_OP_ADD },
+	{ "sub", CALC_OP_SUB },
+	{ "mul", CALC_OP_MUL },
+	{ "div", CALC_OP_DIV },
+}, complex_ops[] = {
+	{ "conj", CALC_OP_CONJ },
+	{ "mag", CALC_OP_MAG },
+	{ "phase", CALC_OP_PHASE },
+};
+// -------------------------------------------------------------------------------------------------
+
+// Non-trivial operands of a mode, varied per iteration so results are not constant
+static void bench_engine_operands(struct calculator_task *task, uint32_t i)
+{
+	uint8_t format = task->mode & CDS_MODE_FORMAT_MASK;
+
+	if (task->mode == FLOAT_MODE || task->mode == HALF_MODE || task->mode == COMPLEX_FLOAT_MODE) {
+		task->f_operand_1 = 1.5f + (float)(i & 0xFF);
+		task->f_operand_2 = 0.75f + (float)(i & 0x0F);
+		task->f_operand_1_im = -0.5f;
+		task->f_operand_2_im = 0.25f;
+	} else if (format == Q15_MODE) {
+		task->q31_operand_1 = 0x2000 + (i & 0xFF);
+		task->q31_operand_2 = 0x1000 - (i & 0x0F);
+	} else if (format == COMPLEX_Q15_MODE) {
+		task->q31_operand_1 = 0x10002000 + (i & 0xFF);
+		task->q31_operand_2 = 0x08001000 - (i & 0x0F);
+	} else {
+		task->q31_operand_1 = 0x20000000 + (int32_t)(i * 37);
+		task->q31_operand_2 = 0x10000000 - (int32_t)(i * 11);
+	}
+}
+
+// Cycles per run of my_cds_calculate_result() for one task, checked once before the timing
+static ReturnValue bench_engine_task(const char *case_name, const struct calculator_task *task,
+				     uint32_t iterations, uint32_t items_per_task)
+{
+	ReturnValue result = my_cds_calculate_result(*task);
+	uint32_t start = k_cycle_get_32();
+
+	for (uint32_t i = 0; i < iterations; i++) {
+		my_cds_calculate_result(*task);
+	}
+	bench_report("engine", case_name, iterations * items_per_task, k_cycle_get_32() - start);
+	return result;
+}
+
+// Scalar opcodes of a mode, and the complex ones in the complex modes
+static void bench_engine_mode(const char *mode_name, uint8_t mode)
+{
+	bool complex = mode == COMPLEX_Q15_MODE || mode == COMPLEX_FLOAT_MODE;
+	struct calculator_task task = { .mode = mode };
+	char case_name[32];
+	ReturnValue result;
+
+	bench_engine_operands(&task, 0);
+	for (size_t o = 0; o < ARRAY_SIZE(ops) + (complex ? ARRAY_SIZE(complex_ops) : 0); o++) {
+		bool scalar = o < ARRAY_SIZE(ops);
+
+		task.operation = scalar ? ops[o].operation : complex_ops[o - ARRAY_SIZE(ops)].operation;
+		snprintk(case_name, sizeof(case_name), "%s_%s", mode_name,
+			 scalar ? ops[o].name : complex_ops[o - ARRAY_SIZE(ops)].name);
+		// COMPLEX_FLOAT_MODE results go partly through result_msgq, drained by the consumer
+		result = bench_engine_task(case_name, &task, BENCH_ITERATIONS, 1);
+		zassert_not_equal(result.type, NONE_TYPE, "%s: no result", case_name);
+	}
+}
+
+// Buffer 'id' of rows x cols elements in the type of a mode, values spread over [0.25, 0.75)
+static void bench_engine_buffer(uint8_t id, uint8_t mode, uint16_t rows, uint16_t cols)
+{
+	int32_float_union value;
+
+	zassert_ok(calc_vec_define(id, calc_vec_type(mode), rows, cols));
+	for (uint32_t i = 0; i < (uint32_t)rows * cols; i++) {
+		float f = 0.25f + (float)(i % 32) / 64.0f;
+
+		if (mode == FLOAT_MODE) {
+			value.f = f;
+		} else {
+			value.u = (int32_t)(f * 2147483648.0f);
+		}
+		zassert_ok(calc_vec_write(id, i * sizeof(value), &value, sizeof(value)));
+	}
+}
+
+// Buffer 'id' holding count coefficients, converted to Q31 in the fixed-point modes
+static void bench_engine_coeffs(uint8_t id, uint8_t mode, const float *coeffs, uint16_t count)
+{
+	int32_float_union value;
+
+	zassert_ok(calc_vec_define(id, calc_vec_type(mode), count, 1));
+	for (uint16_t i = 0; i < count; i++) {
+		if (mode == FLOAT_MODE) {
+			value.f = coeffs[i];
+		} else {
+			value.u = (int32_t)(coeffs[i] * 2147483648.0f);
+		}
+		zassert_ok(calc_vec_write(id, i * sizeof(value), &value, sizeof(value)));
+	}
+}
+
+static void bench_engine_vec(const char *type_name, uint8_t mode)
+{
+	static const struct {
+		const char *name;
+		uint8_t operation;
+		uint32_t desc;
+		uint32_t items;  // Elements computed per task
+	} vec_ops[] = {
+		{ "vec_add", CALC_OP_VEC_ADD, CALC_VEC_DESC(BUF_DST, BUF_A, BUF_B), BENCH_VEC_LEN },
+		{ "vec_mul", CALC_OP_VEC_MUL, CALC_VEC_DESC(BUF_DST, BUF_A, BUF_B), BENCH_VEC_LEN },
+		{ "vec_scalar", CALC_OP_VEC_SCALAR, CALC_VEC_DESC(BUF_DST, BUF_A, CALC_OP_MUL),
+		  BENCH_VEC_LEN },
+		{ "vec_dot", CALC_OP_VEC_DOT, CALC_VEC_DESC(0, BUF_A, BUF_B), BENCH_VEC_LEN },
+		{ "mat_vec", CALC_OP_MAT_VEC, CALC_VEC_DESC(BUF_MAT_DST, BUF_MAT_A, BUF_COL),
+		  BENCH_MAT_DIM },
+		{ "mat_mul", CALC_OP_MAT_MUL, CALC_VEC_DESC(BUF_MAT_DST, BUF_MAT_A, BUF_MAT_B),
+		  BENCH_MAT_DIM * BENCH_MAT_DIM },
+		{ "sort", CALC_OP_SORT, CALC_VEC_DESC(BUF_DST, BUF_A, 0), BENCH_VEC_LEN },
+		{ "median", CALC_OP_MEDIAN, CALC_VEC_DESC(0, BUF_A, 0), BENCH_VEC_LEN },
+	};
+	struct calculator_task task = { .mode = mode };
+	char case_name[32];
+	ReturnValue result;
+
+	bench_engine_buffer(BUF_A, mode, BENCH_VEC_LEN, 1);
+	bench_engine_buffer(BUF_B, mode, BENCH_VEC_LEN, 1);
+	bench_engine_buffer(BUF_MAT_A, mode, BENCH_MAT_DIM, BENCH_MAT_DIM);
+	bench_engine_buffer(BUF_MAT_B, mode, BENCH_MAT_DIM, BENCH_MAT_DIM);
+	bench_engine_buffer(BUF_COL, mode, BENCH_MAT_DIM, 1);
+
+	for (size_t o = 0; o < ARRAY_SIZE(vec_ops); o++) {
+		task.operation = vec_ops[o].operation;
+		task.q31_operand_1 = (int32_t)vec_ops[o].desc;
+		if (mode == FLOAT_MODE) {
+			task.f_operand_2 = 1.5f;  // Scalar of vec_scalar
+		} else {
+			task.q31_operand_2 = 0x40000000;
+		}
+		snprintk(case_name, sizeof(case_name), "%s_%s", type_name, vec_ops[o].name);
+		result = bench_engine_task(case_name, &task, BENCH_BUFFER_ITERATIONS, vec_ops[o].items);
+		zassert_true((int32_t)result.value.u >= 0, "%s failed (err %d)", case_name,
+			     (int32_t)result.value.u);
+	}
+}
+
+// Full spectrum and top-K bins of a CONFIG_CDS_FFT_MAX_LEN sample buffer
+static void bench_engine_fft(const char *type_name, uint8_t mode)
+{
+	struct calculator_task task = { .operation = CALC_OP_FFT, .mode = mode };
+	char case_name[32];
+	ReturnValue result;
+
+	bench_engine_buffer(BUF_A, mode, CONFIG_CDS_FFT_MAX_LEN, 1);
+
+	task.q31_operand_1 = (int32_t)CALC_VEC_DESC(BUF_DST, BUF_A, 0);
+	snprintk(case_name, sizeof(case_name), "%s_fft_%u", type_name, CONFIG_CDS_FFT_MAX_LEN);
+	result = bench_engine_task(case_name, &task, BENCH_BUFFER_ITERATIONS, CONFIG_CDS_FFT_MAX_LEN);
+	zassert_equal((int32_t)result.value.u, (CONFIG_CDS_FFT_MAX_LEN / 2 + 1) * 2, "%s", case_name);
+
+	task.q31_operand_1 = (int32_t)CALC_VEC_DESC(BUF_DST, BUF_A, CONFIG_CDS_FFT_TOP_K_MAX);
+	snprintk(case_name, sizeof(case_name), "%s_fft_top_%u", type_name, CONFIG_CDS_FFT_TOP_K_MAX);
+	result = bench_engine_task(case_name, &task, BENCH_BUFFER_ITERATIONS, CONFIG_CDS_FFT_MAX_LEN);
+	zassert_equal((int32_t)result.value.u, CONFIG_CDS_FFT_TOP_K_MAX * 2, "%s", case_name);
+}
+
+// FIR and biquad cascade over BENCH_VEC_LEN samples, state kept from one run to the next
+static void bench_engine_filter(const char *type_name, uint8_t mode)
+{
+	static const float biquad[] = { 0.2f, 0.4f, 0.2f, 0.5f, -0.25f };  // Low-pass, stable
+	float coeffs[MAX(BENCH_FILTER_TAPS, BENCH_FILTER_STAGES * ARRAY_SIZE(biquad))];
+	struct calculator_task task = { .mode = mode };
+	char case_name[32];
+	ReturnValue result;
+
+	bench_engine_buffer(BUF_A, mode, BENCH_VEC_LEN, 1);
+
+	for (int i = 0; i < BENCH_FILTER_TAPS; i++) {
+		coeffs[i] = 1.0f / BENCH_FILTER_TAPS;  // Moving average
+	}
+	bench_engine_coeffs(BUF_COL, mode, coeffs, BENCH_FILTER_TAPS);
+	task.operation = CALC_OP_FILT_CREATE;
+	task.q31_operand_1 = (int32_t)CALC_VEC_DESC(0, BUF_COL, CALC_FILTER_FIR);
+	task.q31_operand_2 = 0;
+	zassert_ok((int32_t)my_cds_calculate_result(task).value.u);
+
+	for (size_t i = 0; i < BENCH_FILTER_STAGES * ARRAY_SIZE(biquad); i++) {
+		coeffs[i] = biquad[i % ARRAY_SIZE(biquad)];
+	}
+	bench_engine_coeffs(BUF_COL, mode, coeffs, BENCH_FILTER_STAGES * ARRAY_SIZE(biquad));
+	task.q31_operand_1 = (int32_t)CALC_VEC_DESC(1, BUF_COL, CALC_FILTER_BIQUAD);
+	zassert_ok((int32_t)my_cds_calculate_result(task).value.u);
+
+	task.operation = CALC_OP_FILTER;
+	task.q31_operand_1 = (int32_t)CALC_VEC_DESC(BUF_DST, BUF_A, 0);
+	snprintk(case_name, sizeof(case_name), "%s_fir_%u", type_name, BENCH_FILTER_TAPS);
+	result = bench_engine_task(case_name, &task, BENCH_BUFFER_ITERATIONS, BENCH_VEC_LEN);
+	zassert_equal((int32_t)result.value.u, BENCH_VEC_LEN, "%s", case_name);
+
+	task.q31_operand_1 = (int32_t)CALC_VEC_DESC(BUF_DST, BUF_A, 1);
+	snprintk(case_name, sizeof(case_name), "%s_biquad_%u", type_name, BENCH_FILTER_STAGES);
+	result = bench_engine_task(case_name, &task, BENCH_BUFFER_ITERATIONS, BENCH_VEC_LEN);
+	zassert_equal((int32_t)result.value.u, BENCH_VEC_LEN, "%s", case_name);
+}
+
+// Intermediate results of the engine go to the consumer, as in the application
+static void bench_engine_emit(const ReturnValue *result)
+{
+	ReturnValue queued = *result;
+
+#if defined(CONFIG_CDS_LATENCY)
+	queued.t_done = k_cycle_get_32();
+#endif
+	k_msgq_put(&result_msgq, &queued, K_FOREVER);
+}
+
+static const struct calc_engine_ops engine_ops = {
+	.emit = bench_engine_emit,
+};
+
+uint32_t bench_results(uint32_t *last)
+{
+	*last = (uint32_t)atomic_get(&last_result);
+	return (uint32_t)atomic_get(&results);
+}
+
+void bench_engine_init(void)
+{
+	calc_engine_set_ops(&engine_ops);
+}
+
+// Each test starts without buffers, the arena holds the ones of one test at a time
+static void bench_engine_before(void *fixture)
+{
+	my_cds_calculate_result((struct calculator_task){ .operation = CALC_OP_VEC_CLEAR });
+}
+// -------------------------------------------------------------------------------------------------
+
+// Cycles per task of my_cds_calculate_result(), per mode and opcode
+#define BENCH_ENGINE_MODE(name, mode)                                                           \
+	ZTEST(bench_engine, test_##name)                                                        \
+	{                                                                                       \
+		bench_engine_mode(#name, mode);                                                 \
+	}
+
+BENCH_ENGINE_MODE(float, FLOAT_MODE)
+BENCH_ENGINE_MODE(half, HALF_MODE)
+BENCH_ENGINE_MODE(q31, FIXED_MODE)
+BENCH_ENGINE_MODE(q31_sat, FIXED_MODE | CDS_MODE_SAT)
+BENCH_ENGINE_MODE(q31_wrap, FIXED_MODE | CDS_MODE_WRAP)
+BENCH_ENGINE_MODE(q15_sat, Q15_MODE | CDS_MODE_SAT)
+BENCH_ENGINE_MODE(q15_wrap, Q15_MODE | CDS_MODE_WRAP)
+BENCH_ENGINE_MODE(q7_24_sat, Q7_24_MODE | CDS_MODE_SAT)
+BENCH_ENGINE_MODE(q16_16_sat, Q16_16_MODE | CDS_MODE_SAT)
+BENCH_ENGINE_MODE(q16_16_wrap, Q16_16_MODE | CDS_MODE_WRAP)
+BENCH_ENGINE_MODE(cq15, COMPLEX_Q15_MODE)
+BENCH_ENGINE_MODE(cfloat, COMPLEX_FLOAT_MODE)
+
+ZTEST(bench_engine, test_vec_float)
+{
+	bench_engine_vec("float", FLOAT_MODE);
+}
+
+ZTEST(bench_engine, test_vec_q31)
+{
+	bench_engine_vec("q31", FIXED_MODE | CDS_MODE_SAT);
+}
+
+ZTEST(bench_engine, test_fft_float)
+{
+	bench_engine_fft("float", FLOAT_MODE);
+}
+
+ZTEST(bench_engine, test_fft_q31)
+{
+	bench_engine_fft("q31", FIXED_MODE);
+}
+
+ZTEST(bench_engine, test_filter_float)
+{
+	bench_engine_filter("float", FLOAT_MODE);
+}
+
+ZTEST(bench_engine, test_filter_q31)
+{
+	bench_engine_filter("q31", FIXED_MODE);
+}
+
+ZTEST(bench_engine, test_q_div)
+{
+	volatile int32_t sink;
+	uint32_t start = k_cycle_get_32();
+
+	for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+		sink = q_div(0x10000000 + (int32_t)i, 0x40000000 - (int32_t)(i * 3));
+	}
+	bench_report("engine", "q_div", BENCH_ITERATIONS, k_cycle_get_32() - start);
+	zassert_equal(sink, q_div(0x10000000 + BENCH_ITERATIONS - 1,
+				  0x40000000 - (BENCH_ITERATIONS - 1) * 3));
+}
+
+// Cost of one k_msgq put/get pair of a task, without a thread switch
+ZTEST(bench_engine, test_msgq)
+{
+	struct calculator_task task = { .operation = CALC_OP_ADD };
+	uint32_t start = k_cycle_get_32();
+
+	for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+		zassert_ok(k_msgq_put(&bench_msgq, &task, K_NO_WAIT));
+		zassert_ok(k_msgq_get(&bench_msgq, &task, K_NO_WAIT));
+	}
+	bench_report("msgq", "put_get", BENCH_ITERATIONS, k_cycle_get_32() - start);
+}
+
+// Throughput of the whole handoff, tasks queued in batches of 1 ... 1024
+ZTEST(bench_engine, test_pipeline)
+{
+	struct calculator_task task = { .operation = CALC_OP_MUL, .mode = FIXED_MODE | CDS_MODE_SAT };
+	char case_name[32];
+	uint32_t t_last;
+
+	for (uint32_t batch = 1; batch <= 1024; batch *= 2) {
+		uint32_t first = bench_results(&t_last);
+		uint32_t start = k_cycle_get_32();
+
+		task.flags = (batch > 1) ? CDS_TASK_FLAG_BATCH : 0;
+		for (uint32_t n = 0; n < BENCH_PIPELINE_TASKS; n += batch) {
+			atomic_set(&pending, batch);
+			for (uint32_t i = 0; i < batch; i++) {
+				bench_engine_operands(&task, i);
+				k_msgq_put(&calculator_msgq, &task, K_FOREVER);
+			}
+			k_sem_take(&pipeline_done, K_FOREVER);  // Last result of the batch consumed
+		}
+		snprintk(case_name, sizeof(case_name), "batch_%u", batch);
+		bench_report("pipeline", case_name, BENCH_PIPELINE_TASKS, k_cycle_get_32() - start);
+		zassert_equal(bench_results(&t_last) - first, BENCH_PIPELINE_TASKS);
+	}
+}
+
+#if defined(CONFIG_CDS_BENCH)
+static K_SEM_DEFINE(self_bench_records, 0, CALC_BENCH_OPS_MAX);
+
+static void self_bench_record(const uint8_t *record, size_t len)
+{
+	k_sem_give(&self_bench_records);
+}
+
+static const struct calc_io_sink self_bench_sink = {
+	.bench = self_bench_record,
+};
+
+// The self-benchmark runs in the engine thread between the client tasks, the buffers and the
+// accumulators of the session must come out of it as they went in
+ZTEST(bench_engine, test_self_bench_keeps_session)
+{
+	static const uint8_t spec[] = { COMPLEX_FLOAT_MODE, 8, 10, 0, CALC_OP_ADD, CALC_OP_MUL,
+					CALC_OP_DIV };
+	static const uint8_t unary_spec[] = { COMPLEX_FLOAT_MODE, 8, 10, 0, CALC_OP_MAG };
+	static int32_float_union before[BENCH_VEC_LEN];
+	static int32_float_union after[BENCH_VEC_LEN];
+	struct calculator_task task = {
+		.operation = CALC_OP_ADD,
+		.mode = FLOAT_MODE,
+		.f_operand_1 = 1.5f,
+		.f_operand_2 = 2.25f,
+	};
+	uint8_t type;
+
+	calc_io_register(CALC_IO_SHELL, &self_bench_sink);
+	bench_engine_buffer(BUF_A, FLOAT_MODE, BENCH_VEC_LEN, 1);
+	zassert_equal(calc_vec_read(BUF_A, 0, before, BENCH_VEC_LEN, &type), BENCH_VEC_LEN);
+	my_cds_calculate_result(task);  // Accumulator 3.75
+
+	zassert_equal(calc_bench_request(unary_spec, sizeof(unary_spec), CALC_IO_SHELL), -EINVAL);
+	zassert_ok(calc_bench_request(spec, sizeof(spec), CALC_IO_SHELL));
+	for (size_t i = CALC_BENCH_SPEC_HDR_LEN; i < sizeof(spec); i++) {
+		zassert_ok(k_sem_take(&self_bench_records, K_SECONDS(10)), "No record of opcode %u",
+			   spec[i]);
+	}
+
+	zassert_equal(calc_vec_read(BUF_A, 0, after, BENCH_VEC_LEN, &type), BENCH_VEC_LEN);
+	zassert_equal(type, FLOAT_MODE);
+	zassert_mem_equal(before, after, sizeof(before));
+	task.flags = CDS_TASK_FLAG_ACC;
+	task.f_operand_2 = 1.0f;
+	zassert_within(my_cds_calculate_result(task).value.f, 4.75f, 1e-6f);
+	calc_io_register(CALC_IO_SHELL, NULL);
+}
+
+// The workload of a self-benchmark is not counted as client writes: the writes queued behind it
+// when the link drops are still skipped, and the workload itself is not taken for them
+ZTEST(bench_engine, test_self_bench_keeps_ble_writes)
+{
+	static const uint8_t spec[] = { FLOAT_MODE, 8, 10, 0, CALC_OP_ADD };
+	struct calculator_task writes[2] = {
+		{ .operation = CALC_OP_ADD, .mode = FLOAT_MODE, .f_operand_1 = 1.0f, .f_operand_2 = 2.0f },
+		{ .operation = CALC_OP_MUL, .mode = FLOAT_MODE, .f_operand_1 = 3.0f, .f_operand_2 = 4.0f },
+	};
+	struct calculator_task marker = { .operation = CALC_OP_ADD, .mode = FLOAT_MODE };
+	uint32_t t_last;
+	uint32_t first;
+
+	calc_io_register(CALC_IO_SHELL, &self_bench_sink);
+	first = bench_results(&t_last);
+	k_sched_lock();  // All queued before the engine thread runs
+	zassert_ok(calc_bench_request(spec, sizeof(spec), CALC_IO_SHELL));
+	zassert_ok(my_cds_submit_write(writes, ARRAY_SIZE(writes)));
+	my_cds_session_end();
+	k_sched_unlock();
+	zassert_ok(k_sem_take(&self_bench_records, K_SECONDS(10)));
+
+	atomic_set(&pending, 1);
+	zassert_ok(calc_io_submit(&marker, 1, CALC_IO_SHELL, K_FOREVER));
+	zassert_ok(k_sem_take(&pipeline_done, K_SECONDS(10)));
+	zassert_equal(bench_results(&t_last) - first, 1, "Writes of the closed session were run");
+	calc_io_register(CALC_IO_SHELL, NULL);
+}
+#endif
+
+static void *bench_engine_setup(void)
+{
+	bench_engine_init();
+	return NULL;
+}
+
+ZTEST_SUITE(bench_engine, NULL, bench_engine_setup, bench_engine_before, NULL, NULL);
+// -------------------------------------------------------------------------------------------------
+
+// Application engine thread loop
+static void calculator_engine_thread(void)
+{
+	struct calculator_task task;
+	ReturnValue result;
+
+	while (1) {
+		k_msgq_get(&calculator_msgq, &task, K_FOREVER);
+#if defined(CONFIG_CDS_LATENCY)
+		uint32_t t_deq = k_cycle_get_32();
+#endif
+		result = my_cds_calculate_result(task);
+#if defined(CONFIG_CDS_LATENCY)
+		result.t_rx = task.t_rx;
+		result.t_done = k_cycle_get_32();
+		calc_latency_record(CALC_LAT_QUEUE, task.t_rx, t_deq);
+		calc_latency_record(CALC_LAT_COMPUTE, t_deq, result.t_done);
+#endif
+		if (result.type != NONE_TYPE) {
+			k_msgq_put(&result_msgq, &result, K_FOREVER);
+		}
+	}
+}
+
+// Stands in for the send thread, counts the results instead of notifying them
+static void send_data_thread(void)
+{
+	ReturnValue result;
+
+	while (1) {
+		k_msgq_get(&result_msgq, &result, K_FOREVER);
+		uint32_t now = k_cycle_get_32();
+
+#if defined(CONFIG_CDS_LATENCY)
+		calc_latency_record(CALC_LAT_NOTIFY, result.t_done, now);
+		calc_latency_record(CALC_LAT_TOTAL, result.t_rx, now);
+#endif
+		atomic_set(&last_result, (atomic_val_t)now);
+		atomic_inc(&results);
+		if (atomic_get(&pending) > 0 && atomic_dec(&pending) == 1) {
+			k_sem_give(&pipeline_done);
+		}
+	}
+}
+
+// Thread ids as in the application, read by the stats characteristic (cds_stats.c)
+K_THREAD_DEFINE(calculator_engine_thread_id, BENCH_STACKSIZE, calculator_engine_thread, NULL, NULL,
+		NULL, BENCH_THREAD_PRIORITY, 0, 0);
+K_THREAD_DEFINE(send_data_thread_id, BENCH_STACKSIZE, send_data_thread, NULL, NULL, NULL,
+		BENCH_THREAD_PRIORITY, 0, 0);
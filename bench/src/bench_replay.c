@@ -0,0 +1,158 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief Task stream replay
+ *
+ * A capture of scripts/cds_capture.py, embedded at build time with CONFIG_BENCH_REPLAY_CAPTURE,
+ * is decoded frame by frame with cds_codec_decode() and fed through the calculator_msgq ->
+ * engine thread -> result_msgq handoff of the pipeline benchmark. Frames are released at the
+ * recorded pace divided by CONFIG_BENCH_REPLAY_SPEEDUP, and dropped like write_operation()
+ * does when calculator_msgq has no room for them, or back to back (0) waiting for room.
+ * Results are printed as "REPLAY,<key>,<value>" lines, latencies come from calc_latency.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include <zephyr/sys/byteorder.h>
+#include "bench.h"
+#include "my_cds.h"
+#include "cds_codec.h"
+#include "cds_record.h"
+#if defined(CONFIG_CDS_LATENCY)
+#include "calc_latency.h"
+#endif
+
+#if defined(BENCH_REPLAY_CAPTURE)
+extern struct k_msgq calculator_msgq;
+extern struct k_msgq result_msgq;
+
+static const uint8_t capture[] = {
+#include "bench_replay_capture.inc"
+};
+
+#if defined(CONFIG_CDS_LATENCY)
+static void bench_replay_latency(const char *stage, enum calc_latency_stage id)
+{
+	struct calc_latency_summary summary;
+
+	calc_latency_summary(id, &summary);
+	TC_PRINT("REPLAY,%s_p50_us,%u\n", stage, summary.p50_us);
+	TC_PRINT("REPLAY,%s_p99_us,%u\n", stage, summary.p99_us);
+	TC_PRINT("REPLAY,%s_max_us,%u\n", stage, summary.max_us);
+}
+#endif
+
+ZTEST(bench_replay, test_replay)
+{
+	static struct calculator_task tasks[CONFIG_CDS_TASK_QUEUE_LEN];
+	uint32_t frames = 0, queued = 0, dropped = 0, malformed = 0, lost = 0;
+	uint32_t results_start, results_end, t_last;
+	uint32_t start;
+	size_t pos = 0;
+
+#if defined(CONFIG_CDS_LATENCY)
+	calc_latency_reset();
+#endif
+	results_start = bench_results(&t_last);
+#if CONFIG_BENCH_REPLAY_SPEEDUP > 0
+	int64_t start_ticks = k_uptime_ticks();
+	uint64_t due_us = 0;  // Release time of the frame, from the start of the replay
+#endif
+	start = k_cycle_get_32();
+
+	while (pos + CDS_RECORD_HDR_LEN <= sizeof(capture)) {
+		uint32_t delta_us = sys_get_le32(&capture[pos]);
+		uint16_t len = sys_get_le16(&capture[pos + 4]);
+		const uint8_t *frame = &capture[pos + CDS_RECORD_HDR_LEN];
+		int count;
+
+		lost += sys_get_le16(&capture[pos + 6]);
+		pos += CDS_RECORD_HDR_LEN + len;
+		if (pos > sizeof(capture)) {
+			break;  // Truncated capture
+		}
+		frames++;
+
+#if CONFIG_BENCH_REPLAY_SPEEDUP > 0
+		due_us += delta_us / CONFIG_BENCH_REPLAY_SPEEDUP;
+		int64_t wait_us = (int64_t)due_us -
+				  (int64_t)k_ticks_to_us_floor64(k_uptime_ticks() - start_ticks);
+
+		if (wait_us > 0) {
+			k_sleep(K_USEC(wait_us));
+		}
+#else
+		ARG_UNUSED(delta_us);
+#endif
+
+		count = cds_codec_decode(frame, len, tasks, ARRAY_SIZE(tasks));
+		if (count <= 0) {
+			malformed++;
+			continue;
+		}
+#if CONFIG_BENCH_REPLAY_SPEEDUP > 0
+		if (k_msgq_num_free_get(&calculator_msgq) < (uint32_t)count) {  // As write_operation()
+			dropped += count;
+			continue;
+		}
+#endif
+
+#if defined(CONFIG_CDS_LATENCY)
+		uint32_t t_rx = k_cycle_get_32();
+#endif
+		for (int i = 0; i < count; i++) {
+#if defined(CONFIG_CDS_LATENCY)
+			tasks[i].t_rx = t_rx;
+#endif
+			k_msgq_put(&calculator_msgq, &tasks[i], K_FOREVER);
+		}
+		queued += count;
+	}
+
+	// Let the pipeline drain, then time the run up to the last result
+	while (k_msgq_num_used_get(&calculator_msgq) || k_msgq_num_used_get(&result_msgq)) {
+		k_sleep(K_MSEC(1));
+	}
+	k_sleep(K_MSEC(1));
+	results_end = bench_results(&t_last);
+
+	uint32_t results = results_end - results_start;
+	uint32_t cycles = (results ? t_last : k_cycle_get_32()) - start;
+	uint64_t elapsed_us = MAX(k_cyc_to_us_floor64(cycles), 1);
+
+	TC_PRINT("REPLAY,speedup,%u\n", CONFIG_BENCH_REPLAY_SPEEDUP);
+	TC_PRINT("REPLAY,frames,%u\n", frames);
+	TC_PRINT("REPLAY,frames_lost_in_capture,%u\n", lost);
+	TC_PRINT("REPLAY,frames_malformed,%u\n", malformed);
+	TC_PRINT("REPLAY,tasks,%u\n", queued);
+	TC_PRINT("REPLAY,tasks_dropped,%u\n", dropped);
+	TC_PRINT("REPLAY,results,%u\n", results);
+	TC_PRINT("REPLAY,elapsed_us,%u\n", (uint32_t)elapsed_us);
+	TC_PRINT("REPLAY,tasks_per_s,%u\n", (uint32_t)((uint64_t)queued * USEC_PER_SEC / elapsed_us));
+#if defined(CONFIG_CDS_LATENCY)
+	bench_replay_latency("queue", CALC_LAT_QUEUE);
+	bench_replay_latency("compute", CALC_LAT_COMPUTE);
+	bench_replay_latency("total", CALC_LAT_TOTAL);
+#endif
+	zassert_true(frames > 0, "Empty capture");
+	// Rejected client writes are captured too, they count as malformed (frames_malformed)
+	zassert_true(frames > malformed, "No frame of the capture decodes");
+}
+#else
+ZTEST(bench_replay, test_replay)
+{
+	ztest_test_skip();  // No CONFIG_BENCH_REPLAY_CAPTURE
+}
+#endif
+
+static void *bench_replay_setup(void)
+{
+	bench_engine_init();  // Engine hooks and pipeline threads of bench_engine.c
+	return NULL;
+}
+
+ZTEST_SUITE(bench_replay, NULL, bench_replay_setup, NULL, NULL, NULL);
@@ -0,0 +1,32 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ */
+
+/** @file
+ *  @brief Calculator benchmarks
+ *
+ * Ztest suites (bench_codec.c, bench_engine.c, bench_replay.c), their numbers printed as CSV
+ * lines between the header and "BENCH,done".
+ */
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include "bench.h"
+
+void bench_report(const char *suite, const char *name, uint32_t items, uint32_t cycles)
+{
+	uint64_t ns = k_cyc_to_ns_floor64(cycles);
+
+	TC_PRINT("BENCH,%s,%s,%u,%u,%u\n", suite, name, items, cycles,
+		 (uint32_t)(items ? ns / items : 0));
+}
+
+void test_main(void)
+{
+	TC_PRINT("BENCH,suite,case,items,cycles,ns_per_item\n");
+
+	ztest_run_all(NULL, false, 1, 1);
+	ztest_verify_all_test_suites_ran();
+
+	TC_PRINT("BENCH,done\n");
+}
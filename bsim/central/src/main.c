@@ -0,0 +1,527 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief Simulated CDS central, BabbleSim end-to-end benchmark
+ *
+ * Connects to the calculator firmware, discovers CDS, subscribes to the result characteristic
+ * and writes frames of CONFIG_BENCH_BATCH Q31 tasks to the operation characteristic for
+ * CONFIG_BENCH_DURATION_S. Results are printed as CSV lines: "E2E,<key>,<value>".
+ *
+ * A write is acknowledged before its results are notified, so one write is in flight at a time
+ * and the frames waiting for results are kept in a FIFO. A frame is answered when the number of
+ * results received reaches its last task, its write-to-notify latency is taken at that point.
+ *
+ * With CONFIG_BENCH_RESUME the central then drops the link, reconnects and resumes its kept
+ * session (overlay-session.conf on the firmware): the results notified again from the resume
+ * point must match the ones received before the link dropped.
+ */
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/hci.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <stdlib.h>
+#include <string.h>
+#include "my_cds.h"
+#include "cds_codec.h"
+#include "cds_stats.h"
+#include "cds_session.h"
+
+#define PEER_NAME "Nordic_Calculator"
+#define PENDING_MAX 64  // Frames written and not answered yet
+#define RESULT_LOG 256  // Last results received, compared with the ones a resume notifies again
+
+#if defined(CONFIG_BENCH_PHY_CODED)
+#define BENCH_PHY BT_CONN_LE_PHY_PARAM_CODED
+#define BENCH_PHY_NAME "coded"
+#elif defined(CONFIG_BENCH_PHY_2M)
+#define BENCH_PHY BT_CONN_LE_PHY_PARAM_2M
+#define BENCH_PHY_NAME "2M"
+#else
+#define BENCH_PHY BT_CONN_LE_PHY_PARAM_1M
+#define BENCH_PHY_NAME "1M"
+#endif
+
+static struct bt_conn *default_conn;
+static K_SEM_DEFINE(connected_sem, 0, 1);
+static K_SEM_DEFINE(step_sem, 0, 1);  // MTU exchange, discovery, subscription and stats read
+static K_SEM_DEFINE(write_sem, 0, 1);
+static K_SEM_DEFINE(disconnected_sem, 0, 1);
+static K_TIMER_DEFINE(pace, NULL, NULL);  // CONFIG_BENCH_RATE_HZ write slots
+
+static uint16_t svc_end_handle;
+static uint16_t operation_handle;
+static uint16_t result_handle;
+static uint16_t session_handle;
+static int write_err;
+static bool reconnecting;
+
+// Frames waiting for their results (push: main thread, pop: BT RX thread)
+struct pending_frame {
+	uint32_t t_write;
+	uint32_t results_end;  // Results received once the frame is answered
+};
+static struct pending_frame pending[PENDING_MAX];
+static uint32_t pending_head;
+static uint32_t pending_tail;
+static uint32_t results_expected;
+static uint32_t results_received;
+static uint32_t t_last_result;
+static int32_t result_log[RESULT_LOG];  // Result n in result_log[n % RESULT_LOG]
+static struct k_spinlock pending_lock;
+
+static uint32_t latency_us[CONFIG_BENCH_LATENCY_SAMPLES];
+static uint32_t latency_count;
+
+static uint32_t stats[CDS_STATS_WORDS];
+static uint8_t session_info[CDS_SESSION_INFO_LEN];
+// -------------------------------------------------------------------------------------------------
+
+static bool ad_name_match(struct bt_data *data, void *user_data)
+{
+	bool *match = user_data;
+
+	if (data->type == BT_DATA_NAME_COMPLETE) {
+		*match = (data->data_len == strlen(PEER_NAME) &&
+			  memcmp(data->data, PEER_NAME, data->data_len) == 0);
+		return false;
+	}
+	return true;
+}
+
+static void device_found(const bt_addr_le_t *addr, int8_t rssi, uint8_t type,
+			 struct net_buf_simple *ad)
+{
+	struct bt_le_conn_param *param = BT_LE_CONN_PARAM(CONFIG_BENCH_CONN_INTERVAL,
+							  CONFIG_BENCH_CONN_INTERVAL, 0, 400);
+	bool match = false;
+
+	if (default_conn || (type != BT_GAP_ADV_TYPE_ADV_IND && type != BT_GAP_ADV_TYPE_ADV_DIRECT_IND)) {
+		return;
+	}
+	bt_data_parse(ad, ad_name_match, &match);
+	if (!match || bt_le_scan_stop()) {
+		return;
+	}
+	if (bt_conn_le_create(addr, BT_CONN_LE_CREATE_CONN, param, &default_conn)) {
+		printk("E2E,error,create_conn\n");
+		bt_le_scan_start(BT_LE_SCAN_PASSIVE, device_found);
+	}
+}
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	if (err) {
+		printk("E2E,error,connect %u\n", err);
+		bt_conn_unref(default_conn);
+		default_conn = NULL;
+		bt_le_scan_start(BT_LE_SCAN_PASSIVE, device_found);
+		return;
+	}
+	k_sem_give(&connected_sem);
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	if (reconnecting) {
+		k_sem_give(&disconnected_sem);
+		return;
+	}
+	printk("E2E,error,disconnected %u\n", reason);
+}
+
+// Keep the benchmark connection interval, the peripheral asks for its preferred one later
+static bool le_param_req(struct bt_conn *conn, struct bt_le_conn_param *param)
+{
+	return false;
+}
+
+BT_CONN_CB_DEFINE(conn_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+	.le_param_req = le_param_req,
+};
+// -------------------------------------------------------------------------------------------------
+
+static void mtu_exchanged(struct bt_conn *conn, uint8_t err, struct bt_gatt_exchange_params *params)
+{
+	k_sem_give(&step_sem);
+}
+
+static uint8_t discover_func(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			     struct bt_gatt_discover_params *params)
+{
+	if (!attr) {
+		k_sem_give(&step_sem);
+		return BT_GATT_ITER_STOP;
+	}
+
+	if (params->type == BT_GATT_DISCOVER_PRIMARY) {
+		const struct bt_gatt_service_val *svc = attr->user_data;
+
+		svc_end_handle = svc->end_handle;
+		params->uuid = NULL;
+		params->start_handle = attr->handle + 1;
+		params->end_handle = svc->end_handle;
+		params->type = BT_GATT_DISCOVER_CHARACTERISTIC;
+		if (bt_gatt_discover(conn, params)) {
+			k_sem_give(&step_sem);
+		}
+		return BT_GATT_ITER_STOP;
+	}
+
+	const struct bt_gatt_chrc *chrc = attr->user_data;
+
+	if (!bt_uuid_cmp(chrc->uuid, BT_UUID_CDS_OPERATION)) {
+		operation_handle = chrc->value_handle;
+	} else if (!bt_uuid_cmp(chrc->uuid, BT_UUID_CDS_RESULT)) {
+		result_handle = chrc->value_handle;
+	} else if (!bt_uuid_cmp(chrc->uuid, BT_UUID_CDS_SESSION)) {
+		session_handle = chrc->value_handle;
+	}
+	return BT_GATT_ITER_CONTINUE;
+}
+
+static uint8_t notify_func(struct bt_conn *conn, struct bt_gatt_subscribe_params *params,
+			   const void *data, uint16_t length)
+{
+	if (!data) {
+		return BT_GATT_ITER_STOP;
+	}
+
+	uint32_t now = k_cycle_get_32();
+	k_spinlock_key_t key = k_spin_lock(&pending_lock);
+
+	for (uint16_t i = 0; i + sizeof(int32_t) <= length; i += sizeof(int32_t)) {
+		result_log[results_received++ % RESULT_LOG] = sys_get_le32((const uint8_t *)data + i);
+	}  // Q31 results, no device timestamps
+	t_last_result = now;
+	while (pending_head != pending_tail &&
+	       (int32_t)(results_received - pending[pending_head % PENDING_MAX].results_end) >= 0) {
+		if (latency_count < ARRAY_SIZE(latency_us)) {
+			latency_us[latency_count++] = k_cyc_to_us_floor32(
+				now - pending[pending_head % PENDING_MAX].t_write);
+		}
+		pending_head++;
+	}
+	k_spin_unlock(&pending_lock, key);
+	return BT_GATT_ITER_CONTINUE;
+}
+
+static void subscribed(struct bt_conn *conn, uint8_t err, struct bt_gatt_subscribe_params *params)
+{
+	k_sem_give(&step_sem);
+}
+
+static void write_func(struct bt_conn *conn, uint8_t err, struct bt_gatt_write_params *params)
+{
+	if (err) {  // Rejected (task queue full), no results follow for the last frame
+		k_spinlock_key_t key = k_spin_lock(&pending_lock);
+
+		pending_tail--;
+		results_expected -= CONFIG_BENCH_BATCH;
+		k_spin_unlock(&pending_lock, key);
+	}
+	write_err = err;
+	k_sem_give(&write_sem);
+}
+
+static void write_session_func(struct bt_conn *conn, uint8_t err,
+			       struct bt_gatt_write_params *params)
+{
+	write_err = err;
+	k_sem_give(&step_sem);
+}
+
+static uint8_t read_session_func(struct bt_conn *conn, uint8_t err,
+				 struct bt_gatt_read_params *params, const void *data, uint16_t length)
+{
+	if (!err && data && length >= sizeof(session_info)) {
+		memcpy(session_info, data, sizeof(session_info));
+	}
+	k_sem_give(&step_sem);
+	return BT_GATT_ITER_STOP;
+}
+
+static uint8_t read_stats_func(struct bt_conn *conn, uint8_t err, struct bt_gatt_read_params *params,
+			       const void *data, uint16_t length)
+{
+	if (!err && data) {
+		for (size_t i = 0; i < MIN(length / sizeof(uint32_t), ARRAY_SIZE(stats)); i++) {
+			stats[i] = sys_get_le32((const uint8_t *)data + i * sizeof(uint32_t));
+		}
+	}
+	k_sem_give(&step_sem);
+	return BT_GATT_ITER_STOP;
+}
+// -------------------------------------------------------------------------------------------------
+
+static int u32_cmp(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static uint32_t percentile(uint32_t p)
+{
+	return latency_count ? latency_us[(latency_count - 1) * p / 100] : 0;
+}
+
+// Connect, set up the link and discover CDS, 0 when the benchmark can start
+static int bench_connect(void)
+{
+	static struct bt_gatt_exchange_params mtu_params = { .func = mtu_exchanged };
+	static struct bt_gatt_discover_params disc_params;
+	static struct bt_gatt_subscribe_params sub_params;
+	static struct bt_gatt_discover_params ccc_disc_params;
+	int err;
+
+	err = bt_le_scan_start(BT_LE_SCAN_PASSIVE, device_found);
+	if (err) {
+		return err;
+	}
+	k_sem_take(&connected_sem, K_FOREVER);
+
+	err = bt_gatt_exchange_mtu(default_conn, &mtu_params);
+	if (!err) {
+		k_sem_take(&step_sem, K_FOREVER);
+	}
+	bt_conn_le_phy_update(default_conn, BENCH_PHY);
+	bt_conn_le_data_len_update(default_conn, BT_LE_DATA_LEN_PARAM_MAX);
+
+	disc_params.uuid = BT_UUID_CDS;
+	disc_params.func = discover_func;
+	disc_params.start_handle = BT_ATT_FIRST_ATTRIBUTE_HANDLE;
+	disc_params.end_handle = BT_ATT_LAST_ATTRIBUTE_HANDLE;
+	disc_params.type = BT_GATT_DISCOVER_PRIMARY;
+	err = bt_gatt_discover(default_conn, &disc_params);
+	if (err) {
+		return err;
+	}
+	k_sem_take(&step_sem, K_FOREVER);
+	if (!operation_handle || !result_handle) {
+		return -ENOENT;
+	}
+
+	sub_params.notify = notify_func;
+	sub_params.subscribe = subscribed;
+	sub_params.value = BT_GATT_CCC_NOTIFY;
+	sub_params.value_handle = result_handle;
+	sub_params.ccc_handle = 0;  // Discovered up to the end of the service
+	sub_params.end_handle = svc_end_handle;
+	sub_params.disc_params = &ccc_disc_params;
+	err = bt_gatt_subscribe(default_conn, &sub_params);
+	if (err) {
+		return err;
+	}
+	k_sem_take(&step_sem, K_FOREVER);
+	return 0;
+}
+
+// Read the device side counters (CDS stats characteristic)
+static void bench_read_stats(void)
+{
+	static struct bt_gatt_read_params read_params;
+
+	read_params.func = read_stats_func;
+	read_params.handle_count = 0;
+	read_params.by_uuid.uuid = BT_UUID_CDS_STATS;
+	read_params.by_uuid.start_handle = BT_ATT_FIRST_ATTRIBUTE_HANDLE;
+	read_params.by_uuid.end_handle = BT_ATT_LAST_ATTRIBUTE_HANDLE;
+	if (!bt_gatt_read(default_conn, &read_params)) {
+		k_sem_take(&step_sem, K_FOREVER);
+	}
+}
+
+#if defined(CONFIG_BENCH_RESUME)
+// Drop the link, reconnect and resume the session from the oldest result still kept
+static void bench_resume(void)
+{
+	static int32_t expected[RESULT_LOG];
+	static struct bt_gatt_read_params read_params;
+	static struct bt_gatt_write_params write_params;
+	static uint8_t resume[CDS_SESSION_RESUME_LEN];
+	uint32_t received = results_received;
+	uint32_t next, oldest, seq, replayed = 0, mismatched = 0;
+	uint32_t t_wait;
+	int err;
+
+	memcpy(expected, result_log, sizeof(expected));
+	reconnecting = true;
+	bt_conn_disconnect(default_conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+	k_sem_take(&disconnected_sem, K_FOREVER);
+	bt_conn_unref(default_conn);
+	default_conn = NULL;
+	reconnecting = false;
+
+	err = bench_connect();  // Discovers and subscribes again, the results stay paused
+	if (err || !session_handle) {
+		printk("E2E,error,reconnect %d\n", err);
+		return;
+	}
+	read_params.func = read_session_func;
+	read_params.handle_count = 1;
+	read_params.single.handle = session_handle;
+	read_params.single.offset = 0;
+	if (!bt_gatt_read(default_conn, &read_params)) {
+		k_sem_take(&step_sem, K_FOREVER);
+	}
+	next = sys_get_le32(&session_info[1]);
+	oldest = sys_get_le32(&session_info[5]);
+	printk("E2E,resume_resumed,%u\n", session_info[0]);
+	printk("E2E,resume_next,%u\n", next);
+	if (!session_info[0] || next != received) {
+		printk("E2E,resume_ok,0\n");
+		return;
+	}
+
+	seq = next - MIN(next - oldest, RESULT_LOG);
+	k_spinlock_key_t key = k_spin_lock(&pending_lock);
+
+	results_received = seq;  // Results from seq on are notified again
+	k_spin_unlock(&pending_lock, key);
+
+	resume[0] = CDS_SESSION_RESUME;
+	sys_put_le32(seq, &resume[1]);
+	write_params.func = write_session_func;
+	write_params.handle = session_handle;
+	write_params.offset = 0;
+	write_params.data = resume;
+	write_params.length = sizeof(resume);
+	if (!bt_gatt_write(default_conn, &write_params)) {
+		k_sem_take(&step_sem, K_FOREVER);
+	}
+
+	t_wait = k_cycle_get_32();
+	while (results_received < next && k_cyc_to_ms_floor32(k_cycle_get_32() - t_wait) < 2000) {
+		k_sleep(K_MSEC(10));
+	}
+	k_sleep(K_MSEC(100));  // Nothing else may follow, no task was written since
+	for (uint32_t n = seq; n < results_received && n < next; n++) {
+		replayed++;
+		mismatched += (result_log[n % RESULT_LOG] != expected[n % RESULT_LOG]);
+	}
+	printk("E2E,resume_replayed,%u\n", replayed);
+	printk("E2E,resume_mismatched,%u\n", mismatched);
+	printk("E2E,resume_ok,%u\n", !write_err && replayed == next - seq && mismatched == 0 &&
+	       results_received == next);
+}
+#endif
+
+int main(void)
+{
+	static struct calculator_task tasks[CONFIG_BENCH_BATCH];
+	static uint8_t frame[CONFIG_BT_L2CAP_TX_MTU];
+	static struct bt_gatt_write_params write_params;
+	uint32_t frames = 0, rejected = 0, missed = 0;
+	uint32_t t_start, t_end;
+	int len;
+	int err;
+
+	err = bt_enable(NULL);
+	if (!err) {
+		err = bench_connect();
+	}
+	if (err) {
+		printk("E2E,error,setup %d\n", err);
+		return 0;
+	}
+
+	for (int i = 0; i < CONFIG_BENCH_BATCH; i++) {  // Small operands, no saturation
+		tasks[i].q31_operand_1 = (i + 1) << 16;
+		tasks[i].q31_operand_2 = 1 << 16;
+		tasks[i].operation = CALC_OP_ADD;
+		tasks[i].mode = FIXED_MODE;
+	}
+	len = cds_codec_encode(tasks, CONFIG_BENCH_BATCH, frame,
+			       MIN(sizeof(frame), (size_t)bt_gatt_get_mtu(default_conn) - 3));
+	if (len < 0) {
+		printk("E2E,error,frame does not fit the ATT MTU\n");
+		return 0;
+	}
+
+	write_params.func = write_func;
+	write_params.handle = operation_handle;
+	write_params.offset = 0;
+	write_params.data = frame;
+	write_params.length = len;
+
+#if CONFIG_BENCH_RATE_HZ > 0
+	k_timer_start(&pace, K_USEC(USEC_PER_SEC / CONFIG_BENCH_RATE_HZ),
+		      K_USEC(USEC_PER_SEC / CONFIG_BENCH_RATE_HZ));
+#endif
+
+	t_start = k_cycle_get_32();
+	while (k_cyc_to_ms_floor32(k_cycle_get_32() - t_start) < CONFIG_BENCH_DURATION_S * MSEC_PER_SEC) {
+#if CONFIG_BENCH_RATE_HZ > 0
+		missed += k_timer_status_sync(&pace) - 1;  // Slots lost waiting for the previous write
+#endif
+
+		k_spinlock_key_t key = k_spin_lock(&pending_lock);
+
+		if (pending_tail - pending_head == PENDING_MAX) {
+			k_spin_unlock(&pending_lock, key);
+			k_sleep(K_MSEC(1));
+			continue;
+		}
+		results_expected += CONFIG_BENCH_BATCH;
+		pending[pending_tail % PENDING_MAX].t_write = k_cycle_get_32();
+		pending[pending_tail % PENDING_MAX].results_end = results_expected;
+		pending_tail++;
+		k_spin_unlock(&pending_lock, key);
+
+		err = bt_gatt_write(default_conn, &write_params);
+		if (err) {
+			printk("E2E,error,write %d\n", err);
+			return 0;
+		}
+		k_sem_take(&write_sem, K_FOREVER);
+		frames++;
+		if (write_err) {
+			rejected++;
+		}
+	}
+	k_timer_stop(&pace);
+	k_sleep(K_MSEC(500));  // Trailing notifications
+
+	bench_read_stats();
+
+	t_end = results_received ? t_last_result : k_cycle_get_32();
+	uint32_t elapsed_ms = MAX(k_cyc_to_ms_floor32(t_end - t_start), 1);
+
+	qsort(latency_us, latency_count, sizeof(latency_us[0]), u32_cmp);
+
+	printk("E2E,rate_hz,%u\n", CONFIG_BENCH_RATE_HZ);
+	printk("E2E,batch,%u\n", CONFIG_BENCH_BATCH);
+	printk("E2E,mtu,%u\n", bt_gatt_get_mtu(default_conn));
+	printk("E2E,phy,%s\n", BENCH_PHY_NAME);
+	printk("E2E,interval_us,%u\n", CONFIG_BENCH_CONN_INTERVAL * 1250);
+	printk("E2E,elapsed_ms,%u\n", elapsed_ms);
+	printk("E2E,frames,%u\n", frames);
+	printk("E2E,tasks_accepted,%u\n", (frames - rejected) * CONFIG_BENCH_BATCH);
+	printk("E2E,tasks_rejected,%u\n", rejected * CONFIG_BENCH_BATCH);
+	printk("E2E,tasks_dropped_device,%u\n", stats[1]);
+	printk("E2E,notify_failed_device,%u\n", stats[3]);
+	printk("E2E,queue_high_water,%u\n", stats[4]);
+	printk("E2E,results,%u\n", results_received);
+	printk("E2E,ops_per_s,%u\n", (uint32_t)((uint64_t)results_received * MSEC_PER_SEC / elapsed_ms));
+	printk("E2E,slots_missed,%u\n", missed);
+	printk("E2E,latency_samples,%u\n", latency_count);
+	printk("E2E,latency_p50_us,%u\n", percentile(50));
+	printk("E2E,latency_p90_us,%u\n", percentile(90));
+	printk("E2E,latency_p99_us,%u\n", percentile(99));
+	printk("E2E,latency_max_us,%u\n", percentile(100));
+#if defined(CONFIG_BENCH_RESUME)
+	bench_resume();
+#endif
+	printk("E2E,done\n");
+	return 0;
+}
@@ -0,0 +1,74 @@
+#!/usr/bin/env bash
+#
+# Rafal Szymura
+# June 2024
+# BLE Calculator Application
+#
+# End-to-end CDS benchmark on BabbleSim: the calculator firmware and the simulated central
+# (bsim/central) on nrf52_bsim, connected through the 2G4 phy. Runs offline, simulated time.
+#
+# Needs ZEPHYR_BASE, BSIM_OUT_PATH and BSIM_COMPONENTS_PATH (a BabbleSim installation).
+# Parameters (environment):
+#   RATE      writes per second, 0 floods (default 0)
+#   BATCH     tasks per write, 1..64 (default 8)
+#   MTU       ATT MTU of the central, 23..247 (default 247)
+#   PHY       1M, 2M or CODED (default 2M)
+#   INTERVAL  connection interval in 1.25 ms units (default 6)
+#   DURATION  measurement time in simulated seconds (default 10)
+#   RESUME    1 builds the firmware with overlay-session.conf, then the central drops the link,
+#             reconnects, resumes its session and checks the results notified again (default 0)
+#
+# Example: RATE=200 BATCH=16 PHY=1M bsim/run_bench.sh
+# Prints the "E2E,<key>,<value>" lines of the central, also kept in $BUILD_DIR/e2e.csv.
+
+set -eu
+
+: "${ZEPHYR_BASE:?ZEPHYR_BASE is not set}"
+: "${BSIM_OUT_PATH:?BSIM_OUT_PATH is not set}"
+: "${BSIM_COMPONENTS_PATH:?BSIM_COMPONENTS_PATH is not set}"
+
+RATE=${RATE:-0}
+BATCH=${BATCH:-8}
+MTU=${MTU:-247}
+PHY=${PHY:-2M}
+INTERVAL=${INTERVAL:-6}
+DURATION=${DURATION:-10}
+RESUME=${RESUME:-0}
+
+APP_DIR=$(cd "$(dirname "$0")/.." && pwd)
+BUILD_DIR=${BUILD_DIR:-$APP_DIR/build_bsim}
+SIM_ID=cds_e2e_$$
+
+PERIPHERAL_ARGS=()
+CENTRAL_ARGS=()
+if [ "$RESUME" = 1 ]; then
+	PERIPHERAL_ARGS=(-- -DEXTRA_CONF_FILE=overlay-session.conf)
+	CENTRAL_ARGS=(-DCONFIG_BENCH_RESUME=y)
+fi
+
+west build -p auto -b nrf52_bsim -d "$BUILD_DIR/peripheral" "$APP_DIR" "${PERIPHERAL_ARGS[@]}"
+west build -p auto -b nrf52_bsim -d "$BUILD_DIR/central" "$APP_DIR/bsim/central" -- \
+	-DCONFIG_BENCH_RATE_HZ="$RATE" \
+	-DCONFIG_BENCH_BATCH="$BATCH" \
+	-DCONFIG_BENCH_PHY_"$PHY"=y \
+	-DCONFIG_BENCH_CONN_INTERVAL="$INTERVAL" \
+	-DCONFIG_BENCH_DURATION_S="$DURATION" \
+	-DCONFIG_BT_L2CAP_TX_MTU="$MTU" \
+	-DCONFIG_BT_BUF_ACL_RX_SIZE=$((MTU + 4)) \
+	-DCONFIG_BT_BUF_ACL_TX_SIZE=$((MTU + 4)) \
+	"${CENTRAL_ARGS[@]}"
+
+# Connection setup plus the measurement and the trailing notifications (and the resume), in us
+SIM_LENGTH=$(((DURATION + 5 + RESUME * 5) * 1000000))
+
+cd "$BSIM_OUT_PATH/bin"
+"$BUILD_DIR/peripheral/zephyr/zephyr.exe" -s="$SIM_ID" -d=0 -RealEncryption=0 > "$BUILD_DIR/peripheral.log" &
+"$BUILD_DIR/central/zephyr/zephyr.exe" -s="$SIM_ID" -d=1 -RealEncryption=0 > "$BUILD_DIR/central.log" &
+./bs_2G4_phy_v1 -s="$SIM_ID" -D=2 -sim_length="$SIM_LENGTH" > /dev/null
+wait
+
+grep -a "^E2E," "$BUILD_DIR/central.log" | tee "$BUILD_DIR/e2e.csv"
+grep -q "^E2E,done" "$BUILD_DIR/e2e.csv"
+if [ "$RESUME" = 1 ]; then
+	grep -q "^E2E,resume_ok,1" "$BUILD_DIR/e2e.csv"
+fi
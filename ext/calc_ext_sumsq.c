@@ -0,0 +1,47 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief Example loadable operation kernel: operand 1 squared plus operand 2 squared
+ *
+ * Built as an LLEXT module with CONFIG_CDS_EXT, uploaded over the CDS extension characteristic
+ * and registered for an opcode from CALC_OP_EXT_BASE up.
+ */
+
+#include <zephyr/llext/symbol.h>
+#include <errno.h>
+#include "my_cds.h"
+#include "calc_q.h"
+#include "fp16.h"
+
+int calc_ext_op(const struct calculator_task *task, int32_float_union *result)
+{
+	uint8_t status;
+	int32_t a2;
+	int32_t b2;
+
+	if (task->mode == FLOAT_MODE || task->mode == HALF_MODE) {  // HALF_MODE operands are widened
+		float f = task->f_operand_1 * task->f_operand_1 + task->f_operand_2 * task->f_operand_2;
+
+		if (task->mode == HALF_MODE) {
+			result->u = 0;
+			result->h = fp16_from_float(f);
+			return HALF_TYPE;
+		}
+		result->f = f;
+		return FLOAT_TYPE;
+	}
+	if (!calc_q_mode_valid(task->mode)) {
+		return -EINVAL;
+	}
+
+	// Saturation or wrapping as selected by the mode
+	a2 = calc_q_execute(task->mode, CALC_OP_MUL, task->q31_operand_1, task->q31_operand_1, &status);
+	b2 = calc_q_execute(task->mode, CALC_OP_MUL, task->q31_operand_2, task->q31_operand_2, &status);
+	result->u = calc_q_execute(task->mode, CALC_OP_ADD, a2, b2, &status);
+	return ((task->mode & CDS_MODE_FORMAT_MASK) == Q15_MODE) ? INT16_TYPE : INT32_TYPE;
+}
+LL_EXTENSION_SYMBOL(calc_ext_op);
@@ -0,0 +1,54 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief Session arena
+ */
+
+#include "calc_port.h"
+#include "calc_arena.h"
+
+static uint8_t arena[CONFIG_CDS_SESSION_ARENA_SIZE] __aligned(CALC_ARENA_ALIGN);
+static struct calc_arena_stats stats = { .size = sizeof(arena) };
+
+// Allocations may come from the BT RX thread (buffer upload) and the calculator engine thread
+CALC_PORT_SPINLOCK_DEFINE(arena_lock);
+// -------------------------------------------------------------------------------------------------
+
+void *calc_arena_alloc(size_t size)
+{
+	calc_port_key_t key = calc_port_spin_lock(&arena_lock);
+	void *block = NULL;
+
+	if (size <= sizeof(arena) && ROUND_UP(size, CALC_ARENA_ALIGN) <= sizeof(arena) - stats.used) {
+		size = ROUND_UP(size, CALC_ARENA_ALIGN);
+		block = &arena[stats.used];
+		stats.used += size;
+		stats.high_water = MAX(stats.high_water, stats.used);
+	} else {
+		stats.failures++;
+	}
+	calc_port_spin_unlock(&arena_lock, key);
+
+	return block;
+}
+
+void calc_arena_reset(void)
+{
+	calc_port_key_t key = calc_port_spin_lock(&arena_lock);
+
+	stats.used = 0;
+	stats.resets++;
+	calc_port_spin_unlock(&arena_lock, key);
+}
+
+void calc_arena_stats(struct calc_arena_stats *out)
+{
+	calc_port_key_t key = calc_port_spin_lock(&arena_lock);
+
+	*out = stats;
+	calc_port_spin_unlock(&arena_lock, key);
+}
@@ -0,0 +1,60 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+#ifndef CALC_ARENA_H_
+#define CALC_ARENA_H_
+
+/**@file
+ * @defgroup calc_arena Session arena
+ * @{
+ * @brief Bump allocator for the variable-size working memory of one client session.
+ *
+ * All allocations come from one static block of CONFIG_CDS_SESSION_ARENA_SIZE bytes. Allocation
+ * is a bounds check and a pointer bump, nothing is freed individually: the whole arena is reset
+ * when the session ends (disconnect) or on CALC_OP_SESSION_RESET, so memory use is the same
+ * after weeks of uptime as after boot. The owners of the allocations drop them before the reset.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include "calc_port.h"
+
+#define CALC_ARENA_ALIGN 4
+
+struct calc_arena_stats {
+	uint32_t size;			// Budget in bytes
+	uint32_t used;			// Allocated in this session
+	uint32_t high_water;	// Largest use since boot
+	uint32_t failures;		// Allocations refused since boot
+	uint32_t resets;		// Sessions ended since boot
+};
+
+/** @brief Allocate from the session arena.
+ *
+ * @param[in] size Size in bytes, rounded up to CALC_ARENA_ALIGN.
+ *
+ * @retval Pointer to the block. NULL if the budget is exhausted.
+ */
+void *calc_arena_alloc(size_t size);
+
+/** @brief Release every allocation of the session. */
+void calc_arena_reset(void);
+
+/** @brief Read the arena usage and high-water mark. */
+void calc_arena_stats(struct calc_arena_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* CALC_ARENA_H_ */
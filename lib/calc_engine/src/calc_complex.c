@@ -0,0 +1,174 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief Complex arithmetic
+ */
+
+#include "calc_port.h"
+#include <math.h>
+#include "calc_complex.h"
+#include "calc_q.h"
+#include "calc_engine.h"
+
+#if defined(__ARM_FEATURE_SIMD32)  // Cortex-M4/M33 DSP extension
+#include <arm_acle.h>
+#endif
+
+#define COMPLEX_PI 3.14159265358979f
+
+static int16_t sat_q15(int64_t v)
+{
+	return (v > INT16_MAX) ? INT16_MAX : ((v < INT16_MIN) ? INT16_MIN : (int16_t)v);
+}
+
+static uint32_t isqrt32(uint32_t v)
+{
+	uint32_t r = 0;
+	uint32_t bit = 1u << 30;
+
+	while (bit > v) {
+		bit >>= 2;
+	}
+	while (bit) {
+		if (v >= r + bit) {
+			v -= r + bit;
+			r = (r >> 1) + bit;
+		} else {
+			r >>= 1;
+		}
+		bit >>= 2;
+	}
+	return r;
+}
+
+// Saturating halfword add/sub, the products a b and a conj(b) in Q30
+#if defined(__ARM_FEATURE_SIMD32)  // Cortex-M4/M33 DSP extension
+static int32_t cq15_add(int32_t a, int32_t b)
+{
+	return __qadd16(a, b);
+}
+
+static int32_t cq15_sub(int32_t a, int32_t b)
+{
+	return __qsub16(a, b);
+}
+
+static void cq15_mul_q30(int32_t a, int32_t b, int64_t *re, int64_t *im)
+{
+	*re = __smlsld(a, b, 0);
+	*im = __smlaldx(a, b, 0);
+}
+
+static void cq15_mul_conj_q30(int32_t a, int32_t b, int64_t *re, int64_t *im)
+{
+	*re = __smlald(a, b, 0);
+	*im = __smlsldx(b, a, 0);
+}
+#else
+static int32_t cq15_add(int32_t a, int32_t b)
+{
+	return (int32_t)CALC_CQ15(sat_q15(CALC_CQ15_RE(a) + CALC_CQ15_RE(b)),
+				  sat_q15(CALC_CQ15_IM(a) + CALC_CQ15_IM(b)));
+}
+
+static int32_t cq15_sub(int32_t a, int32_t b)
+{
+	return (int32_t)CALC_CQ15(sat_q15(CALC_CQ15_RE(a) - CALC_CQ15_RE(b)),
+				  sat_q15(CALC_CQ15_IM(a) - CALC_CQ15_IM(b)));
+}
+
+static void cq15_mul_q30(int32_t a, int32_t b, int64_t *re, int64_t *im)
+{
+	*re = (int64_t)CALC_CQ15_RE(a) * CALC_CQ15_RE(b) - (int64_t)CALC_CQ15_IM(a) * CALC_CQ15_IM(b);
+	*im = (int64_t)CALC_CQ15_RE(a) * CALC_CQ15_IM(b) + (int64_t)CALC_CQ15_IM(a) * CALC_CQ15_RE(b);
+}
+
+static void cq15_mul_conj_q30(int32_t a, int32_t b, int64_t *re, int64_t *im)
+{
+	*re = (int64_t)CALC_CQ15_RE(a) * CALC_CQ15_RE(b) + (int64_t)CALC_CQ15_IM(a) * CALC_CQ15_IM(b);
+	*im = (int64_t)CALC_CQ15_IM(a) * CALC_CQ15_RE(b) - (int64_t)CALC_CQ15_RE(a) * CALC_CQ15_IM(b);
+}
+#endif
+// -------------------------------------------------------------------------------------------------
+
+int32_t calc_complex_q15(uint8_t operation, int32_t a, int32_t b, uint8_t *status)
+{
+	int64_t re, im, den;
+
+	*status = CALC_Q_OK;
+	switch (operation) {
+		case CALC_OP_ADD:
+			return cq15_add(a, b);
+		case CALC_OP_SUB:
+			return cq15_sub(a, b);
+		case CALC_OP_MUL:
+			cq15_mul_q30(a, b, &re, &im);
+			return (int32_t)CALC_CQ15(sat_q15(re >> 15), sat_q15(im >> 15));
+		case CALC_OP_DIV:  // a conj(b) / |b|^2
+			cq15_mul_conj_q30(a, b, &re, &im);
+			den = (int64_t)CALC_CQ15_RE(b) * CALC_CQ15_RE(b) + (int64_t)CALC_CQ15_IM(b) * CALC_CQ15_IM(b);
+			if (den == 0) {
+				*status = CALC_Q_DIV_BY_ZERO;
+				return 0;
+			}
+			return (int32_t)CALC_CQ15(sat_q15(re * 32768 / den), sat_q15(im * 32768 / den));
+		case CALC_OP_CONJ:
+			return (int32_t)CALC_CQ15(CALC_CQ15_RE(a), sat_q15(-CALC_CQ15_IM(a)));
+		case CALC_OP_MAG:
+			return sat_q15(isqrt32((uint32_t)(CALC_CQ15_RE(a) * CALC_CQ15_RE(a)) +
+					       (uint32_t)(CALC_CQ15_IM(a) * CALC_CQ15_IM(a))));
+		case CALC_OP_PHASE:
+			return sat_q15(lrintf(atan2f(CALC_CQ15_IM(a), CALC_CQ15_RE(a)) / COMPLEX_PI * 32768.0f));
+		default:  // CALC_OP_RESET
+			return 0;
+	}
+}
+
+struct calc_complex calc_complex_f32(uint8_t operation, struct calc_complex a,
+				     struct calc_complex b, uint8_t *status)
+{
+	struct calc_complex result = { 0.0f, 0.0f };
+	float den;
+
+	*status = CALC_Q_OK;
+	switch (operation) {
+		case CALC_OP_ADD:
+			result.re = a.re + b.re;
+			result.im = a.im + b.im;
+			break;
+		case CALC_OP_SUB:
+			result.re = a.re - b.re;
+			result.im = a.im - b.im;
+			break;
+		case CALC_OP_MUL:
+			result.re = a.re * b.re - a.im * b.im;
+			result.im = a.re * b.im + a.im * b.re;
+			break;
+		case CALC_OP_DIV:
+			den = b.re * b.re + b.im * b.im;
+			if (den > EPSILON * EPSILON) {  // |b| > EPSILON, as in the scalar modes
+				result.re = (a.re * b.re + a.im * b.im) / den;
+				result.im = (a.im * b.re - a.re * b.im) / den;
+			} else {
+				*status = CALC_Q_DIV_BY_ZERO;
+			}
+			break;
+		case CALC_OP_CONJ:
+			result.re = a.re;
+			result.im = -a.im;
+			break;
+		case CALC_OP_MAG:
+			result.re = hypotf(a.re, a.im);
+			break;
+		case CALC_OP_PHASE:
+			result.re = atan2f(a.im, a.re);
+			break;
+		default:  // CALC_OP_RESET
+			break;
+	}
+	return result;
+}
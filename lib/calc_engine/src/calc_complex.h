@@ -0,0 +1,63 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+#ifndef CALC_COMPLEX_H_
+#define CALC_COMPLEX_H_
+
+/**@file
+ * @defgroup calc_complex Complex arithmetic
+ * @{
+ * @brief Complex (I/Q) kernels for COMPLEX_Q15_MODE and COMPLEX_FLOAT_MODE.
+ *
+ * A COMPLEX_Q15_MODE operand is one 32-bit word holding re in the low and im in the high
+ * halfword, the layout of the Cortex-M4 dual 16-bit multiply instructions used on targets with
+ * the DSP extension. Q15 results saturate.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "calc_port.h"
+
+struct calc_complex {
+	float re;
+	float im;
+};
+
+#define CALC_CQ15(re, im) ((uint32_t)(uint16_t)(re) | ((uint32_t)(uint16_t)(im) << 16))
+#define CALC_CQ15_RE(v)   ((int16_t)((v) & 0xFFFF))
+#define CALC_CQ15_IM(v)   ((int16_t)((uint32_t)(v) >> 16))
+
+/** @brief Execute a COMPLEX_Q15_MODE operation.
+ *
+ * @param[in] operation CALC_OP_RESET ... CALC_OP_DIV, CALC_OP_CONJ, CALC_OP_MAG or CALC_OP_PHASE.
+ * @param[in] a Packed operand 1.
+ * @param[in] b Packed operand 2.
+ * @param[out] status CALC_Q_OK or CALC_Q_DIV_BY_ZERO.
+ *
+ * @retval Packed result. CALC_OP_MAG and CALC_OP_PHASE (angle / pi) return a sign-extended Q15.
+ */
+int32_t calc_complex_q15(uint8_t operation, int32_t a, int32_t b, uint8_t *status);
+
+/** @brief Execute a COMPLEX_FLOAT_MODE operation.
+ *
+ * @param[out] status CALC_Q_OK or CALC_Q_DIV_BY_ZERO.
+ *
+ * @retval Result. CALC_OP_MAG and CALC_OP_PHASE (radians) return it in re, im is 0.
+ */
+struct calc_complex calc_complex_f32(uint8_t operation, struct calc_complex a,
+				     struct calc_complex b, uint8_t *status);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* CALC_COMPLEX_H_ */
@@ -0,0 +1,471 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief Calculator engine
+ */
+
+#include "calc_port.h"
+#include <errno.h>
+#include <string.h>
+#include "calc_engine.h"
+#include "fp16.h"
+#include "calc_q.h"
+#include "calc_stats.h"
+#include "calc_vec.h"
+#include "calc_fft.h"
+#include "calc_filter.h"
+#include "calc_sort.h"
+#include "calc_complex.h"
+#include "calc_func.h"
+#include "calc_arena.h"
+
+static const struct calc_engine_ops *engine_ops;
+static struct calc_engine_state state;  // Previous results, operand 1 of CDS_TASK_FLAG_ACC tasks
+static uint8_t task_origin;  // Origin of the task being calculated, for its intermediate results
+static uint8_t task_origin_gen;
+#if defined(CONFIG_CDS_LATENCY)
+static uint32_t task_t_rx;  // Stamp of the task being calculated, for its intermediate results
+#endif
+// -------------------------------------------------------------------------------------------------
+
+// Pass an intermediate result of a multi-result operation, always packed with the following ones
+static void emit_result(ReturnType type, int32_float_union value)
+{
+	ReturnValue result = { .value = value, .type = type, .batched = true, .origin = task_origin,
+			      .origin_gen = task_origin_gen };
+
+	if (!engine_ops || !engine_ops->emit) {
+		return;
+	}
+#if defined(CONFIG_CDS_LATENCY)
+	result.t_rx = task_t_rx;
+#endif
+	engine_ops->emit(&result);
+}
+
+static void engine_log(uint8_t event, uint8_t mode, uint8_t operation, int32_t value)
+{
+	if (engine_ops && engine_ops->log) {
+		engine_ops->log(event, mode, operation, value);
+	}
+}
+
+static ReturnValue calculate_stats(const struct calculator_task *task)
+{
+	bool fixed = (task->mode & CDS_MODE_FORMAT_MASK) == FIXED_MODE;
+	bool half = task->mode == HALF_MODE;
+	ReturnType value_type = fixed ? INT32_TYPE : (half ? HALF_TYPE : FLOAT_TYPE);
+	int32_float_union operand_1 = { .u = task->q31_operand_1 };
+	int32_float_union operand_2 = { .u = task->q31_operand_2 };
+	ReturnValue result = { .type = INT32_TYPE, .batched = (task->flags & CDS_TASK_FLAG_BATCH) != 0 };
+	struct calc_stats_snapshot snapshot;
+	int err = -EINVAL;
+
+	if (!fixed && task->mode != FLOAT_MODE && !half) {
+		engine_log(CALC_ENGINE_LOG_OP_ERROR, task->mode, task->operation, -ENOTSUP);
+		result.value.u = -ENOTSUP;
+		return result;
+	}
+
+	switch (task->operation) {
+		case CALC_OP_STAT_SELECT:
+			if (fixed || task->f_operand_1 >= 0.0f) {
+				err = calc_stats_select(fixed ? (uint32_t)task->q31_operand_1 : (uint32_t)task->f_operand_1);
+			}
+			result.value.u = err;
+			break;
+		case CALC_OP_STAT_RESET:
+			result.value.u = calc_stats_reset(fixed, operand_1, operand_2);
+			break;
+		case CALC_OP_STAT_PUSH:
+			err = calc_stats_push(fixed, operand_1);
+			if (err) {  // Sample does not match the stream type
+				engine_log(CALC_ENGINE_LOG_OP_ERROR, task->mode, task->operation, err);
+			}
+			result.type = NONE_TYPE;
+			break;
+		case CALC_OP_STAT_SNAPSHOT:
+			calc_stats_snapshot(&snapshot);
+			if (half && !snapshot.fixed) {  // Round the float aggregates to the HALF_MODE wire format
+				snapshot.mean.h = fp16_from_float(snapshot.mean.f);
+				snapshot.variance.h = fp16_from_float(snapshot.variance.f);
+				snapshot.min.h = fp16_from_float(snapshot.min.f);
+				snapshot.max.h = fp16_from_float(snapshot.max.f);
+			}
+			emit_result(INT32_TYPE, (int32_float_union){ .u = snapshot.count });
+			emit_result(value_type, snapshot.mean);
+			emit_result(value_type, snapshot.variance);
+			emit_result(value_type, snapshot.min);
+			emit_result(value_type, snapshot.max);
+			if (snapshot.fixed) {  // Q40, low word first
+				emit_result(INT32_TYPE, (int32_float_union){ .u = (int32_t)snapshot.sum_sq_q40 });
+				emit_result(INT32_TYPE, (int32_float_union){ .u = (int32_t)(snapshot.sum_sq_q40 >> 32) });
+			} else {
+				emit_result(half ? HALF_TYPE : FLOAT_TYPE,
+					    half ? (int32_float_union){ .h = fp16_from_float(snapshot.sum_sq) }
+						 : (int32_float_union){ .f = snapshot.sum_sq });
+			}
+			for (int i = 0; i < CONFIG_CDS_STAT_HIST_BINS - 1; i++) {
+				emit_result(INT32_TYPE, (int32_float_union){ .u = snapshot.hist[i] });
+			}
+			result.value.u = snapshot.hist[CONFIG_CDS_STAT_HIST_BINS - 1];
+			result.batched = true;
+			break;
+		default:
+			break;
+	}
+
+	return result;
+}
+
+// Notify the elements of a buffer as one packed result batch, the last one is returned
+static ReturnValue emit_buffer(uint8_t id)
+{
+	int32_float_union chunk[16];
+	ReturnValue result = { .type = INT32_TYPE, .batched = true };
+	uint32_t first = 0;
+	uint8_t type;
+	int count;
+
+	while ((count = calc_vec_read(id, first, chunk, ARRAY_SIZE(chunk), &type)) > 0) {
+		ReturnType value_type = (type == FLOAT_MODE) ? FLOAT_TYPE : INT32_TYPE;
+
+		if (first > 0) {
+			emit_result(result.type, result.value);  // Held back in case it is the last one
+		}
+		for (int i = 0; i < count - 1; i++) {
+			emit_result(value_type, chunk[i]);
+		}
+		result.type = value_type;
+		result.value = chunk[count - 1];
+		first += count;
+	}
+	if (count < 0) {
+		result.value.u = count;
+	}
+	return result;
+}
+
+// dst of these opcodes is a filter or function id, or unused, not a buffer to notify
+static bool vec_dst_is_buffer(uint8_t operation)
+{
+	return operation != CALC_OP_FILT_CREATE && operation != CALC_OP_FILT_RESET &&
+	       operation != CALC_OP_FUNC_DEFINE && operation != CALC_OP_FUNC_DELETE &&
+	       operation != CALC_OP_VEC_CLEAR;
+}
+
+static ReturnValue calculate_vec(const struct calculator_task *task)
+{
+	uint32_t desc = (uint32_t)task->q31_operand_1;
+	uint8_t dst = desc & 0xFF;
+	uint8_t a = (desc >> 8) & 0xFF;
+	uint8_t b = (desc >> 16) & 0xFF;
+	int32_float_union scalar = { .u = task->q31_operand_2 };
+	ReturnValue result = { .type = INT32_TYPE, .batched = (task->flags & CDS_TASK_FLAG_BATCH) != 0 };
+	int err;
+
+	switch (task->operation) {
+		case CALC_OP_VEC_ADD:
+			err = calc_vec_elementwise(CALC_OP_ADD, task->mode, dst, a, b);
+			break;
+		case CALC_OP_VEC_SUB:
+			err = calc_vec_elementwise(CALC_OP_SUB, task->mode, dst, a, b);
+			break;
+		case CALC_OP_VEC_MUL:
+			err = calc_vec_elementwise(CALC_OP_MUL, task->mode, dst, a, b);
+			break;
+		case CALC_OP_VEC_SCALAR:
+			err = calc_vec_scalar(b, task->mode, dst, a, scalar);
+			break;
+		case CALC_OP_VEC_DOT:
+			err = calc_vec_dot(task->mode, a, b, &result.value);
+			if (!err) {
+				result.type = (task->mode == FLOAT_MODE) ? FLOAT_TYPE : INT32_TYPE;
+				return result;
+			}
+			break;
+		case CALC_OP_MAT_VEC:
+		case CALC_OP_MAT_MUL:
+			err = calc_vec_mat_mul(task->mode, dst, a, b);
+			break;
+		case CALC_OP_VEC_READ:
+			return emit_buffer(dst);
+		case CALC_OP_FFT:
+			err = calc_fft(task->mode, dst, a, b);
+			break;
+		case CALC_OP_FILT_CREATE:
+			err = calc_filter_create(dst, task->mode, b, a, (uint8_t)task->q31_operand_2);
+			break;
+		case CALC_OP_FILT_RESET:
+			err = calc_filter_reset(dst);
+			break;
+		case CALC_OP_FILTER:
+			err = calc_filter_run(b, dst, a);
+			break;
+		case CALC_OP_SORT:
+			err = calc_sort(task->mode, dst, a, b != 0);
+			break;
+		case CALC_OP_NTH:
+		case CALC_OP_MEDIAN:
+			err = (task->operation == CALC_OP_NTH) ?
+				      calc_sort_nth(task->mode, a, (uint32_t)task->q31_operand_2, &result.value) :
+				      calc_sort_median(task->mode, a, &result.value);
+			if (!err) {
+				result.type = (task->mode == FLOAT_MODE) ? FLOAT_TYPE : INT32_TYPE;
+				return result;
+			}
+			break;
+		case CALC_OP_TOP_K:
+			err = calc_sort_top_k(task->mode, dst, a, b);
+			break;
+		case CALC_OP_FUNC_DEFINE:
+			err = calc_func_define(dst, task->mode, b, a, (uint8_t)task->q31_operand_2);
+			break;
+		case CALC_OP_FUNC_DELETE:
+			err = calc_func_delete(dst);
+			break;
+		case CALC_OP_FUNC_EVAL:
+			err = calc_func_eval(b, dst, a);
+			break;
+		case CALC_OP_VEC_CLEAR:
+			calc_vec_clear();
+			calc_arena_reset();  // The buffers are the only arena owners
+			err = 0;
+			break;
+		default:
+			err = -ENOTSUP;
+			break;
+	}
+
+	if (err < 0) {
+		engine_log(CALC_ENGINE_LOG_OP_ERROR, task->mode, task->operation, err);
+	} else if ((desc & CALC_VEC_EMIT) && vec_dst_is_buffer(task->operation)) {
+		return emit_buffer(dst);
+	}
+	result.value.u = err;  // Number of result elements or error code
+	return result;
+}
+
+static ReturnValue calculate_complex(const struct calculator_task *task)
+{
+	ReturnValue result = { .type = INT32_TYPE, .batched = (task->flags & CDS_TASK_FLAG_BATCH) != 0 };
+	bool acc = (task->flags & CDS_TASK_FLAG_ACC) != 0;
+	bool real = task->operation == CALC_OP_MAG || task->operation == CALC_OP_PHASE;
+	uint8_t status;
+
+	if (task->mode == COMPLEX_Q15_MODE) {
+		result.value.u = calc_complex_q15(task->operation, acc ? state.acc_q[COMPLEX_Q15_MODE] : task->q31_operand_1,
+						  task->q31_operand_2, &status);
+		result.type = real ? INT16_TYPE : INT32_TYPE;
+		state.acc_q[COMPLEX_Q15_MODE] = real ? (int32_t)CALC_CQ15(result.value.u, 0) : result.value.u;
+	} else {  // COMPLEX_FLOAT_MODE
+		struct calc_complex a = { task->f_operand_1, task->f_operand_1_im };
+		struct calc_complex b = { task->f_operand_2, task->f_operand_2_im };
+
+		state.acc_c = calc_complex_f32(task->operation, acc ? state.acc_c : a, b, &status);
+		result.type = FLOAT_TYPE;
+		result.value.f = state.acc_c.re;
+		if (!real) {  // Real and imaginary part in the same notification
+			emit_result(FLOAT_TYPE, result.value);
+			result.value.f = state.acc_c.im;
+			result.batched = true;
+		}
+	}
+	if (status == CALC_Q_DIV_BY_ZERO) {
+		engine_log(CALC_ENGINE_LOG_DIV_ZERO, task->mode, task->operation, 0);
+	}
+	return result;
+}
+
+static ReturnValue calculate_ext(const struct calculator_task *task)
+{
+	ReturnValue result = { .type = INT32_TYPE, .batched = (task->flags & CDS_TASK_FLAG_BATCH) != 0 };
+	int ret = engine_ops->ext(task, &result.value);
+
+	if (ret < 0 || ret > NONE_TYPE) {  // Error code as the INT32_TYPE result
+		result.value.u = (ret < 0) ? ret : -EINVAL;
+	} else {
+		result.type = ret;
+	}
+	return result;
+}
+
+static ReturnValue calculate_task(struct calculator_task task)
+{
+	float result_f = 0.0f;	// Initialize the floating-point result to 0
+	int32_t result_q31 = 0;	// Initialize the fixed-point result to 0
+
+	ReturnValue result;
+
+	if (task.operation >= CALC_OP_STAT_SELECT && task.operation <= CALC_OP_STAT_SNAPSHOT) {
+		return calculate_stats(&task);
+	}
+	if (task.operation >= CALC_OP_VEC_ADD && task.operation <= CALC_OP_FUNC_EVAL &&
+	    (task.operation < CALC_OP_CONJ || task.operation > CALC_OP_PHASE)) {  // Complex ops in between
+		return calculate_vec(&task);
+	}
+	if (task.operation >= CALC_OP_EXT_BASE && engine_ops && engine_ops->ext) {
+		return calculate_ext(&task);
+	}
+
+	if (task.mode == COMPLEX_Q15_MODE || task.mode == COMPLEX_FLOAT_MODE) {
+		return calculate_complex(&task);
+	}
+
+	if (task.flags & CDS_TASK_FLAG_ACC) {  // Single-argument operation on the previous result
+		if (task.mode == FLOAT_MODE || task.mode == HALF_MODE) {
+			task.f_operand_1 = state.acc_f;
+		} else {
+			task.q31_operand_1 = state.acc_q[task.mode & CDS_MODE_FORMAT_MASK];
+		}
+	}
+
+	if (task.mode == FLOAT_MODE || task.mode == HALF_MODE) {  // HALF_MODE operands were widened on write
+		switch (task.operation) {
+			case CALC_OP_RESET: // Reset
+				result_f = 0.0f;
+				break;
+			case CALC_OP_ADD: // Add
+				result_f = task.f_operand_1 + task.f_operand_2;
+				break;
+			case CALC_OP_SUB: // Subtract
+				result_f = task.f_operand_1 - task.f_operand_2;
+				break;
+			case CALC_OP_MUL: // Multiply
+				result_f = task.f_operand_1 * task.f_operand_2;
+				break;
+			case CALC_OP_DIV: // Divide
+				if (task.f_operand_2 > EPSILON || task.f_operand_2 < -EPSILON) { // Division by zero, also checked in TEST TOOL python app
+					result_f = task.f_operand_1 / task.f_operand_2;
+				} else {
+					engine_log(CALC_ENGINE_LOG_DIV_ZERO, task.mode, task.operation, 0);
+					result_f = 0.0f;
+				}
+				break;
+			default:
+				break;
+			/*
+			 if (isinf(result_f) || isnan(result_f)){
+				printk("Float Overflow!");
+			result_q31 = 0.0f;
+			 }
+			*/
+		}
+	} else { // Fixed-point modes - https://en.wikipedia.org/wiki/Q_(number_format)
+		uint8_t status;
+
+		// Kernel generated for the format and overflow policy selected by the mode
+		result_q31 = calc_q_execute(task.mode, task.operation, task.q31_operand_1,
+					    task.q31_operand_2, &status);
+		if (status == CALC_Q_INVALID) {  // Unknown mode, the accumulators are left alone
+			engine_log(CALC_ENGINE_LOG_OP_ERROR, task.mode, task.operation, -EINVAL);
+			result.value.u = result_q31;
+			result.type = INT32_TYPE;
+			result.batched = (task.flags & CDS_TASK_FLAG_BATCH) != 0;
+			return result;
+		} else if (status == CALC_Q_OVERFLOW) {
+			engine_log(CALC_ENGINE_LOG_OVERFLOW, task.mode, task.operation, 0);
+		} else if (status == CALC_Q_DIV_BY_ZERO) {  // Also checked in TEST TOOL python app
+			engine_log(CALC_ENGINE_LOG_DIV_ZERO, task.mode, task.operation, 0);
+		}
+	}
+
+    // Notify result
+    if (task.mode == FLOAT_MODE) {
+		result.value.f = result_f;
+		result.type = FLOAT_TYPE;
+		state.acc_f = result_f;
+    } else if (task.mode == HALF_MODE) {
+		result.value.u = 0;
+		result.value.h = fp16_from_float(result_f);  // Round back to binary16
+		result.type = HALF_TYPE;
+		state.acc_f = fp16_to_float(result.value.h);  // Accumulate what the client has seen
+    } else { // Fixed-point modes
+		result.value.u = result_q31;
+		result.type = ((task.mode & CDS_MODE_FORMAT_MASK) == Q15_MODE) ? INT16_TYPE : INT32_TYPE;
+		state.acc_q[task.mode & CDS_MODE_FORMAT_MASK] = result_q31;
+    }
+	result.batched = (task.flags & CDS_TASK_FLAG_BATCH) != 0;
+
+	return result;
+}
+
+// Session ----------------------------------------------------------------------------------------
+static ReturnValue calculate_session(const struct calculator_task *task)
+{
+	struct calc_arena_stats stats;
+	ReturnValue result = { .type = INT32_TYPE, .batched = (task->flags & CDS_TASK_FLAG_BATCH) != 0 };
+
+	calc_arena_stats(&stats);
+	if (task->operation == CALC_OP_SESSION_RESET) {
+		calc_vec_clear();  // Owners drop their blocks before the arena is reset
+		calc_arena_reset();
+		result.value.u = stats.used;
+		return result;
+	}
+
+	emit_result(INT32_TYPE, (int32_float_union){ .u = stats.used });
+	emit_result(INT32_TYPE, (int32_float_union){ .u = stats.high_water });
+	emit_result(INT32_TYPE, (int32_float_union){ .u = stats.size });
+	result.value.u = stats.failures;
+	result.batched = true;
+	return result;
+}
+
+ReturnValue calc_engine_execute(struct calculator_task task)
+{
+	task_origin = task.origin;
+	task_origin_gen = task.origin_gen;
+#if defined(CONFIG_CDS_LATENCY)
+	task_t_rx = task.t_rx;
+#endif
+	if (task.operation == CALC_OP_JOB_SET || task.operation == CALC_OP_JOB_CLEAR) {
+		ReturnValue result = { .type = INT32_TYPE, .batched = (task.flags & CDS_TASK_FLAG_BATCH) != 0 };
+
+		result.value.u = -ENOTSUP;  // Scheduled by the host of the engine
+		return result;
+	}
+	if (task.operation == CALC_OP_SESSION_RESET || task.operation == CALC_OP_ARENA_STATS) {
+		return calculate_session(&task);
+	}
+	return calculate_task(task);
+}
+
+void calc_engine_emit(ReturnType type, int32_float_union value)
+{
+	emit_result(type, value);
+}
+
+const struct calc_engine_ops *calc_engine_set_ops(const struct calc_engine_ops *ops)
+{
+	const struct calc_engine_ops *prev = engine_ops;
+
+	engine_ops = ops;
+	return prev;
+}
+
+void calc_engine_state_save(struct calc_engine_state *out)
+{
+	*out = state;
+}
+
+void calc_engine_state_restore(const struct calc_engine_state *in)
+{
+	state = *in;
+}
+// -------------------------------------------------------------------------------------------------
+
+int32_t q_div(int32_t a, int32_t b)
+{
+	uint8_t status;
+	int32_t result = calc_q_execute(FIXED_MODE, CALC_OP_DIV, a, b, &status);
+
+	if (status == CALC_Q_OVERFLOW) {
+		engine_log(CALC_ENGINE_LOG_OVERFLOW, FIXED_MODE, CALC_OP_DIV, 0);
+	}
+	return result;
+}
@@ -0,0 +1,263 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+#ifndef CALC_ENGINE_H_
+#define CALC_ENGINE_H_
+
+/**@file
+ * @defgroup calc_engine Calculator engine
+ * @{
+ * @brief Tasks, results and execution of the calculator, independent of the transport and the OS.
+ *
+ * calc_engine_execute() runs one decoded task to completion in the calling thread and returns
+ * its (last) result. Everything the engine hands back to its host goes through the hooks of
+ * struct calc_engine_ops: intermediate results of multi-result operations, diagnostic events
+ * and extension opcodes. The firmware connects them to result_msgq, calc_trace and calc_ext;
+ * a host simulator or fuzzer links the same sources as a static library (lib/calc_engine).
+ *
+ * Standing jobs and the self-benchmark need timers and are scheduled by the firmware around
+ * the engine, see my_cds_calculate_result().
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "calc_port.h"
+#include "calc_complex.h"
+
+// MODES:
+#define FLOAT_MODE 0  // 32-bit floating-point mode
+#define FIXED_MODE 1  // Q31 fixed-point mode
+#define HALF_MODE  2  // 16-bit half-precision (binary16) on the wire, 32-bit float in the engine
+#define Q15_MODE    3  // Q15 fixed-point mode (sign-extended 16-bit operands)
+#define Q7_24_MODE  4  // Q7.24 fixed-point mode
+#define Q16_16_MODE 5  // Q16.16 fixed-point mode
+#define COMPLEX_Q15_MODE   6  // (re, im) Q15 pair packed in one 32-bit operand, re in the low half
+#define COMPLEX_FLOAT_MODE 7  // (re, im) float pair, imaginary parts in f_operand_1_im/f_operand_2_im
+
+// Overflow policy of the fixed-point modes, OR-ed into the mode. Without one, FIXED_MODE returns
+// zero on overflow (original behaviour) and the other fixed-point modes saturate.
+#define CDS_MODE_FORMAT_MASK 0x0F
+#define CDS_MODE_SAT         0x10  // Saturate
+#define CDS_MODE_WRAP        0x20  // Two's complement wrap-around
+
+// OPERATIONS:
+#define CALC_OP_RESET 0
+#define CALC_OP_ADD   1
+#define CALC_OP_SUB   2
+#define CALC_OP_MUL   3
+#define CALC_OP_DIV   4
+// Streaming statistics (float and Q31), see calc_stats.h. Float modes pass the stream id as a number.
+#define CALC_OP_STAT_SELECT   5  // Operand 1: stream id. Result: status
+#define CALC_OP_STAT_RESET    6  // Operands: histogram range [lo, hi). Result: status
+#define CALC_OP_STAT_PUSH     7  // Operand 1: sample. No result
+#define CALC_OP_STAT_SNAPSHOT 8  // Results: count, mean, variance, min, max, sum of squares, histogram
+// Vector and matrix operations on uploaded buffers (float or Q31), see calc_vec.h.
+// Operand 1 is a raw descriptor built with CALC_VEC_DESC(), whatever the mode.
+#define CALC_OP_VEC_ADD    9   // dst = a + b, element-wise
+#define CALC_OP_VEC_SUB    10  // dst = a - b, element-wise
+#define CALC_OP_VEC_MUL    11  // dst = a * b, element-wise
+#define CALC_OP_VEC_SCALAR 12  // dst = a (op) operand 2, op = CALC_OP_ADD..CALC_OP_DIV in place of b
+#define CALC_OP_VEC_DOT    13  // Result: a . b
+#define CALC_OP_MAT_VEC    14  // dst = a * b, b is a vector
+#define CALC_OP_MAT_MUL    15  // dst = a * b
+#define CALC_OP_VEC_READ   16  // Results: elements of dst
+#define CALC_OP_VEC_CLEAR  17  // Drop all buffers and release the session arena
+#define CALC_OP_FFT        18  // dst = real FFT of a, b = top-K magnitude bins or 0, see calc_fft.h
+// Streaming filters, see calc_filter.h. The filter id takes the dst byte of the descriptor.
+#define CALC_OP_FILT_CREATE 19  // Filter dst from coefficient buffer a, b = kind. Operand 2: post shift
+#define CALC_OP_FILT_RESET  20  // Clear the state of filter dst
+#define CALC_OP_FILTER      21  // dst = a run through filter b, state kept for the next run
+// Sort and selection, see calc_sort.h
+#define CALC_OP_SORT   22  // dst = a sorted, ascending or descending if b is not 0
+#define CALC_OP_NTH    23  // Result: element of rank operand 2 in a
+#define CALC_OP_MEDIAN 24  // Result: median of a
+#define CALC_OP_TOP_K  25  // dst = the b largest elements of a, descending
+// Complex modes only, see calc_complex.h
+#define CALC_OP_CONJ  26  // Result: conj(operand 1)
+#define CALC_OP_MAG   27  // Result: |operand 1|
+#define CALC_OP_PHASE 28  // Result: arg(operand 1)
+// Function store, see calc_func.h. The function id takes the dst byte of the descriptor.
+#define CALC_OP_FUNC_DEFINE 29  // Function dst from buffer a, b = kind. Operand 2: Q31 shift
+#define CALC_OP_FUNC_DELETE 30  // Delete function dst
+#define CALC_OP_FUNC_EVAL   31  // dst = f(a), f = function b
+// Standing jobs, see calc_jobs.h
+#define CALC_OP_JOB_SET   32  // Repeat the previous task. Operand 1: CALC_JOB_DESC(), operand 2: threshold
+#define CALC_OP_JOB_CLEAR 33  // Operand 1: job id, CALC_JOB_ALL for all jobs
+// Session, see calc_arena.h
+#define CALC_OP_SESSION_RESET 34  // Stop jobs, drop buffers, reset the arena. Result: bytes released
+#define CALC_OP_ARENA_STATS   35  // Results: used, high-water mark, size, failed allocations
+// Loadable kernels, see calc_ext.h
+#define CALC_OP_EXT_BASE 0x80  // First opcode available to LLEXT extensions, 0x81 is the codec marker
+
+#define CALC_VEC_EMIT 0x01000000  // Descriptor flag: notify the elements of dst instead of the count,
+                                  // ignored when dst is a filter or function id
+#define CALC_VEC_DESC(dst, a, b) ((uint32_t)(dst) | ((uint32_t)(a) << 8) | ((uint32_t)(b) << 16))
+
+// TASK FLAGS:
+#define CDS_TASK_FLAG_ACC   0x01  // Operand 1 is the result of the previous operation
+#define CDS_TASK_FLAG_BATCH 0x02  // Part of a batch frame, the result is packed with its neighbours
+#define CDS_TASK_FLAG_JOB   0x04  // Re-evaluation of standing job 'job', see calc_jobs.h
+#define CDS_TASK_FLAG_BENCH 0x08  // Run the self-benchmark spec, see calc_bench.h
+#define CDS_TASK_FLAG_SESSION 0x10  // End of a kept client session, see cds_session.h
+#define CDS_TASK_FLAG_WORKLOAD 0x20  // Self-benchmark workload, run in place by the engine thread
+// -------------------------------------------------------------------------------------------------
+struct calculator_task {		// Engine task, decoded from the wire by cds_codec
+	union {						// Union for 1 argument, allowing either float or fixed-point integer.
+		float f_operand_1;		// 32-bit floating-point operand
+		int32_t q31_operand_1;	// Fixed-point (Q31) operand
+	};
+	union {						// Union for 2 argument, allowing either float or fixed-point integer.
+		float f_operand_2;		// 32-bit floating-point operand
+		int32_t q31_operand_2;	// Fixed-point (Q31) operand
+	};
+	float f_operand_1_im;		// COMPLEX_FLOAT_MODE: imaginary part of operand 1
+	float f_operand_2_im;		// COMPLEX_FLOAT_MODE: imaginary part of operand 2
+	uint8_t operation;			// Operation to be performed (e.g., add, subtract)
+	uint8_t mode;				// Mode: FLOAT_MODE, HALF_MODE, a fixed-point or a complex mode
+	uint8_t flags;				// CDS_TASK_FLAG_*
+	uint8_t job;				// Standing job id, with CDS_TASK_FLAG_JOB
+	uint8_t job_gen;			// Generation of the job, evaluations of a replaced job are dropped
+	uint8_t origin;				// Transport the task came from, copied to its results
+	uint8_t origin_gen;			// Generation of the origin (session slot reuse, UART frame seq), copied too
+#if defined(CONFIG_CDS_LATENCY)
+	uint32_t t_rx;				// k_cycle_get_32() when queued, see calc_latency.h
+#endif
+};
+// -------------------------------------------------------------------------------------------------
+#pragma pack(push, 1) // Preserve current packing settings and set packing to 1 byte
+struct calculator_task_legacy {	// Original 10-byte wire format
+	uint8_t operation;			// Operation to be performed (e.g., add, subtract)
+	union {						// Union for 1 argument, allowing either float or fixed-point integer.
+		float f_operand_1;		// 32-bit floating-point operand
+        int32_t q31_operand_1;	// Fixed-point (Q31) operand
+	};
+	union {						// Union for 2 argument, allowing either float or fixed-point integer.
+		float f_operand_2;		// 32-bit floating-point operand
+		int32_t q31_operand_2;	// Fixed-point (Q31) operand
+	};
+	uint8_t mode;				// Mode: floating-point (0) or fixed-point (1)
+};
+
+struct calculator_task_f16 {	// HALF_MODE wire format, a write may carry several back to back
+	uint8_t operation;			// Operation to be performed (e.g., add, subtract)
+	uint16_t h_operand_1;		// binary16 operand
+	uint16_t h_operand_2;		// binary16 operand
+	uint8_t mode;				// Mode: always HALF_MODE
+};
+#pragma pack(pop) // Restore original packing
+// -------------------------------------------------------------------------------------------------
+typedef union {
+    int32_t u;
+    float f;
+    uint16_t h;  // binary16 bit pattern
+} int32_float_union;
+
+typedef enum {
+    INT32_TYPE,
+    FLOAT_TYPE,
+    HALF_TYPE,
+    INT16_TYPE,  // Q15, sign-extended in value.u
+    NONE_TYPE    // Operation without a result, nothing is notified
+} ReturnType;
+
+typedef struct {
+    int32_float_union value;
+    ReturnType type;
+    bool batched;  // Task had CDS_TASK_FLAG_BATCH
+    uint8_t origin;  // Origin of the task, not interpreted by the engine
+    uint8_t origin_gen;  // Generation of the origin, not interpreted either
+#if defined(CONFIG_CDS_LATENCY)
+    uint32_t t_rx;    // Task queued, k_cycle_get_32()
+    uint32_t t_done;  // Result ready
+#endif
+} ReturnValue;
+// -------------------------------------------------------------------------------------------------
+
+#define EPSILON 1e-10  // Division by zero
+
+// -------------------------------------------------------------------------------------------------
+// Diagnostic events of the log hook, same ids as the CALC_TRACE_* records of the firmware
+#define CALC_ENGINE_LOG_DIV_ZERO 3  // Division by zero, the result is 0
+#define CALC_ENGINE_LOG_OVERFLOW 4  // Fixed-point overflow handled by the mode policy
+#define CALC_ENGINE_LOG_OP_ERROR 5  // Operation failed, value: error code
+
+/** @brief Hooks of the engine host. Any of them can be NULL. */
+struct calc_engine_ops {
+	/** Intermediate result of a multi-result operation. They are always batched and come
+	 *  before the result returned by calc_engine_execute(). NULL drops them.
+	 */
+	void (*emit)(const ReturnValue *result);
+	/** Diagnostic event (CALC_ENGINE_LOG_*) of a task, NULL drops it. */
+	void (*log)(uint8_t event, uint8_t mode, uint8_t operation, int32_t value);
+	/** Operation with an opcode from CALC_OP_EXT_BASE up, returns the ReturnType of the
+	 *  result or a negative error code. Without it these opcodes run as scalar no-ops.
+	 */
+	int (*ext)(const struct calculator_task *task, int32_float_union *result);
+};
+
+/** @brief Accumulated results, operand 1 of CDS_TASK_FLAG_ACC tasks. */
+struct calc_engine_state {
+	float acc_f;  // FLOAT_MODE and HALF_MODE
+	int32_t acc_q[CDS_MODE_FORMAT_MASK + 1];  // Per fixed-point format
+	struct calc_complex acc_c;  // COMPLEX_FLOAT_MODE
+};
+
+/** @brief Set the engine hooks.
+ *
+ * May be called again to swap them, the engine state is kept.
+ *
+ * @param[in] ops Hooks, must stay valid while set. NULL for none.
+ *
+ * @retval The hooks set before.
+ */
+const struct calc_engine_ops *calc_engine_set_ops(const struct calc_engine_ops *ops);
+
+/** @brief Execute a task.
+ *
+ * Arithmetic in every mode, statistics, vector/matrix, FFT, filter, sort, function store and
+ * session operations. CALC_OP_JOB_SET and CALC_OP_JOB_CLEAR return -ENOTSUP, standing jobs are
+ * scheduled by the host of the engine. Not reentrant: one thread executes tasks.
+ *
+ * @param[in] task Decoded task.
+ *
+ * @retval Result of the task, NONE_TYPE if there is nothing to return.
+ */
+ReturnValue calc_engine_execute(struct calculator_task task);
+
+/** @brief Pass an intermediate result of the task being executed to the emit hook.
+ *
+ * For hosts extending the engine dispatch (e.g. the standing job id ahead of its result).
+ */
+void calc_engine_emit(ReturnType type, int32_float_union value);
+
+/** @brief Copy the accumulated results. */
+void calc_engine_state_save(struct calc_engine_state *state);
+
+/** @brief Replace the accumulated results. */
+void calc_engine_state_restore(const struct calc_engine_state *state);
+
+/** @brief Calculate the result of q31 division.
+ *
+ * This function calculates an int32_t division result value. 
+ *
+ * @param[in] a dividend
+* @param[in] b divider
+ *
+ * @retval int32_t result value.
+ */
+int32_t q_div(int32_t a, int32_t b);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* CALC_ENGINE_H_ */
@@ -0,0 +1,68 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+#ifndef CALC_ENGINE_CONFIG_H_
+#define CALC_ENGINE_CONFIG_H_
+
+/**@file
+ * @defgroup calc_engine_config Calculator engine host configuration
+ * @{
+ * @brief Kconfig defaults of the engine (lib/calc_engine/Kconfig) for host builds.
+ *
+ * Used instead of Kconfig outside Zephyr. Override a value with a compile definition, e.g.
+ * -DCONFIG_CDS_VEC_BUFFERS=16, to match the configuration of the firmware under test.
+ * Features that need the kernel or CMSIS-DSP (settings, CMSIS-DSP kernels) stay disabled.
+ */
+
+#ifndef CONFIG_CDS_STAT_STREAMS
+#define CONFIG_CDS_STAT_STREAMS 4
+#endif
+#ifndef CONFIG_CDS_STAT_HIST_BINS
+#define CONFIG_CDS_STAT_HIST_BINS 16
+#endif
+#ifndef CONFIG_CDS_VEC_BUFFERS
+#define CONFIG_CDS_VEC_BUFFERS 8
+#endif
+#ifndef CONFIG_CDS_SESSION_ARENA_SIZE
+#define CONFIG_CDS_SESSION_ARENA_SIZE 16384
+#endif
+#ifndef CONFIG_CDS_FFT_MAX_LEN
+#define CONFIG_CDS_FFT_MAX_LEN 1024
+#endif
+#ifndef CONFIG_CDS_FFT_TOP_K_MAX
+#define CONFIG_CDS_FFT_TOP_K_MAX 16
+#endif
+#ifndef CONFIG_CDS_SORT_MAX_LEN
+#define CONFIG_CDS_SORT_MAX_LEN 1024
+#endif
+#ifndef CONFIG_CDS_FILTERS
+#define CONFIG_CDS_FILTERS 4
+#endif
+#ifndef CONFIG_CDS_FILTER_MAX_TAPS
+#define CONFIG_CDS_FILTER_MAX_TAPS 64
+#endif
+#ifndef CONFIG_CDS_FILTER_MAX_STAGES
+#define CONFIG_CDS_FILTER_MAX_STAGES 8
+#endif
+#ifndef CONFIG_CDS_FILTER_BLOCK
+#define CONFIG_CDS_FILTER_BLOCK 32
+#endif
+#ifndef CONFIG_CDS_FUNCS
+#define CONFIG_CDS_FUNCS 8
+#endif
+#ifndef CONFIG_CDS_FUNC_PWL_POINTS
+#define CONFIG_CDS_FUNC_PWL_POINTS 32
+#endif
+#if !defined(CONFIG_CDS_FP16_ROUND_TOWARD_ZERO) && !defined(CONFIG_CDS_FP16_ROUND_UP) && \
+	!defined(CONFIG_CDS_FP16_ROUND_DOWN)
+#define CONFIG_CDS_FP16_ROUND_NEAREST_EVEN 1
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* CALC_ENGINE_CONFIG_H_ */
@@ -0,0 +1,342 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief Real FFT
+ */
+
+#include "calc_port.h"
+#include <errno.h>
+#include <string.h>
+#include <math.h>
+#include "calc_fft.h"
+#include "calc_vec.h"
+
+#if defined(CONFIG_CDS_FFT_CMSIS_DSP)
+#include <arm_math.h>
+#define FFT_SCRATCH_LEN (2 * CONFIG_CDS_FFT_MAX_LEN + 2)  // rfft_fast_f32 needs separate input and output
+#else
+#define FFT_SCRATCH_LEN (CONFIG_CDS_FFT_MAX_LEN + 2)  // In place, bins 0 ... N/2
+#endif
+
+#define FFT_PI 3.14159265358979f
+
+static int32_float_union scratch[FFT_SCRATCH_LEN];  // Engine thread only
+
+struct fft_peak {
+	uint32_t bin;
+	int32_float_union magnitude;
+};
+// -------------------------------------------------------------------------------------------------
+
+static int32_t mul_q31(int32_t a, int32_t b)
+{
+	return (int32_t)(((int64_t)a * b) >> 31);
+}
+
+static int32_t q31_from_float(float f)
+{
+	return (f >= 1.0f) ? INT32_MAX : (int32_t)(f * 2147483648.0f);
+}
+
+static int32_t sat_q31(int64_t v)
+{
+	return (v > INT32_MAX) ? INT32_MAX : (v < INT32_MIN) ? INT32_MIN : (int32_t)v;
+}
+
+static uint32_t isqrt64(uint64_t v)
+{
+	uint64_t r = 0;
+	uint64_t bit = (uint64_t)1 << 62;
+
+	while (bit > v) {
+		bit >>= 2;
+	}
+	while (bit) {
+		if (v >= r + bit) {
+			v -= r + bit;
+			r = (r >> 1) + bit;
+		} else {
+			r >>= 1;
+		}
+		bit >>= 2;
+	}
+	return (uint32_t)r;
+}
+
+#if !defined(CONFIG_CDS_FFT_CMSIS_DSP)
+static uint32_t bit_reverse(uint32_t v, uint32_t bits)
+{
+	uint32_t r = 0;
+
+	for (uint32_t i = 0; i < bits; i++) {
+		r = (r << 1) | ((v >> i) & 1);
+	}
+	return r;
+}
+
+// Portable in-place radix-2 complex FFT of m interleaved (re, im) points
+static void cfft_ref_f32(float *z, uint32_t m, uint32_t log2m)
+{
+	for (uint32_t i = 0; i < m; i++) {
+		uint32_t j = bit_reverse(i, log2m);
+
+		if (j > i) {
+			float re = z[2 * i], im = z[2 * i + 1];
+
+			z[2 * i] = z[2 * j];
+			z[2 * i + 1] = z[2 * j + 1];
+			z[2 * j] = re;
+			z[2 * j + 1] = im;
+		}
+	}
+	for (uint32_t len = 2; len <= m; len <<= 1) {
+		for (uint32_t j = 0; j < len / 2; j++) {
+			float wr = cosf(2 * FFT_PI * j / len);
+			float wi = -sinf(2 * FFT_PI * j / len);
+
+			for (uint32_t i = j; i < m; i += len) {
+				float *u = &z[2 * i];
+				float *v = &z[2 * (i + len / 2)];
+				float tr = v[0] * wr - v[1] * wi;
+				float ti = v[0] * wi + v[1] * wr;
+
+				v[0] = u[0] - tr;
+				v[1] = u[1] - ti;
+				u[0] += tr;
+				u[1] += ti;
+			}
+		}
+	}
+}
+
+// Same as cfft_ref_f32 in Q31, scaled by 1/2 per stage (1/m in total) like arm_cfft_q31
+static void cfft_ref_q31(int32_t *z, uint32_t m, uint32_t log2m)
+{
+	for (uint32_t i = 0; i < m; i++) {
+		uint32_t j = bit_reverse(i, log2m);
+
+		if (j > i) {
+			int32_t re = z[2 * i], im = z[2 * i + 1];
+
+			z[2 * i] = z[2 * j];
+			z[2 * i + 1] = z[2 * j + 1];
+			z[2 * j] = re;
+			z[2 * j + 1] = im;
+		}
+	}
+	for (uint32_t len = 2; len <= m; len <<= 1) {
+		for (uint32_t j = 0; j < len / 2; j++) {
+			int32_t wr = q31_from_float(cosf(2 * FFT_PI * j / len));
+			int32_t wi = q31_from_float(-sinf(2 * FFT_PI * j / len));
+
+			for (uint32_t i = j; i < m; i += len) {
+				int32_t *u = &z[2 * i];
+				int32_t *v = &z[2 * (i + len / 2)];
+				int64_t tr = (int64_t)mul_q31(v[0], wr) - mul_q31(v[1], wi);
+				int64_t ti = (int64_t)mul_q31(v[0], wi) + mul_q31(v[1], wr);
+
+				v[0] = (int32_t)((u[0] - tr) >> 1);
+				v[1] = (int32_t)((u[1] - ti) >> 1);
+				u[0] = (int32_t)((u[0] + tr) >> 1);
+				u[1] = (int32_t)((u[1] + ti) >> 1);
+			}
+		}
+	}
+}
+
+#endif
+
+// Split the N/2-point FFT Z of the packed samples into bins 0 ... N/2 of the real FFT, in place:
+// X[k] = E + W^k O, X[N/2 - k] = conj(E - W^k O), E = (Z[k] + Z*[N/2 - k]) / 2,
+// O = (Z[k] - Z*[N/2 - k]) / 2j
+static void rfft_split_f32(float *x, uint32_t n)
+{
+	uint32_t m = n / 2;
+	float z0r = x[0], z0i = x[1];
+
+	for (uint32_t k = 1; k <= m / 2; k++) {
+		float a = x[2 * k], b = x[2 * k + 1];
+		float c = x[2 * (m - k)], d = x[2 * (m - k) + 1];
+		float e_re = (a + c) / 2, e_im = (b - d) / 2;
+		float o_re = (b + d) / 2, o_im = -(a - c) / 2;
+		float wr = cosf(2 * FFT_PI * k / n), wi = -sinf(2 * FFT_PI * k / n);
+		float tr = wr * o_re - wi * o_im, ti = wr * o_im + wi * o_re;
+
+		x[2 * k] = e_re + tr;
+		x[2 * k + 1] = e_im + ti;
+		x[2 * (m - k)] = e_re - tr;
+		x[2 * (m - k) + 1] = -(e_im - ti);
+	}
+	x[0] = z0r + z0i;
+	x[1] = 0.0f;
+	x[n] = z0r - z0i;
+	x[n + 1] = 0.0f;
+}
+
+// Q31 split, the samples were pre-scaled by 1/2 so Z holds the N/2-point FFT scaled by 1/N and
+// the result is X scaled by 1/N
+static void rfft_split_q31(int32_t *x, uint32_t n)
+{
+	uint32_t m = n / 2;
+	int32_t z0r = x[0], z0i = x[1];
+
+	for (uint32_t k = 1; k <= m / 2; k++) {
+		int64_t a = x[2 * k], b = x[2 * k + 1];
+		int64_t c = x[2 * (m - k)], d = x[2 * (m - k) + 1];
+		int32_t e_re = (int32_t)((a + c) >> 1), e_im = (int32_t)((b - d) >> 1);
+		int32_t o_re = (int32_t)((b + d) >> 1), o_im = (int32_t)((c - a) >> 1);
+		int32_t wr = q31_from_float(cosf(2 * FFT_PI * k / n));
+		int32_t wi = q31_from_float(-sinf(2 * FFT_PI * k / n));
+		int64_t tr = (int64_t)mul_q31(wr, o_re) - mul_q31(wi, o_im);
+		int64_t ti = (int64_t)mul_q31(wr, o_im) + mul_q31(wi, o_re);
+
+		x[2 * k] = sat_q31(e_re + tr);
+		x[2 * k + 1] = sat_q31(e_im + ti);
+		x[2 * (m - k)] = sat_q31(e_re - tr);
+		x[2 * (m - k) + 1] = sat_q31(ti - e_im);
+	}
+	x[0] = sat_q31((int64_t)z0r + z0i);
+	x[1] = 0;
+	x[n] = sat_q31((int64_t)z0r - z0i);
+	x[n + 1] = 0;
+}
+
+// Real FFT of n samples in scratch, bins 0 ... n/2 as (re, im) pairs in scratch on return
+static void rfft(uint8_t type, uint32_t n)
+{
+	uint32_t log2m = 0;
+
+	while ((2u << log2m) < n) {
+		log2m++;
+	}
+
+	if (type == FLOAT_MODE) {
+#if defined(CONFIG_CDS_FFT_CMSIS_DSP)
+		arm_rfft_fast_instance_f32 s;
+		float *in = &scratch[n + 2].f;
+		float *out = &scratch[0].f;
+
+		memcpy(in, out, n * sizeof(float));
+		arm_rfft_fast_init_f32(&s, n);
+		arm_rfft_fast_f32(&s, in, out, 0);
+		out[n] = out[1];  // Nyquist bin is packed into the imaginary part of bin 0
+		out[1] = 0.0f;
+		out[n + 1] = 0.0f;
+#else
+		cfft_ref_f32(&scratch[0].f, n / 2, log2m);
+		rfft_split_f32(&scratch[0].f, n);
+#endif
+		return;
+	}
+
+	for (uint32_t i = 0; i < n; i++) {
+		scratch[i].u >>= 1;  // Headroom for the N/2-point FFT of the packed samples
+	}
+#if defined(CONFIG_CDS_FFT_CMSIS_DSP)
+	arm_cfft_instance_q31 s;
+
+	arm_cfft_init_q31(&s, n / 2);
+	arm_cfft_q31(&s, (q31_t *)&scratch[0].u, 0, 1);
+#else
+	cfft_ref_q31(&scratch[0].u, n / 2, log2m);
+#endif
+	rfft_split_q31(&scratch[0].u, n);
+}
+
+static int32_float_union magnitude(uint8_t type, uint32_t bin)
+{
+	int32_float_union re = scratch[2 * bin], im = scratch[2 * bin + 1];
+	int32_float_union mag;
+
+	if (type == FLOAT_MODE) {
+		mag.f = sqrtf(re.f * re.f + im.f * im.f);
+	} else {
+		uint32_t root = isqrt64((uint64_t)((int64_t)re.u * re.u) + (uint64_t)((int64_t)im.u * im.u));
+
+		mag.u = (root > INT32_MAX) ? INT32_MAX : (int32_t)root;
+	}
+	return mag;
+}
+
+static bool magnitude_greater(uint8_t type, int32_float_union a, int32_float_union b)
+{
+	return (type == FLOAT_MODE) ? a.f > b.f : a.u > b.u;
+}
+
+// Keep the top_k largest magnitude bins in descending order in peaks
+static uint32_t top_bins(uint8_t type, uint32_t bins, struct fft_peak *peaks, uint32_t top_k)
+{
+	uint32_t count = 0;
+
+	for (uint32_t bin = 0; bin < bins; bin++) {
+		int32_float_union mag = magnitude(type, bin);
+		uint32_t i = count;
+
+		if (count == top_k && !magnitude_greater(type, mag, peaks[count - 1].magnitude)) {
+			continue;
+		}
+		if (count < top_k) {
+			count++;
+		} else {
+			i = count - 1;
+		}
+		while (i > 0 && magnitude_greater(type, mag, peaks[i - 1].magnitude)) {
+			peaks[i] = peaks[i - 1];
+			i--;
+		}
+		peaks[i].bin = bin;
+		peaks[i].magnitude = mag;
+	}
+	return count;
+}
+
+int calc_fft(uint8_t mode, uint8_t dst, uint8_t src, uint8_t top_k)
+{
+	struct fft_peak peaks[CONFIG_CDS_FFT_TOP_K_MAX];
+	uint32_t count;
+	uint8_t type;
+	int n;
+	int err;
+
+	n = calc_vec_read(src, 0, scratch, CONFIG_CDS_FFT_MAX_LEN + 1, &type);
+	if (n < 0) {
+		return n;
+	}
+	if (calc_vec_type(mode) != type) {
+		return -ENOTSUP;
+	}
+	if (n < CALC_FFT_MIN_LEN || n > CONFIG_CDS_FFT_MAX_LEN || (n & (n - 1)) != 0 ||
+	    top_k > CONFIG_CDS_FFT_TOP_K_MAX) {
+		return -EINVAL;
+	}
+
+	rfft(type, n);
+
+	if (top_k == 0) {
+		err = calc_vec_define(dst, type, n / 2 + 1, 2);
+		if (!err) {
+			err = calc_vec_write(dst, 0, scratch, (n + 2) * sizeof(scratch[0]));
+		}
+		return err ? err : n + 2;
+	}
+
+	count = top_bins(type, n / 2 + 1, peaks, top_k);
+
+	for (uint32_t i = 0; i < count; i++) {  // Reuse scratch for the (bin, magnitude) rows
+		if (type == FLOAT_MODE) {
+			scratch[2 * i].f = (float)peaks[i].bin;
+		} else {
+			scratch[2 * i].u = (int32_t)peaks[i].bin;
+		}
+		scratch[2 * i + 1] = peaks[i].magnitude;
+	}
+	err = calc_vec_define(dst, type, count, 2);
+	if (!err) {
+		err = calc_vec_write(dst, 0, scratch, 2 * count * sizeof(scratch[0]));
+	}
+	return err ? err : (int)(2 * count);
+}
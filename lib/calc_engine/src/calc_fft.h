@@ -0,0 +1,52 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+#ifndef CALC_FFT_H_
+#define CALC_FFT_H_
+
+/**@file
+ * @defgroup calc_fft Real FFT
+ * @{
+ * @brief Real FFT over an uploaded sample buffer.
+ *
+ * Uses CMSIS-DSP (arm_rfft_fast_f32, arm_cfft_q31) when CONFIG_CDS_FFT_CMSIS_DSP is enabled,
+ * a portable radix-2 reference otherwise (e.g. on native_sim). Both compute the real FFT as an
+ * N/2-point complex FFT of the packed samples followed by a split step. Float spectra are not
+ * scaled, Q31 spectra are scaled by 1/N.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "calc_port.h"
+
+#define CALC_FFT_MIN_LEN 32
+
+/** @brief Real FFT of a sample buffer.
+ *
+ * The full spectrum is stored as (N/2 + 1) x 2 buffer of (re, im) bins 0 ... N/2. With top_k,
+ * a top_k x 2 buffer of (bin, magnitude) sorted by descending magnitude is stored instead.
+ *
+ * @param[in] mode Task mode, FLOAT_MODE or Q31, must match the sample buffer type.
+ * @param[in] dst Destination buffer, may alias src.
+ * @param[in] src Sample buffer, power-of-two length from CALC_FFT_MIN_LEN to
+ *                CONFIG_CDS_FFT_MAX_LEN.
+ * @param[in] top_k Number of magnitude bins to keep, 0 for the full spectrum.
+ *
+ * @retval Number of elements in dst. Otherwise, a (negative) error code.
+ */
+int calc_fft(uint8_t mode, uint8_t dst, uint8_t src, uint8_t top_k);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* CALC_FFT_H_ */
@@ -0,0 +1,249 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief Streaming filters
+ */
+
+#include "calc_port.h"
+#include <errno.h>
+#include <string.h>
+#include "calc_filter.h"
+#include "calc_vec.h"
+
+#if defined(CONFIG_CDS_FILTER_CMSIS_DSP)
+#include <arm_math.h>
+#endif
+
+#define FILTER_BLOCK CONFIG_CDS_FILTER_BLOCK
+#define BIQUAD_COEFFS 5
+#define BIQUAD_STATE 4  // x[n-1], x[n-2], y[n-1], y[n-2]
+
+#define FILTER_COEFFS MAX(CONFIG_CDS_FILTER_MAX_TAPS, BIQUAD_COEFFS * CONFIG_CDS_FILTER_MAX_STAGES)
+#define FILTER_STATE MAX(CONFIG_CDS_FILTER_MAX_TAPS + FILTER_BLOCK - 1, \
+			 BIQUAD_STATE * CONFIG_CDS_FILTER_MAX_STAGES)
+
+struct calc_filter {
+	int32_float_union coeffs[FILTER_COEFFS];  // FIR taps time-reversed, as arm_fir_* expects
+	int32_float_union state[FILTER_STATE];
+	uint16_t len;		// FIR taps or biquad stages
+	uint8_t type;		// FLOAT_MODE or FIXED_MODE
+	uint8_t kind;		// CALC_FILTER_FIR or CALC_FILTER_BIQUAD
+	uint8_t post_shift;
+	bool defined;
+#if defined(CONFIG_CDS_FILTER_CMSIS_DSP)
+	union {
+		arm_fir_instance_f32 fir_f32;
+		arm_fir_instance_q31 fir_q31;
+		arm_biquad_casd_df1_inst_f32 iir_f32;
+		arm_biquad_casd_df1_inst_q31 iir_q31;
+	} inst;
+#endif
+};
+
+// Engine thread only
+static struct calc_filter filters[CONFIG_CDS_FILTERS];
+static int32_float_union block_in[MAX(FILTER_BLOCK, FILTER_COEFFS + 1)];  // Samples or coefficients
+static int32_float_union block_out[FILTER_BLOCK];
+// -------------------------------------------------------------------------------------------------
+
+#if !defined(CONFIG_CDS_FILTER_CMSIS_DSP)
+// Portable kernels with the arithmetic of their CMSIS-DSP counterparts: the state starts with the
+// taps - 1 previous samples, Q31 products are accumulated in 64 bits and truncated.
+static void fir_ref(struct calc_filter *flt, const int32_float_union *in, int32_float_union *out,
+		    uint32_t count)
+{
+	int32_float_union *hist = flt->state;
+
+	memcpy(&hist[flt->len - 1], in, count * sizeof(*in));
+	for (uint32_t i = 0; i < count; i++) {
+		if (flt->type == FLOAT_MODE) {
+			float acc = 0.0f;
+
+			for (uint32_t k = 0; k < flt->len; k++) {
+				acc += hist[i + k].f * flt->coeffs[k].f;
+			}
+			out[i].f = acc;
+		} else {
+			int64_t acc = 0;
+
+			for (uint32_t k = 0; k < flt->len; k++) {
+				acc += (int64_t)hist[i + k].u * flt->coeffs[k].u;
+			}
+			out[i].u = (int32_t)(acc >> 31);
+		}
+	}
+	memmove(hist, &hist[count], (flt->len - 1) * sizeof(*hist));
+}
+
+static void biquad_ref(struct calc_filter *flt, const int32_float_union *in, int32_float_union *out,
+		       uint32_t count)
+{
+	memmove(out, in, count * sizeof(*in));
+	for (uint32_t stage = 0; stage < flt->len; stage++) {
+		const int32_float_union *b = &flt->coeffs[BIQUAD_COEFFS * stage];
+		int32_float_union *st = &flt->state[BIQUAD_STATE * stage];
+
+		for (uint32_t i = 0; i < count; i++) {
+			int32_float_union x = out[i];
+
+			if (flt->type == FLOAT_MODE) {
+				out[i].f = b[0].f * x.f + b[1].f * st[0].f + b[2].f * st[1].f +
+					   b[3].f * st[2].f + b[4].f * st[3].f;
+			} else {
+				int64_t acc = (int64_t)b[0].u * x.u + (int64_t)b[1].u * st[0].u +
+					      (int64_t)b[2].u * st[1].u + (int64_t)b[3].u * st[2].u +
+					      (int64_t)b[4].u * st[3].u;
+
+				out[i].u = (int32_t)(acc >> (31 - flt->post_shift));
+			}
+			st[1] = st[0];
+			st[0] = x;
+			st[3] = st[2];
+			st[2] = out[i];
+		}
+	}
+}
+#endif
+
+static void filter_block(struct calc_filter *flt, int32_float_union *in, int32_float_union *out,
+			 uint32_t count)
+{
+#if defined(CONFIG_CDS_FILTER_CMSIS_DSP)
+	if (flt->kind == CALC_FILTER_FIR) {
+		if (flt->type == FLOAT_MODE) {
+			arm_fir_f32(&flt->inst.fir_f32, &in->f, &out->f, count);
+		} else {
+			arm_fir_q31(&flt->inst.fir_q31, &in->u, &out->u, count);
+		}
+	} else {
+		if (flt->type == FLOAT_MODE) {
+			arm_biquad_cascade_df1_f32(&flt->inst.iir_f32, &in->f, &out->f, count);
+		} else {
+			arm_biquad_cascade_df1_q31(&flt->inst.iir_q31, &in->u, &out->u, count);
+		}
+	}
+#else
+	if (flt->kind == CALC_FILTER_FIR) {
+		fir_ref(flt, in, out, count);
+	} else {
+		biquad_ref(flt, in, out, count);
+	}
+#endif
+}
+// -------------------------------------------------------------------------------------------------
+
+int calc_filter_create(uint8_t id, uint8_t mode, uint8_t kind, uint8_t coeffs, uint8_t post_shift)
+{
+	const int32_float_union *values = block_in;
+	struct calc_filter *flt;
+	int type = calc_vec_type(mode);
+	uint8_t coeff_type;
+	int count;
+
+	if (type < 0) {
+		return type;
+	}
+	if (id >= CONFIG_CDS_FILTERS || kind > CALC_FILTER_BIQUAD || post_shift > 31) {
+		return -EINVAL;
+	}
+
+	count = calc_vec_read(coeffs, 0, block_in, FILTER_COEFFS + 1, &coeff_type);
+	if (count < 0) {
+		return count;
+	}
+	if (coeff_type != type || count == 0 ||
+	    (kind == CALC_FILTER_FIR && count > CONFIG_CDS_FILTER_MAX_TAPS) ||
+	    (kind == CALC_FILTER_BIQUAD && (count % BIQUAD_COEFFS != 0 ||
+					    count > BIQUAD_COEFFS * CONFIG_CDS_FILTER_MAX_STAGES))) {
+		return -EINVAL;
+	}
+
+	flt = &filters[id];
+	memset(flt, 0, sizeof(*flt));
+	flt->type = type;
+	flt->kind = kind;
+	flt->post_shift = post_shift;
+	if (kind == CALC_FILTER_FIR) {
+		flt->len = count;
+		for (int i = 0; i < count; i++) {
+			flt->coeffs[i] = values[count - 1 - i];
+		}
+	} else {
+		flt->len = count / BIQUAD_COEFFS;
+		memcpy(flt->coeffs, values, count * sizeof(values[0]));
+	}
+
+#if defined(CONFIG_CDS_FILTER_CMSIS_DSP)
+	if (kind == CALC_FILTER_FIR) {
+		if (type == FLOAT_MODE) {
+			arm_fir_init_f32(&flt->inst.fir_f32, flt->len, &flt->coeffs[0].f, &flt->state[0].f,
+					 FILTER_BLOCK);
+		} else {
+			arm_fir_init_q31(&flt->inst.fir_q31, flt->len, &flt->coeffs[0].u, &flt->state[0].u,
+					 FILTER_BLOCK);
+		}
+	} else {
+		if (type == FLOAT_MODE) {
+			arm_biquad_cascade_df1_init_f32(&flt->inst.iir_f32, flt->len, &flt->coeffs[0].f,
+							&flt->state[0].f);
+		} else {
+			arm_biquad_cascade_df1_init_q31(&flt->inst.iir_q31, flt->len, &flt->coeffs[0].u,
+							&flt->state[0].u, post_shift);
+		}
+	}
+#endif
+	flt->defined = true;
+	return 0;
+}
+
+int calc_filter_reset(uint8_t id)
+{
+	if (id >= CONFIG_CDS_FILTERS || !filters[id].defined) {
+		return -EINVAL;
+	}
+	memset(filters[id].state, 0, sizeof(filters[id].state));
+	return 0;
+}
+
+int calc_filter_run(uint8_t id, uint8_t dst, uint8_t src)
+{
+	struct calc_filter *flt;
+	uint16_t rows, cols;
+	uint8_t type;
+	uint32_t first = 0;
+	int count;
+	int err;
+
+	if (id >= CONFIG_CDS_FILTERS || !filters[id].defined) {
+		return -EINVAL;
+	}
+	flt = &filters[id];
+
+	err = calc_vec_shape(src, &rows, &cols, &type);
+	if (err) {
+		return err;
+	}
+	if (type != flt->type) {
+		return -EINVAL;
+	}
+	if (dst != src) {
+		err = calc_vec_define(dst, type, rows, cols);
+		if (err) {
+			return err;
+		}
+	}
+
+	while ((count = calc_vec_read(src, first, block_in, FILTER_BLOCK, &type)) > 0) {
+		filter_block(flt, block_in, block_out, count);
+		err = calc_vec_write(dst, first * sizeof(block_out[0]), block_out, count * sizeof(block_out[0]));
+		if (err) {
+			return err;
+		}
+		first += count;
+	}
+	return (count < 0) ? count : (int)first;
+}
@@ -0,0 +1,70 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+#ifndef CALC_FILTER_H_
+#define CALC_FILTER_H_
+
+/**@file
+ * @defgroup calc_filter Streaming filters
+ * @{
+ * @brief Stateful FIR and biquad cascade IIR filters in float or Q31.
+ *
+ * Coefficients are uploaded once into a buffer and copied into the filter. Sample buffers are
+ * then run through the filter block by block, the filter state is kept between runs so a signal
+ * can be streamed in consecutive frames. The kernels and coefficient layouts are the ones of
+ * CMSIS-DSP (arm_fir_*, arm_biquad_cascade_df1_*), used when CONFIG_CDS_FILTER_CMSIS_DSP is
+ * enabled.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "calc_port.h"
+
+// Filter kinds
+#define CALC_FILTER_FIR    0  // Coefficients: h[0] ... h[taps - 1]
+#define CALC_FILTER_BIQUAD 1  // Coefficients: stages x {b0, b1, b2, a1, a2}, feedback terms added:
+			      // y = b0 x[n] + b1 x[n-1] + b2 x[n-2] + a1 y[n-1] + a2 y[n-2]
+
+/** @brief Create (or replace) a filter from a coefficient buffer.
+ *
+ * @param[in] id Filter id, below CONFIG_CDS_FILTERS.
+ * @param[in] mode Task mode, FLOAT_MODE or Q31, must match the coefficient buffer type.
+ * @param[in] kind CALC_FILTER_FIR or CALC_FILTER_BIQUAD.
+ * @param[in] coeffs Coefficient buffer, up to CONFIG_CDS_FILTER_MAX_TAPS taps or
+ *                   CONFIG_CDS_FILTER_MAX_STAGES x 5 biquad coefficients.
+ * @param[in] post_shift Q31 biquad only, coefficients are in Q(31 - post_shift).
+ *
+ * @retval 0 If the operation was successful. Otherwise, a (negative) error code.
+ */
+int calc_filter_create(uint8_t id, uint8_t mode, uint8_t kind, uint8_t coeffs, uint8_t post_shift);
+
+/** @brief Clear the state (delay line) of a filter.
+ *
+ * @retval 0 If the operation was successful. Otherwise, -EINVAL.
+ */
+int calc_filter_reset(uint8_t id);
+
+/** @brief Run a sample buffer through a filter.
+ *
+ * @param[in] id Filter id.
+ * @param[in] dst Output buffer, (re)defined with the shape of src. May alias src.
+ * @param[in] src Sample buffer of the filter type.
+ *
+ * @retval Number of output samples. Otherwise, a (negative) error code.
+ */
+int calc_filter_run(uint8_t id, uint8_t dst, uint8_t src);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* CALC_FILTER_H_ */
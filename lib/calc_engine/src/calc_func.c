@@ -0,0 +1,252 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief Function store
+ */
+
+#include "calc_port.h"
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include "calc_func.h"
+#include "calc_vec.h"
+
+#if defined(CONFIG_CDS_FUNC_SETTINGS)
+#include <zephyr/settings/settings.h>
+#endif
+
+#define FUNC_BLOCK 32
+#define FUNC_VALUES MAX(CALC_FUNC_MAX_DEGREE + 1, 2 * CONFIG_CDS_FUNC_PWL_POINTS)
+
+struct calc_func {
+	int32_float_union values[FUNC_VALUES];  // Coefficients or (x, y) breakpoints
+	uint8_t len;	// Coefficients or breakpoints
+	uint8_t kind;	// CALC_FUNC_POLY or CALC_FUNC_PWL
+	uint8_t type;	// FLOAT_MODE or FIXED_MODE
+	uint8_t shift;
+	bool defined;
+};
+
+// Engine thread only, and the settings loader before it runs
+static struct calc_func funcs[CONFIG_CDS_FUNCS];
+static int32_float_union block[MAX(FUNC_BLOCK, FUNC_VALUES + 1)];
+// -------------------------------------------------------------------------------------------------
+
+static int32_t sat_q31(int64_t v)
+{
+	return (v > INT32_MAX) ? INT32_MAX : ((v < INT32_MIN) ? INT32_MIN : (int32_t)v);
+}
+
+static int32_t shift_q31(int32_t v, uint8_t shift)
+{
+	return sat_q31((int64_t)v * ((int64_t)1 << shift));
+}
+
+static int32_float_union poly_eval(const struct calc_func *fn, int32_float_union x)
+{
+	int32_float_union acc = fn->values[fn->len - 1];
+
+	for (int k = fn->len - 2; k >= 0; k--) {
+		if (fn->type == FLOAT_MODE) {
+			acc.f = acc.f * x.f + fn->values[k].f;
+		} else {
+			acc.u = sat_q31((((int64_t)acc.u * x.u) >> 31) + fn->values[k].u);
+		}
+	}
+	if (fn->type != FLOAT_MODE) {
+		acc.u = shift_q31(acc.u, fn->shift);
+	}
+	return acc;
+}
+
+static bool pwl_less(uint8_t type, int32_float_union a, int32_float_union b)
+{
+	return (type == FLOAT_MODE) ? a.f < b.f : a.u < b.u;
+}
+
+static int32_float_union pwl_eval(const struct calc_func *fn, int32_float_union x)
+{
+	const int32_float_union *p = fn->values;  // x0, y0, x1, y1, ...
+	uint32_t lo = 0;
+	uint32_t hi = fn->len - 1;
+	int32_float_union y;
+
+	if (!pwl_less(fn->type, p[0], x)) {
+		y = p[1];
+	} else if (!pwl_less(fn->type, x, p[2 * hi])) {
+		y = p[2 * hi + 1];
+	} else {
+		while (hi - lo > 1) {  // Invariant: x[lo] <= x < x[hi]
+			uint32_t mid = (lo + hi) / 2;
+
+			if (pwl_less(fn->type, x, p[2 * mid])) {
+				hi = mid;
+			} else {
+				lo = mid;
+			}
+		}
+		if (fn->type == FLOAT_MODE) {
+			y.f = p[2 * lo + 1].f + (p[2 * hi + 1].f - p[2 * lo + 1].f) * (x.f - p[2 * lo].f) /
+						       (p[2 * hi].f - p[2 * lo].f);
+		} else {
+			int64_t dy = (int64_t)p[2 * hi + 1].u - p[2 * lo + 1].u;
+			uint64_t dx = (uint64_t)((int64_t)p[2 * hi].u - p[2 * lo].u);
+			uint64_t t = ((uint64_t)((int64_t)x.u - p[2 * lo].u) << 30) / dx;  // Q30 fraction
+
+			y.u = sat_q31(p[2 * lo + 1].u + ((dy * (int64_t)t) >> 30));
+		}
+	}
+	if (fn->type != FLOAT_MODE) {
+		y.u = shift_q31(y.u, fn->shift);
+	}
+	return y;
+}
+
+#if defined(CONFIG_CDS_FUNC_SETTINGS)
+static int func_settings_set(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg)
+{
+	unsigned long id = strtoul(name, NULL, 10);
+	struct calc_func fn;
+
+	if (id >= CONFIG_CDS_FUNCS || len != sizeof(fn)) {
+		return -EINVAL;
+	}
+	if (read_cb(cb_arg, &fn, sizeof(fn)) != sizeof(fn)) {
+		return -EIO;
+	}
+	funcs[id] = fn;
+	return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(cds_func, "cds/func", NULL, func_settings_set, NULL, NULL);
+
+static void func_settings_key(uint8_t id, char *key, size_t size)
+{
+	snprintk(key, size, "cds/func/%u", id);
+}
+#endif
+// -------------------------------------------------------------------------------------------------
+
+int calc_func_init(void)
+{
+#if defined(CONFIG_CDS_FUNC_SETTINGS)
+	int err = settings_subsys_init();
+
+	if (err) {
+		return err;
+	}
+	return settings_load_subtree("cds/func");
+#else
+	return 0;
+#endif
+}
+
+int calc_func_define(uint8_t id, uint8_t mode, uint8_t kind, uint8_t src, uint8_t shift)
+{
+	struct calc_func *fn;
+	int type = calc_vec_type(mode);
+	uint8_t src_type;
+	int count;
+
+	if (type < 0) {
+		return type;
+	}
+	if (id >= CONFIG_CDS_FUNCS || kind > CALC_FUNC_PWL || shift > 31) {
+		return -EINVAL;
+	}
+
+	count = calc_vec_read(src, 0, block, FUNC_VALUES + 1, &src_type);
+	if (count < 0) {
+		return count;
+	}
+	if (src_type != type || count == 0 ||
+	    (kind == CALC_FUNC_POLY && count > CALC_FUNC_MAX_DEGREE + 1) ||
+	    (kind == CALC_FUNC_PWL && (count % 2 != 0 || count > 2 * CONFIG_CDS_FUNC_PWL_POINTS))) {
+		return -EINVAL;
+	}
+	for (int i = 2; kind == CALC_FUNC_PWL && i < count; i += 2) {
+		if (!pwl_less(type, block[i - 2], block[i])) {
+			return -EINVAL;  // Breakpoints must be strictly increasing
+		}
+	}
+
+	fn = &funcs[id];
+	memset(fn, 0, sizeof(*fn));
+	memcpy(fn->values, block, count * sizeof(block[0]));
+	fn->len = (kind == CALC_FUNC_PWL) ? count / 2 : count;
+	fn->kind = kind;
+	fn->type = type;
+	fn->shift = shift;
+	fn->defined = true;
+
+#if defined(CONFIG_CDS_FUNC_SETTINGS)
+	char key[16];
+
+	func_settings_key(id, key, sizeof(key));
+	return settings_save_one(key, fn, sizeof(*fn));
+#else
+	return 0;
+#endif
+}
+
+int calc_func_delete(uint8_t id)
+{
+	if (id >= CONFIG_CDS_FUNCS || !funcs[id].defined) {
+		return -EINVAL;
+	}
+	funcs[id].defined = false;
+
+#if defined(CONFIG_CDS_FUNC_SETTINGS)
+	char key[16];
+
+	func_settings_key(id, key, sizeof(key));
+	return settings_delete(key);
+#else
+	return 0;
+#endif
+}
+
+int calc_func_eval(uint8_t id, uint8_t dst, uint8_t src)
+{
+	const struct calc_func *fn;
+	uint16_t rows, cols;
+	uint8_t type;
+	uint32_t first = 0;
+	int count;
+	int err;
+
+	if (id >= CONFIG_CDS_FUNCS || !funcs[id].defined) {
+		return -EINVAL;
+	}
+	fn = &funcs[id];
+
+	err = calc_vec_shape(src, &rows, &cols, &type);
+	if (err) {
+		return err;
+	}
+	if (type != fn->type) {
+		return -EINVAL;
+	}
+	if (dst != src) {
+		err = calc_vec_define(dst, type, rows, cols);
+		if (err) {
+			return err;
+		}
+	}
+
+	while ((count = calc_vec_read(src, first, block, FUNC_BLOCK, &type)) > 0) {
+		for (int i = 0; i < count; i++) {
+			block[i] = (fn->kind == CALC_FUNC_POLY) ? poly_eval(fn, block[i]) : pwl_eval(fn, block[i]);
+		}
+		err = calc_vec_write(dst, first * sizeof(block[0]), block, count * sizeof(block[0]));
+		if (err) {
+			return err;
+		}
+		first += count;
+	}
+	return (count < 0) ? count : (int)first;
+}
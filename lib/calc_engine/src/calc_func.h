@@ -0,0 +1,76 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+#ifndef CALC_FUNC_H_
+#define CALC_FUNC_H_
+
+/**@file
+ * @defgroup calc_func Function store
+ * @{
+ * @brief Stored polynomial and piecewise-linear functions, evaluated over buffers.
+ *
+ * Functions are defined from an uploaded buffer and kept in RAM, and in flash through the
+ * settings subsystem (key "cds/func/<id>") with CONFIG_CDS_FUNC_SETTINGS. Q31 functions hold
+ * their coefficients or breakpoint values in Q(31 - shift) so calibration curves may exceed
+ * [-1, 1), the result is shifted back to Q31 with saturation.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "calc_port.h"
+
+// Function kinds
+#define CALC_FUNC_POLY 0  // Coefficients c0 ... cn, f(x) = c0 + c1 x + ... + cn x^n, Horner's method
+#define CALC_FUNC_PWL  1  // rows x 2 buffer of (x, y) breakpoints, x strictly increasing. Linear
+			  // interpolation, held constant outside [x0, xn]
+
+#define CALC_FUNC_MAX_DEGREE 8
+
+/** @brief Load the persisted functions, call once at startup.
+ *
+ * @retval 0 If the operation was successful. Otherwise, a (negative) error code.
+ */
+int calc_func_init(void);
+
+/** @brief Define (or replace) a function from a buffer.
+ *
+ * @param[in] id Function id, below CONFIG_CDS_FUNCS.
+ * @param[in] mode Task mode, FLOAT_MODE or Q31, must match the buffer type.
+ * @param[in] kind CALC_FUNC_POLY or CALC_FUNC_PWL.
+ * @param[in] src Coefficient or breakpoint buffer.
+ * @param[in] shift Q31 only, the coefficients or y values are in Q(31 - shift).
+ *
+ * @retval 0 If the operation was successful. Otherwise, a (negative) error code.
+ */
+int calc_func_define(uint8_t id, uint8_t mode, uint8_t kind, uint8_t src, uint8_t shift);
+
+/** @brief Delete a function, also from flash.
+ *
+ * @retval 0 If the operation was successful. Otherwise, a (negative) error code.
+ */
+int calc_func_delete(uint8_t id);
+
+/** @brief Evaluate a function over a buffer, dst = f(src).
+ *
+ * @param[in] id Function id.
+ * @param[in] dst Output buffer, (re)defined with the shape of src. May alias src.
+ * @param[in] src Input buffer of the function type.
+ *
+ * @retval Number of results. Otherwise, a (negative) error code.
+ */
+int calc_func_eval(uint8_t id, uint8_t dst, uint8_t src);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* CALC_FUNC_H_ */
@@ -0,0 +1,145 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+#ifndef CALC_PORT_H_
+#define CALC_PORT_H_
+
+/**@file
+ * @defgroup calc_port Calculator engine portability layer
+ * @{
+ * @brief The few OS services the engine library uses, mapped to Zephyr or to the host.
+ *
+ * Under Zephyr (__ZEPHYR__) the configuration comes from Kconfig and the locks are kernel
+ * objects. On the host the configuration comes from calc_engine_config.h and the locks are
+ * pthread mutexes, so simulators may drive the engine from several threads like the
+ * firmware does (buffer uploads and the engine thread).
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#if defined(__ZEPHYR__)
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/sys/byteorder.h>
+
+#define CALC_PORT_MUTEX_DEFINE(name) static K_MUTEX_DEFINE(name)
+#define CALC_PORT_SPINLOCK_DEFINE(name) static struct k_spinlock name
+
+typedef struct k_mutex calc_port_mutex_t;
+typedef struct k_spinlock calc_port_spinlock_t;
+typedef k_spinlock_key_t calc_port_key_t;
+
+static inline void calc_port_mutex_lock(calc_port_mutex_t *mutex)
+{
+	k_mutex_lock(mutex, K_FOREVER);
+}
+
+static inline void calc_port_mutex_unlock(calc_port_mutex_t *mutex)
+{
+	k_mutex_unlock(mutex);
+}
+
+static inline calc_port_key_t calc_port_spin_lock(calc_port_spinlock_t *lock)
+{
+	return k_spin_lock(lock);
+}
+
+static inline void calc_port_spin_unlock(calc_port_spinlock_t *lock, calc_port_key_t key)
+{
+	k_spin_unlock(lock, key);
+}
+#else
+#include <stdint.h>
+#include <pthread.h>
+#include "calc_engine_config.h"
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(array) (sizeof(array) / sizeof((array)[0]))
+#endif
+#ifndef MIN
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+#define ROUND_UP(x, align) ((((unsigned long)(x) + ((unsigned long)(align) - 1)) / \
+			     (unsigned long)(align)) * (unsigned long)(align))
+#define __aligned(x) __attribute__((__aligned__(x)))
+
+#define CALC_PORT_MUTEX_DEFINE(name) static pthread_mutex_t name = PTHREAD_MUTEX_INITIALIZER
+#define CALC_PORT_SPINLOCK_DEFINE(name) CALC_PORT_MUTEX_DEFINE(name)
+
+typedef pthread_mutex_t calc_port_mutex_t;
+typedef pthread_mutex_t calc_port_spinlock_t;
+typedef int calc_port_key_t;
+
+static inline void calc_port_mutex_lock(calc_port_mutex_t *mutex)
+{
+	pthread_mutex_lock(mutex);
+}
+
+static inline void calc_port_mutex_unlock(calc_port_mutex_t *mutex)
+{
+	pthread_mutex_unlock(mutex);
+}
+
+static inline calc_port_key_t calc_port_spin_lock(calc_port_spinlock_t *lock)
+{
+	pthread_mutex_lock(lock);
+	return 0;
+}
+
+static inline void calc_port_spin_unlock(calc_port_spinlock_t *lock, calc_port_key_t key)
+{
+	(void)key;
+	pthread_mutex_unlock(lock);
+}
+
+// Wire format helpers, byte by byte so any host byte order works
+static inline uint16_t sys_get_le16(const uint8_t *src)
+{
+	return (uint16_t)(src[0] | (src[1] << 8));
+}
+
+static inline uint32_t sys_get_le32(const uint8_t *src)
+{
+	return (uint32_t)src[0] | ((uint32_t)src[1] << 8) | ((uint32_t)src[2] << 16) |
+	       ((uint32_t)src[3] << 24);
+}
+
+static inline void sys_put_le16(uint16_t val, uint8_t *dst)
+{
+	dst[0] = (uint8_t)val;
+	dst[1] = (uint8_t)(val >> 8);
+}
+
+static inline void sys_put_le32(uint32_t val, uint8_t *dst)
+{
+	sys_put_le16((uint16_t)val, dst);
+	sys_put_le16((uint16_t)(val >> 16), &dst[2]);
+}
+
+static inline uint16_t sys_le16_to_cpu(uint16_t val)
+{
+	return sys_get_le16((const uint8_t *)&val);
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* CALC_PORT_H_ */
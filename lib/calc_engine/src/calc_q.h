@@ -0,0 +1,58 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+#ifndef CALC_Q_H_
+#define CALC_Q_H_
+
+/**@file
+ * @defgroup calc_q Fixed-point engine kernels
+ * @{
+ * @brief Fixed-point kernels generated from fixed_point.hpp for Q31, Q15, Q7.24 and Q16.16.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include "calc_port.h"
+
+#define CALC_Q_OK          0
+#define CALC_Q_OVERFLOW    1
+#define CALC_Q_DIV_BY_ZERO 2
+#define CALC_Q_INVALID     3  // Not a fixed-point mode, the result is -EINVAL
+
+/** @brief Check if a mode selects a fixed-point format and a valid overflow policy.
+ *
+ * @param[in] mode Task mode (format and CDS_MODE_SAT/CDS_MODE_WRAP).
+ *
+ * @retval true If the mode is a fixed-point mode.
+ */
+bool calc_q_mode_valid(uint8_t mode);
+
+/** @brief Execute a fixed-point operation.
+ *
+ * The kernel is selected from a table by format, overflow policy and operation.
+ *
+ * @param[in] mode Task mode, checked with calc_q_mode_valid().
+ * @param[in] operation Operation (CALC_OP_RESET ... CALC_OP_DIV).
+ * @param[in] a Raw operand 1.
+ * @param[in] b Raw operand 2.
+ * @param[out] status CALC_Q_OK, CALC_Q_OVERFLOW, CALC_Q_DIV_BY_ZERO or CALC_Q_INVALID.
+ *
+ * @retval Raw result, sign-extended to 32 bits.
+ */
+int32_t calc_q_execute(uint8_t mode, uint8_t operation, int32_t a, int32_t b, uint8_t *status);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* CALC_Q_H_ */
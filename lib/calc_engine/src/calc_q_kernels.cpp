@@ -0,0 +1,108 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief Fixed-point engine kernels
+ */
+
+#include <errno.h>
+#include "calc_q.h"
+#include "calc_engine.h"
+#include "fixed_point.hpp"
+
+namespace {
+
+using kernel_t = int32_t (*)(int32_t a, int32_t b, fxp::status &st);
+
+template <typename Fmt>
+int32_t kernel_reset(int32_t, int32_t, fxp::status &)
+{
+	return 0;
+}
+
+template <typename Fmt>
+int32_t kernel_add(int32_t a, int32_t b, fxp::status &st)
+{
+	return Fmt::add(Fmt::from_raw(a), Fmt::from_raw(b), st).raw();
+}
+
+template <typename Fmt>
+int32_t kernel_sub(int32_t a, int32_t b, fxp::status &st)
+{
+	return Fmt::sub(Fmt::from_raw(a), Fmt::from_raw(b), st).raw();
+}
+
+template <typename Fmt>
+int32_t kernel_mul(int32_t a, int32_t b, fxp::status &st)
+{
+	return Fmt::mul(Fmt::from_raw(a), Fmt::from_raw(b), st).raw();
+}
+
+template <typename Fmt>
+int32_t kernel_div(int32_t a, int32_t b, fxp::status &st)
+{
+	return Fmt::div(Fmt::from_raw(a), Fmt::from_raw(b), st).raw();
+}
+
+static_assert(static_cast<int>(fxp::status::overflow) == CALC_Q_OVERFLOW, "status mismatch");
+static_assert(static_cast<int>(fxp::status::div_by_zero) == CALC_Q_DIV_BY_ZERO, "status mismatch");
+
+constexpr int kernel_ops = CALC_OP_DIV + 1;
+
+struct kernel_row {
+	kernel_t op[kernel_ops];
+};
+
+template <typename Fmt>
+constexpr kernel_row make_row()
+{
+	return { { kernel_reset<Fmt>, kernel_add<Fmt>, kernel_sub<Fmt>, kernel_mul<Fmt>,
+		   kernel_div<Fmt> } };
+}
+
+// [format][policy]: policy 0 is the format default, 1 saturate, 2 wrap
+constexpr kernel_row kernels[][3] = {
+	{ make_row<fxp::q31<fxp::flush, fxp::round_floor>>(),  // Original FIXED_MODE arithmetic
+	  make_row<fxp::q31<fxp::saturate>>(), make_row<fxp::q31<fxp::wrap>>() },
+	{ make_row<fxp::q15<>>(), make_row<fxp::q15<fxp::saturate>>(),
+	  make_row<fxp::q15<fxp::wrap>>() },
+	{ make_row<fxp::q7_24<>>(), make_row<fxp::q7_24<fxp::saturate>>(),
+	  make_row<fxp::q7_24<fxp::wrap>>() },
+	{ make_row<fxp::q16_16<>>(), make_row<fxp::q16_16<fxp::saturate>>(),
+	  make_row<fxp::q16_16<fxp::wrap>>() },
+};
+
+// Mode format -> kernels row, -1 for non fixed-point formats
+constexpr int8_t format_index[CDS_MODE_FORMAT_MASK + 1] = {
+	-1, 0, -1, 1, 2, 3, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+} // namespace
+
+bool calc_q_mode_valid(uint8_t mode)
+{
+	uint8_t policy = (mode & ~CDS_MODE_FORMAT_MASK) >> 4;
+
+	return format_index[mode & CDS_MODE_FORMAT_MASK] >= 0 && policy < 3;
+}
+
+int32_t calc_q_execute(uint8_t mode, uint8_t operation, int32_t a, int32_t b, uint8_t *status)
+{
+	fxp::status st = fxp::status::ok;
+	int32_t result = 0;
+
+	if (!calc_q_mode_valid(mode)) {  // The table has no row for it
+		*status = CALC_Q_INVALID;
+		return -EINVAL;
+	}
+	if (operation < kernel_ops) {
+		const kernel_row &row = kernels[format_index[mode & CDS_MODE_FORMAT_MASK]][mode >> 4];
+
+		result = row.op[operation](a, b, st);
+	}
+	*status = static_cast<uint8_t>(st);
+	return result;
+}
@@ -0,0 +1,236 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief Sort and selection
+ */
+
+#include "calc_port.h"
+#include <errno.h>
+#include <string.h>
+#include "calc_sort.h"
+#include "calc_vec.h"
+
+#define SORT_RADIX_BITS 8
+#define SORT_BUCKETS (1 << SORT_RADIX_BITS)
+
+// Engine thread only
+static uint32_t keys[CONFIG_CDS_SORT_MAX_LEN];
+static uint32_t tmp[CONFIG_CDS_SORT_MAX_LEN];
+static uint32_t counts[SORT_BUCKETS];
+// -------------------------------------------------------------------------------------------------
+
+static uint32_t key_from_value(uint8_t type, uint32_t v)
+{
+	if (type == FLOAT_MODE && (v & 0x80000000u)) {
+		return ~v;  // Negative floats order by decreasing magnitude
+	}
+	return v ^ 0x80000000u;
+}
+
+static uint32_t value_from_key(uint8_t type, uint32_t key)
+{
+	if (type == FLOAT_MODE && !(key & 0x80000000u)) {
+		return ~key;
+	}
+	return key ^ 0x80000000u;
+}
+
+// Copy the elements of src into keys
+static int load_keys(uint8_t mode, uint8_t src, uint8_t *type, uint16_t *rows, uint16_t *cols)
+{
+	int32_float_union *values = (int32_float_union *)keys;
+	int n;
+
+	if (calc_vec_shape(src, rows, cols, type) < 0) {
+		return -EINVAL;
+	}
+	if (calc_vec_type(mode) != *type) {
+		return -ENOTSUP;
+	}
+	if ((uint32_t)*rows * *cols > CONFIG_CDS_SORT_MAX_LEN) {
+		return -ENOMEM;
+	}
+
+	n = calc_vec_read(src, 0, values, CONFIG_CDS_SORT_MAX_LEN, type);
+	for (int i = 0; i < n; i++) {
+		keys[i] = key_from_value(*type, (uint32_t)values[i].u);
+	}
+	return n;
+}
+
+// LSD radix sort of keys[0 ... n), ping-ponging with tmp. Passes on a constant digit are skipped.
+static void radix_sort(uint32_t n)
+{
+	uint32_t *from = keys;
+	uint32_t *to = tmp;
+	uint32_t *swap;
+
+	for (uint32_t shift = 0; shift < 32; shift += SORT_RADIX_BITS) {
+		uint32_t sum = 0;
+
+		memset(counts, 0, sizeof(counts));
+		for (uint32_t i = 0; i < n; i++) {
+			counts[(from[i] >> shift) & (SORT_BUCKETS - 1)]++;
+		}
+		if (counts[(from[0] >> shift) & (SORT_BUCKETS - 1)] == n) {
+			continue;
+		}
+		for (uint32_t b = 0; b < SORT_BUCKETS; b++) {
+			uint32_t c = counts[b];
+
+			counts[b] = sum;
+			sum += c;
+		}
+		for (uint32_t i = 0; i < n; i++) {
+			to[counts[(from[i] >> shift) & (SORT_BUCKETS - 1)]++] = from[i];
+		}
+		swap = from;
+		from = to;
+		to = swap;
+	}
+	if (from != keys) {
+		memcpy(keys, from, n * sizeof(keys[0]));
+	}
+}
+
+// MSD radix select: the key of rank nth in keys[0 ... n), one counting pass per digit
+static uint32_t radix_select(uint32_t n, uint32_t nth)
+{
+	uint32_t prefix = 0;
+	uint32_t mask = 0;
+
+	for (int shift = 32 - SORT_RADIX_BITS; shift >= 0; shift -= SORT_RADIX_BITS) {
+		uint32_t b = 0;
+
+		memset(counts, 0, sizeof(counts));
+		for (uint32_t i = 0; i < n; i++) {
+			if ((keys[i] & mask) == prefix) {
+				counts[(keys[i] >> shift) & (SORT_BUCKETS - 1)]++;
+			}
+		}
+		while (nth >= counts[b]) {
+			nth -= counts[b++];
+		}
+		prefix |= b << shift;
+		mask |= (uint32_t)(SORT_BUCKETS - 1) << shift;
+	}
+	return prefix;
+}
+
+static void reverse_keys(uint32_t n)
+{
+	for (uint32_t i = 0; i < n / 2; i++) {
+		uint32_t key = keys[i];
+
+		keys[i] = keys[n - 1 - i];
+		keys[n - 1 - i] = key;
+	}
+}
+
+static int store_keys(uint8_t dst, uint8_t type, const uint32_t *src_keys, uint32_t n,
+		      uint16_t rows, uint16_t cols)
+{
+	int32_float_union *values = (int32_float_union *)tmp;
+	int err = calc_vec_define(dst, type, rows, cols);
+
+	if (err) {
+		return err;
+	}
+	for (uint32_t i = 0; i < n; i++) {
+		values[i].u = (int32_t)value_from_key(type, src_keys[i]);
+	}
+	err = calc_vec_write(dst, 0, values, n * sizeof(values[0]));
+	return err ? err : (int)n;
+}
+// -------------------------------------------------------------------------------------------------
+
+int calc_sort(uint8_t mode, uint8_t dst, uint8_t src, bool descending)
+{
+	uint16_t rows, cols;
+	uint8_t type;
+	int n = load_keys(mode, src, &type, &rows, &cols);
+
+	if (n <= 0) {
+		return n;
+	}
+
+	radix_sort(n);
+	if (descending) {
+		reverse_keys(n);
+	}
+	return store_keys(dst, type, keys, n, rows, cols);
+}
+
+int calc_sort_nth(uint8_t mode, uint8_t src, uint32_t nth, int32_float_union *result)
+{
+	uint16_t rows, cols;
+	uint8_t type;
+	int n = load_keys(mode, src, &type, &rows, &cols);
+
+	if (n <= 0) {
+		return (n < 0) ? n : -EINVAL;
+	}
+	if (nth >= (uint32_t)n) {
+		return -EINVAL;
+	}
+	result->u = (int32_t)value_from_key(type, radix_select(n, nth));
+	return 0;
+}
+
+int calc_sort_median(uint8_t mode, uint8_t src, int32_float_union *result)
+{
+	int32_float_union lo, hi;
+	uint16_t rows, cols;
+	uint8_t type;
+	int n = load_keys(mode, src, &type, &rows, &cols);
+
+	if (n <= 0) {
+		return (n < 0) ? n : -EINVAL;
+	}
+	hi.u = (int32_t)value_from_key(type, radix_select(n, n / 2));
+	if (n % 2) {
+		*result = hi;
+		return 0;
+	}
+	lo.u = (int32_t)value_from_key(type, radix_select(n, n / 2 - 1));
+	if (type == FLOAT_MODE) {
+		result->f = lo.f + (hi.f - lo.f) / 2;
+	} else {
+		result->u = (int32_t)(((int64_t)lo.u + hi.u) >> 1);
+	}
+	return 0;
+}
+
+int calc_sort_top_k(uint8_t mode, uint8_t dst, uint8_t src, uint32_t k)
+{
+	uint32_t threshold;
+	uint32_t above = 0;
+	uint16_t rows, cols;
+	uint8_t type;
+	int n = load_keys(mode, src, &type, &rows, &cols);
+
+	if (n <= 0) {
+		return (n < 0) ? n : -EINVAL;
+	}
+	if (k == 0 || k > (uint32_t)n) {
+		return -EINVAL;
+	}
+
+	// Keys above the k-th largest, then as many copies of it as needed, sorted at the front
+	threshold = radix_select(n, n - k);
+	for (int i = 0; i < n; i++) {
+		if (keys[i] > threshold) {
+			keys[above++] = keys[i];
+		}
+	}
+	while (above < k) {
+		keys[above++] = threshold;
+	}
+	radix_sort(k);
+	reverse_keys(k);
+	return store_keys(dst, type, keys, k, k, 1);
+}
@@ -0,0 +1,66 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+#ifndef CALC_SORT_H_
+#define CALC_SORT_H_
+
+/**@file
+ * @defgroup calc_sort Sort and selection
+ * @{
+ * @brief Sort, nth-element, median and top-k over float or Q31 buffers.
+ *
+ * Elements are mapped to order-preserving unsigned keys (sign bit flipped for Q31, sign bit
+ * flipped or all bits inverted for float) and processed with an LSD radix sort or an MSD radix
+ * select, in a fixed scratch area of 2 x CONFIG_CDS_SORT_MAX_LEN keys. Nothing is allocated.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "calc_port.h"
+#include "calc_engine.h"
+
+/** @brief Sort a buffer.
+ *
+ * @param[in] mode Task mode, FLOAT_MODE or Q31, must match the buffer type.
+ * @param[in] dst Destination buffer, (re)defined with the shape of src. May alias src.
+ * @param[in] src Buffer to sort, up to CONFIG_CDS_SORT_MAX_LEN elements.
+ * @param[in] descending Sort in descending order.
+ *
+ * @retval Number of sorted elements. Otherwise, a (negative) error code.
+ */
+int calc_sort(uint8_t mode, uint8_t dst, uint8_t src, bool descending);
+
+/** @brief The element that would be at index nth of the sorted buffer.
+ *
+ * @retval 0 If the operation was successful. Otherwise, a (negative) error code.
+ */
+int calc_sort_nth(uint8_t mode, uint8_t src, uint32_t nth, int32_float_union *result);
+
+/** @brief Median of a buffer, the mean of the two middle elements for an even length.
+ *
+ * @retval 0 If the operation was successful. Otherwise, a (negative) error code.
+ */
+int calc_sort_median(uint8_t mode, uint8_t src, int32_float_union *result);
+
+/** @brief The k largest elements of a buffer in descending order.
+ *
+ * @param[in] dst Destination buffer, (re)defined as a k-element vector. May alias src.
+ *
+ * @retval Number of elements in dst. Otherwise, a (negative) error code.
+ */
+int calc_sort_top_k(uint8_t mode, uint8_t dst, uint8_t src, uint32_t k);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* CALC_SORT_H_ */
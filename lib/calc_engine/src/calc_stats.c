@@ -0,0 +1,196 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief Streaming statistics
+ */
+
+#include "calc_port.h"
+#include <errno.h>
+#include <string.h>
+#include "calc_stats.h"
+
+#define STATS_HIST_BINS CONFIG_CDS_STAT_HIST_BINS
+
+struct stats_stream {
+	bool fixed;
+	uint32_t count;
+	union {
+		struct {						// Float stream
+			float mean;
+			float m2;
+			float sum_sq;
+			float min;
+			float max;
+			float lo;
+			float hi;
+		} f;
+		struct {						// Q31 stream
+			int64_t mean_q47;
+			uint64_t m2_q40;
+			uint64_t sum_sq_q40;
+			int32_t min;
+			int32_t max;
+			int32_t lo;
+			int32_t hi;
+		} q;
+	};
+	uint32_t hist[STATS_HIST_BINS];
+};
+
+static struct stats_stream streams[CONFIG_CDS_STAT_STREAMS];
+static struct stats_stream *current = &streams[0];
+// -------------------------------------------------------------------------------------------------
+
+static uint64_t add_sat_u64(uint64_t a, uint64_t b)
+{
+	return (a + b < a) ? UINT64_MAX : a + b;
+}
+
+// (a * b) >> 54 for |a|, |b| < 2^49 without a 128-bit product: Q47 * Q47 -> Q40
+static uint64_t mul_q47_q40(int64_t a, int64_t b)
+{
+	uint64_t ua = (a < 0) ? -(uint64_t)a : (uint64_t)a;
+	uint64_t ub = (b < 0) ? -(uint64_t)b : (uint64_t)b;
+	uint64_t a1 = ua >> 27, a0 = ua & 0x7FFFFFF;
+	uint64_t b1 = ub >> 27, b0 = ub & 0x7FFFFFF;
+	uint64_t mid = a1 * b0 + a0 * b1 + ((a0 * b0) >> 27);
+
+	if ((a < 0) != (b < 0)) {
+		return 0;  // Only reached through rounding of the running mean, the true product is >= 0
+	}
+	return a1 * b1 + (mid >> 27);
+}
+
+static uint32_t hist_bin_f(const struct stats_stream *s, float x)
+{
+	float pos = (x - s->f.lo) * STATS_HIST_BINS / (s->f.hi - s->f.lo);
+
+	if (!(pos >= 0.0f)) {  // Also catches NaN
+		return 0;
+	}
+	return (pos >= STATS_HIST_BINS) ? STATS_HIST_BINS - 1 : (uint32_t)pos;
+}
+
+static uint32_t hist_bin_q(const struct stats_stream *s, int32_t x)
+{
+	if (x < s->q.lo) {
+		return 0;
+	}
+	int64_t pos = ((int64_t)x - s->q.lo) * STATS_HIST_BINS / ((int64_t)s->q.hi - s->q.lo);
+
+	return (pos >= STATS_HIST_BINS) ? STATS_HIST_BINS - 1 : (uint32_t)pos;
+}
+
+static void push_f(struct stats_stream *s, float x)
+{
+	float delta = x - s->f.mean;
+
+	s->count++;
+	s->f.mean += delta / s->count;  // Welford
+	s->f.m2 += delta * (x - s->f.mean);
+	s->f.sum_sq += x * x;
+	if (s->count == 1 || x < s->f.min) {
+		s->f.min = x;
+	}
+	if (s->count == 1 || x > s->f.max) {
+		s->f.max = x;
+	}
+	s->hist[hist_bin_f(s, x)]++;
+}
+
+static void push_q(struct stats_stream *s, int32_t x)
+{
+	int64_t x_q47 = (int64_t)x << 16;
+	int64_t delta = x_q47 - s->q.mean_q47;  // |delta| < 2^48
+
+	s->count++;
+	s->q.mean_q47 += delta / s->count;  // Welford
+	s->q.m2_q40 = add_sat_u64(s->q.m2_q40, mul_q47_q40(delta, x_q47 - s->q.mean_q47));
+	s->q.sum_sq_q40 = add_sat_u64(s->q.sum_sq_q40, (uint64_t)(((int64_t)x * x) >> 22));
+	if (s->count == 1 || x < s->q.min) {
+		s->q.min = x;
+	}
+	if (s->count == 1 || x > s->q.max) {
+		s->q.max = x;
+	}
+	s->hist[hist_bin_q(s, x)]++;
+}
+// -------------------------------------------------------------------------------------------------
+
+int calc_stats_select(uint32_t id)
+{
+	if (id >= CONFIG_CDS_STAT_STREAMS) {
+		return -EINVAL;
+	}
+	current = &streams[id];
+	return 0;
+}
+
+int calc_stats_reset(bool fixed, int32_float_union lo, int32_float_union hi)
+{
+	if (fixed ? (hi.u <= lo.u) : !(hi.f > lo.f)) {
+		return -EINVAL;
+	}
+
+	memset(current, 0, sizeof(*current));
+	current->fixed = fixed;
+	if (fixed) {
+		current->q.lo = lo.u;
+		current->q.hi = hi.u;
+	} else {
+		current->f.lo = lo.f;
+		current->f.hi = hi.f;
+	}
+	return 0;
+}
+
+int calc_stats_push(bool fixed, int32_float_union sample)
+{
+	if (fixed != current->fixed || (!fixed && current->f.hi <= current->f.lo)) {
+		return -EINVAL;  // Type mismatch or stream never reset
+	}
+
+	if (fixed) {
+		push_q(current, sample.u);
+	} else {
+		push_f(current, sample.f);
+	}
+	return 0;
+}
+
+void calc_stats_snapshot(struct calc_stats_snapshot *snapshot)
+{
+	const struct stats_stream *s = current;
+
+	memset(snapshot, 0, sizeof(*snapshot));
+	snapshot->fixed = s->fixed;
+	snapshot->count = s->count;
+	memcpy(snapshot->hist, s->hist, sizeof(snapshot->hist));
+
+	if (s->fixed) {
+		uint64_t var_q40 = (s->count > 1) ? s->q.m2_q40 / (s->count - 1) : 0;
+
+		snapshot->mean.u = (int32_t)(s->q.mean_q47 >> 16);
+		snapshot->variance.u = (var_q40 >= ((uint64_t)1 << 40)) ? INT32_MAX
+									: (int32_t)(var_q40 >> 9);
+		snapshot->min.u = s->q.min;
+		snapshot->max.u = s->q.max;
+		snapshot->sum_sq_q40 = s->q.sum_sq_q40;
+	} else {
+		snapshot->mean.f = s->f.mean;
+		snapshot->variance.f = (s->count > 1) ? s->f.m2 / (s->count - 1) : 0.0f;
+		snapshot->min.f = s->f.min;
+		snapshot->max.f = s->f.max;
+		snapshot->sum_sq = s->f.sum_sq;
+	}
+}
+
+void calc_stats_clear(void)
+{
+	memset(streams, 0, sizeof(streams));
+	current = &streams[0];
+}
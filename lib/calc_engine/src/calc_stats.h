@@ -0,0 +1,85 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+#ifndef CALC_STATS_H_
+#define CALC_STATS_H_
+
+/**@file
+ * @defgroup calc_stats Streaming statistics
+ * @{
+ * @brief Running aggregates over sample streams, O(1) memory per stream.
+ *
+ * Each stream keeps a Welford mean and variance, min/max, sum of squares and a fixed-bin
+ * histogram, either in float or in Q31. Q31 streams keep the mean in Q47 and the second
+ * moment and the sum of squares in unsigned Q40 (int64 cannot hold a Q62 sum).
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "calc_port.h"
+#include "calc_engine.h"
+
+/** @brief Aggregate of a stream. */
+struct calc_stats_snapshot {
+	bool fixed;						// Q31 stream, otherwise float
+	uint32_t count;					// Number of samples
+	int32_float_union mean;
+	int32_float_union variance;		// Sample variance (n - 1), Q31 saturates at 1.0
+	int32_float_union min;
+	int32_float_union max;
+	float sum_sq;					// Float streams
+	uint64_t sum_sq_q40;			// Q31 streams
+	uint32_t hist[CONFIG_CDS_STAT_HIST_BINS];
+};
+
+/** @brief Select the stream used by the following calls.
+ *
+ * @param[in] id Stream id, below CONFIG_CDS_STAT_STREAMS.
+ *
+ * @retval 0 If the operation was successful. Otherwise, -EINVAL.
+ */
+int calc_stats_select(uint32_t id);
+
+/** @brief Clear the selected stream and set its type and histogram range.
+ *
+ * @param[in] fixed Q31 stream if true, float stream otherwise.
+ * @param[in] lo Lower edge of the first histogram bin.
+ * @param[in] hi Upper edge of the last histogram bin. Samples outside [lo, hi) land in the
+ *               first or last bin.
+ *
+ * @retval 0 If the operation was successful. Otherwise, -EINVAL for an empty range.
+ */
+int calc_stats_reset(bool fixed, int32_float_union lo, int32_float_union hi);
+
+/** @brief Add a sample to the selected stream.
+ *
+ * @param[in] fixed Type of the sample, must match the stream.
+ * @param[in] sample Float or Q31 sample.
+ *
+ * @retval 0 If the operation was successful. Otherwise, -EINVAL on a type mismatch.
+ */
+int calc_stats_push(bool fixed, int32_float_union sample);
+
+/** @brief Read the aggregate of the selected stream.
+ *
+ * @param[out] snapshot Current aggregate.
+ */
+void calc_stats_snapshot(struct calc_stats_snapshot *snapshot);
+
+/** @brief Clear all streams. */
+void calc_stats_clear(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* CALC_STATS_H_ */
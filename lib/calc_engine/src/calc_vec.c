@@ -0,0 +1,330 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief Vector and matrix buffers
+ */
+
+#include "calc_port.h"
+#include <errno.h>
+#include <string.h>
+#include "calc_vec.h"
+#include "calc_q.h"
+#include "calc_arena.h"
+
+struct vec_buffer {
+	int32_float_union *data;	// Elements, in the session arena
+	uint32_t capacity;	// Allocated elements
+	uint16_t rows;
+	uint16_t cols;
+	uint8_t type;		// FLOAT_MODE or FIXED_MODE
+	bool defined;
+};
+
+static struct vec_buffer buffers[CONFIG_CDS_VEC_BUFFERS];
+
+#define VEC_MAX_LEN (CONFIG_CDS_SESSION_ARENA_SIZE / sizeof(int32_float_union))  // Elements
+
+// Buffers are written from the BT RX thread and used by the calculator engine thread
+CALC_PORT_MUTEX_DEFINE(vec_lock);
+// -------------------------------------------------------------------------------------------------
+
+static uint32_t vec_len(const struct vec_buffer *buf)
+{
+	return (uint32_t)buf->rows * buf->cols;
+}
+
+static struct vec_buffer *vec_get(uint8_t id, uint8_t type)
+{
+	if (id >= CONFIG_CDS_VEC_BUFFERS || !buffers[id].defined || buffers[id].type != type) {
+		return NULL;
+	}
+	return &buffers[id];
+}
+
+static int vec_define_locked(uint8_t id, uint8_t type, uint16_t rows, uint16_t cols)
+{
+	struct vec_buffer *buf;
+	uint32_t len = (uint32_t)rows * cols;
+
+	if (id >= CONFIG_CDS_VEC_BUFFERS || (type != FLOAT_MODE && type != FIXED_MODE) || len == 0) {
+		return -EINVAL;
+	}
+	if (len > VEC_MAX_LEN) {
+		return -ENOMEM;  // Checked in elements, the size in bytes wraps on 32-bit targets
+	}
+
+	buf = &buffers[id];
+	if (!buf->defined || buf->capacity < len) {
+		int32_float_union *data = calc_arena_alloc(len * sizeof(int32_float_union));
+
+		if (!data) {
+			return -ENOMEM;
+		}
+		buf->data = data;  // An outgrown block stays allocated until the session reset
+		buf->capacity = len;
+	}
+	buf->rows = rows;
+	buf->cols = cols;
+	buf->type = type;
+	buf->defined = true;
+	return 0;
+}
+
+// Element type of a task mode, vector operations run in FLOAT_MODE or in Q31
+static int vec_type(uint8_t mode)
+{
+	if (mode == FLOAT_MODE) {
+		return FLOAT_MODE;
+	}
+	return ((mode & CDS_MODE_FORMAT_MASK) == FIXED_MODE) ? FIXED_MODE : -ENOTSUP;
+}
+
+static float vec_op_f(uint8_t op, float a, float b)
+{
+	switch (op) {
+		case CALC_OP_ADD:
+			return a + b;
+		case CALC_OP_SUB:
+			return a - b;
+		case CALC_OP_MUL:
+			return a * b;
+		default:  // CALC_OP_DIV
+			return (b > EPSILON || b < -EPSILON) ? a / b : 0.0f;
+	}
+}
+
+static int32_t sat_q31(int64_t v)
+{
+	return (v > INT32_MAX) ? INT32_MAX : ((v < INT32_MIN) ? INT32_MIN : (int32_t)v);
+}
+// -------------------------------------------------------------------------------------------------
+
+int calc_vec_define(uint8_t id, uint8_t type, uint16_t rows, uint16_t cols)
+{
+	calc_port_mutex_lock(&vec_lock);
+	int err = vec_define_locked(id, type, rows, cols);
+	calc_port_mutex_unlock(&vec_lock);
+
+	return err;
+}
+
+int calc_vec_write(uint8_t id, size_t byte_offset, const void *data, size_t len)
+{
+	int err = -EINVAL;
+
+	calc_port_mutex_lock(&vec_lock);
+	if (id < CONFIG_CDS_VEC_BUFFERS && buffers[id].defined &&
+	    byte_offset <= vec_len(&buffers[id]) * sizeof(int32_float_union) &&
+	    len <= vec_len(&buffers[id]) * sizeof(int32_float_union) - byte_offset) {
+		memcpy((uint8_t *)buffers[id].data + byte_offset, data, len);
+		err = 0;
+	}
+	calc_port_mutex_unlock(&vec_lock);
+
+	return err;
+}
+
+int calc_vec_read(uint8_t id, uint32_t first, int32_float_union *out, size_t max, uint8_t *type)
+{
+	int count = -EINVAL;
+
+	calc_port_mutex_lock(&vec_lock);
+	if (id < CONFIG_CDS_VEC_BUFFERS && buffers[id].defined) {
+		uint32_t len = vec_len(&buffers[id]);
+
+		count = (first < len) ? MIN(len - first, max) : 0;
+		memcpy(out, &buffers[id].data[first], count * sizeof(int32_float_union));
+		*type = buffers[id].type;
+	}
+	calc_port_mutex_unlock(&vec_lock);
+
+	return count;
+}
+
+int calc_vec_shape(uint8_t id, uint16_t *rows, uint16_t *cols, uint8_t *type)
+{
+	int err = -EINVAL;
+
+	calc_port_mutex_lock(&vec_lock);
+	if (id < CONFIG_CDS_VEC_BUFFERS && buffers[id].defined) {
+		*rows = buffers[id].rows;
+		*cols = buffers[id].cols;
+		*type = buffers[id].type;
+		err = 0;
+	}
+	calc_port_mutex_unlock(&vec_lock);
+
+	return err;
+}
+
+int calc_vec_type(uint8_t mode)
+{
+	return vec_type(mode);
+}
+
+int calc_vec_elementwise(uint8_t op, uint8_t mode, uint8_t dst, uint8_t a, uint8_t b)
+{
+	int type = vec_type(mode);
+	int err = -EINVAL;
+
+	if (type < 0 || op < CALC_OP_ADD || op > CALC_OP_DIV) {
+		return (type < 0) ? type : -EINVAL;
+	}
+
+	calc_port_mutex_lock(&vec_lock);
+	struct vec_buffer *va = vec_get(a, type);
+	struct vec_buffer *vb = vec_get(b, type);
+
+	if (va && vb && vec_len(va) == vec_len(vb) &&
+	    (err = vec_define_locked(dst, type, va->rows, va->cols)) == 0) {
+		const int32_float_union *pa = va->data;
+		const int32_float_union *pb = vb->data;
+		int32_float_union *pd = buffers[dst].data;
+		uint32_t len = vec_len(va);
+		uint8_t status;
+
+		for (uint32_t i = 0; i < len; i++) {
+			if (type == FLOAT_MODE) {
+				pd[i].f = vec_op_f(op, pa[i].f, pb[i].f);
+			} else {
+				pd[i].u = calc_q_execute(mode, op, pa[i].u, pb[i].u, &status);
+			}
+		}
+		err = (int)len;
+	}
+	calc_port_mutex_unlock(&vec_lock);
+
+	return err;
+}
+
+int calc_vec_scalar(uint8_t op, uint8_t mode, uint8_t dst, uint8_t a, int32_float_union scalar)
+{
+	int type = vec_type(mode);
+	int err = -EINVAL;
+
+	if (type < 0 || op < CALC_OP_ADD || op > CALC_OP_DIV) {
+		return (type < 0) ? type : -EINVAL;
+	}
+
+	calc_port_mutex_lock(&vec_lock);
+	struct vec_buffer *va = vec_get(a, type);
+
+	if (va && (err = vec_define_locked(dst, type, va->rows, va->cols)) == 0) {
+		const int32_float_union *pa = va->data;
+		int32_float_union *pd = buffers[dst].data;
+		uint32_t len = vec_len(va);
+		uint8_t status;
+
+		for (uint32_t i = 0; i < len; i++) {
+			if (type == FLOAT_MODE) {
+				pd[i].f = vec_op_f(op, pa[i].f, scalar.f);
+			} else {
+				pd[i].u = calc_q_execute(mode, op, pa[i].u, scalar.u, &status);
+			}
+		}
+		err = (int)len;
+	}
+	calc_port_mutex_unlock(&vec_lock);
+
+	return err;
+}
+
+int calc_vec_dot(uint8_t mode, uint8_t a, uint8_t b, int32_float_union *result)
+{
+	int type = vec_type(mode);
+	int err = -EINVAL;
+
+	if (type < 0) {
+		return type;
+	}
+
+	calc_port_mutex_lock(&vec_lock);
+	struct vec_buffer *va = vec_get(a, type);
+	struct vec_buffer *vb = vec_get(b, type);
+
+	if (va && vb && vec_len(va) == vec_len(vb)) {
+		const int32_float_union *pa = va->data;
+		const int32_float_union *pb = vb->data;
+		uint32_t len = vec_len(va);
+		float sum_f = 0.0f;
+		int64_t sum_q48 = 0;
+
+		for (uint32_t i = 0; i < len; i++) {
+			if (type == FLOAT_MODE) {
+				sum_f += pa[i].f * pb[i].f;
+			} else {
+				sum_q48 += ((int64_t)pa[i].u * pb[i].u) >> 14;  // Q62 -> Q48
+			}
+		}
+		if (type == FLOAT_MODE) {
+			result->f = sum_f;
+		} else {
+			result->u = sat_q31(sum_q48 >> 17);
+		}
+		err = 0;
+	}
+	calc_port_mutex_unlock(&vec_lock);
+
+	return err;
+}
+
+int calc_vec_mat_mul(uint8_t mode, uint8_t dst, uint8_t a, uint8_t b)
+{
+	int type = vec_type(mode);
+	int err = -EINVAL;
+
+	if (type < 0) {
+		return type;
+	}
+	if (dst == a || dst == b) {
+		return -EINVAL;
+	}
+
+	calc_port_mutex_lock(&vec_lock);
+	struct vec_buffer *va = vec_get(a, type);
+	struct vec_buffer *vb = vec_get(b, type);
+
+	if (va && vb && va->cols == vb->rows &&
+	    (err = vec_define_locked(dst, type, va->rows, vb->cols)) == 0) {
+		const int32_float_union *pa = va->data;
+		const int32_float_union *pb = vb->data;
+		int32_float_union *pd = buffers[dst].data;
+		uint16_t m = va->rows, k = va->cols, n = vb->cols;
+
+		for (uint16_t row = 0; row < m; row++) {
+			for (uint16_t col = 0; col < n; col++) {
+				const int32_float_union *pr = &pa[(uint32_t)row * k];
+				float sum_f = 0.0f;
+				int64_t sum_q48 = 0;
+
+				for (uint16_t i = 0; i < k; i++) {
+					if (type == FLOAT_MODE) {
+						sum_f += pr[i].f * pb[(uint32_t)i * n + col].f;
+					} else {
+						sum_q48 += ((int64_t)pr[i].u * pb[(uint32_t)i * n + col].u) >> 14;
+					}
+				}
+				if (type == FLOAT_MODE) {
+					pd[(uint32_t)row * n + col].f = sum_f;
+				} else {
+					pd[(uint32_t)row * n + col].u = sat_q31(sum_q48 >> 17);
+				}
+			}
+		}
+		err = (int)((uint32_t)m * n);
+	}
+	calc_port_mutex_unlock(&vec_lock);
+
+	return err;
+}
+
+void calc_vec_clear(void)
+{
+	calc_port_mutex_lock(&vec_lock);
+	memset(buffers, 0, sizeof(buffers));
+	calc_port_mutex_unlock(&vec_lock);
+}
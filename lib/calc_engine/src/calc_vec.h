@@ -0,0 +1,126 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+#ifndef CALC_VEC_H_
+#define CALC_VEC_H_
+
+/**@file
+ * @defgroup calc_vec Vector and matrix buffers
+ * @{
+ * @brief Operand buffers uploaded over the CDS buffer characteristic and the operations on them.
+ *
+ * Buffers are rows x cols matrices (vectors have one column) of float or Q31 elements, stored
+ * in the session arena (calc_arena.h). Redefining a buffer reuses its space when the new shape
+ * fits, the space is only reclaimed by the session arena reset.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "calc_port.h"
+#include "calc_engine.h"
+
+// Buffer characteristic records
+#define CALC_BUF_DEFINE 0  // [0][id][type][rows le16][cols le16]
+#define CALC_BUF_DATA   1  // [1][id][element offset le16][elements...]
+
+#define CALC_BUF_DEFINE_LEN 7
+#define CALC_BUF_DATA_HDR_LEN 4
+
+/** @brief Define (allocate) a buffer.
+ *
+ * @param[in] id Buffer id, below CONFIG_CDS_VEC_BUFFERS.
+ * @param[in] type FLOAT_MODE or FIXED_MODE (Q31).
+ * @param[in] rows Number of rows.
+ * @param[in] cols Number of columns, 1 for a vector.
+ *
+ * @retval 0 If the operation was successful. -EINVAL for a bad id, type or shape, -ENOMEM if
+ *         the arena is exhausted.
+ */
+int calc_vec_define(uint8_t id, uint8_t type, uint16_t rows, uint16_t cols);
+
+/** @brief Copy raw little-endian element data into a buffer.
+ *
+ * @param[in] id Buffer id.
+ * @param[in] byte_offset Destination offset in bytes, need not be element aligned.
+ * @param[in] data Element data.
+ * @param[in] len Length of data.
+ *
+ * @retval 0 If the operation was successful. Otherwise, -EINVAL.
+ */
+int calc_vec_write(uint8_t id, size_t byte_offset, const void *data, size_t len);
+
+/** @brief Copy elements out of a buffer.
+ *
+ * @param[in] id Buffer id.
+ * @param[in] first First element.
+ * @param[out] out Elements.
+ * @param[in] max Capacity of out.
+ * @param[out] type Element type, FLOAT_MODE or FIXED_MODE.
+ *
+ * @retval Number of copied elements, 0 past the end. -EINVAL for an undefined buffer.
+ */
+int calc_vec_read(uint8_t id, uint32_t first, int32_float_union *out, size_t max, uint8_t *type);
+
+/** @brief Shape and element type of a buffer.
+ *
+ * @retval 0 If the buffer is defined. Otherwise, -EINVAL.
+ */
+int calc_vec_shape(uint8_t id, uint16_t *rows, uint16_t *cols, uint8_t *type);
+
+/** @brief Element type of a task mode.
+ *
+ * @retval FLOAT_MODE or FIXED_MODE (Q31). -ENOTSUP for the other formats.
+ */
+int calc_vec_type(uint8_t mode);
+
+/** @brief Element-wise dst = a (op) b.
+ *
+ * @param[in] op CALC_OP_ADD, CALC_OP_SUB, CALC_OP_MUL or CALC_OP_DIV.
+ * @param[in] mode Task mode, selects the element type and the Q31 overflow policy.
+ * @param[in] dst Destination buffer, (re)defined with the shape of a. May alias a or b.
+ * @param[in] a Buffer operand.
+ * @param[in] b Buffer operand with as many elements as a.
+ *
+ * @retval Number of result elements. Otherwise, a (negative) error code.
+ */
+int calc_vec_elementwise(uint8_t op, uint8_t mode, uint8_t dst, uint8_t a, uint8_t b);
+
+/** @brief Scalar broadcast dst = a (op) scalar.
+ *
+ * @retval Number of result elements. Otherwise, a (negative) error code.
+ */
+int calc_vec_scalar(uint8_t op, uint8_t mode, uint8_t dst, uint8_t a, int32_float_union scalar);
+
+/** @brief Dot product of two buffers with the same number of elements.
+ *
+ * Q31 products are accumulated in Q48 (16 guard bits) and saturated back to Q31.
+ *
+ * @retval 0 If the operation was successful. Otherwise, a (negative) error code.
+ */
+int calc_vec_dot(uint8_t mode, uint8_t a, uint8_t b, int32_float_union *result);
+
+/** @brief Matrix product dst = a * b, matrix-vector when b has one column.
+ *
+ * @param[in] dst Destination buffer, must not alias a or b.
+ *
+ * @retval Number of result elements. Otherwise, a (negative) error code.
+ */
+int calc_vec_mat_mul(uint8_t mode, uint8_t dst, uint8_t a, uint8_t b);
+
+/** @brief Drop all buffers, before the session arena is reset. */
+void calc_vec_clear(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* CALC_VEC_H_ */
@@ -0,0 +1,388 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief CDS wire codec
+ */
+
+#include "calc_port.h"
+#include <errno.h>
+#include <string.h>
+#include "cds_codec.h"
+#include "fp16.h"
+#include "calc_q.h"
+
+// Operand words of a task: operand 1 (real part in the complex modes), imaginary part of operand 1
+// (COMPLEX_FLOAT_MODE only), then the same for operand 2. This is also their order on the wire.
+#define CODEC_WORDS 4
+
+// Delta state of a frame, raw operand bit patterns (2-byte ones zero-extended) of the previous task
+struct codec_state {
+	uint32_t prev[CODEC_WORDS];
+};
+// -------------------------------------------------------------------------------------------------
+
+static uint8_t codec_operand_count(uint8_t operation)
+{
+	switch (operation) {
+		case CALC_OP_RESET:
+		case CALC_OP_STAT_SNAPSHOT:
+		case CALC_OP_VEC_CLEAR:
+		case CALC_OP_SESSION_RESET:
+		case CALC_OP_ARENA_STATS:
+			return 0;
+		case CALC_OP_STAT_SELECT:
+		case CALC_OP_STAT_PUSH:
+		case CALC_OP_VEC_ADD:
+		case CALC_OP_VEC_SUB:
+		case CALC_OP_VEC_MUL:
+		case CALC_OP_VEC_DOT:
+		case CALC_OP_MAT_VEC:
+		case CALC_OP_MAT_MUL:
+		case CALC_OP_VEC_READ:
+		case CALC_OP_FFT:
+		case CALC_OP_FILT_RESET:
+		case CALC_OP_FILTER:
+		case CALC_OP_SORT:
+		case CALC_OP_MEDIAN:
+		case CALC_OP_TOP_K:
+		case CALC_OP_CONJ:
+		case CALC_OP_MAG:
+		case CALC_OP_PHASE:
+		case CALC_OP_FUNC_DELETE:
+		case CALC_OP_FUNC_EVAL:
+		case CALC_OP_JOB_CLEAR:
+			return 1;
+		default:
+			return 2;
+	}
+}
+
+static uint8_t codec_operand_width(uint8_t mode)
+{
+	return (mode == HALF_MODE || (mode & CDS_MODE_FORMAT_MASK) == Q15_MODE) ? sizeof(uint16_t)
+									       : sizeof(uint32_t);
+}
+
+static uint8_t codec_operand_words(uint8_t mode)
+{
+	return (mode == COMPLEX_FLOAT_MODE) ? 2 : 1;
+}
+
+bool cds_codec_mode_valid(uint8_t mode)
+{
+	return mode == FLOAT_MODE || mode == HALF_MODE || mode == COMPLEX_Q15_MODE ||
+	       mode == COMPLEX_FLOAT_MODE || calc_q_mode_valid(mode);
+}
+
+static uint32_t zigzag_encode(int32_t v)
+{
+	return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t zigzag_decode(uint32_t v)
+{
+	return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static size_t varint_len(uint32_t v)
+{
+	size_t len = 1;
+
+	while (v >= 0x80) {
+		v >>= 7;
+		len++;
+	}
+	return len;
+}
+
+static size_t varint_put(uint32_t v, uint8_t *buf)
+{
+	size_t len = 0;
+
+	while (v >= 0x80) {
+		buf[len++] = (uint8_t)(v | 0x80);
+		v >>= 7;
+	}
+	buf[len++] = (uint8_t)v;
+	return len;
+}
+
+// Returns the number of bytes consumed, 0 if the varint is truncated or longer than 32 bits
+static size_t varint_get(const uint8_t *buf, size_t len, uint32_t *v)
+{
+	uint32_t value = 0;
+
+	for (size_t i = 0; i < len && i < 5; i++) {
+		if (i == 4 && buf[i] > 0x0F) {
+			return 0;  // Bits above 32, or a sixth byte
+		}
+		value |= (uint32_t)(buf[i] & 0x7F) << (7 * i);
+		if (!(buf[i] & 0x80)) {
+			*v = value;
+			return i + 1;
+		}
+	}
+	return 0;
+}
+// -------------------------------------------------------------------------------------------------
+
+// Raw operand bit patterns to engine operands, HALF_MODE is widened to float32, Q15 sign-extended
+static void codec_set_operands(struct calculator_task *task, const uint32_t *raw)
+{
+	int32_float_union im_1 = { .u = (int32_t)raw[1] };
+	int32_float_union im_2 = { .u = (int32_t)raw[3] };
+
+	if (task->mode == HALF_MODE) {
+		task->f_operand_1 = fp16_to_float((uint16_t)raw[0]);
+		task->f_operand_2 = fp16_to_float((uint16_t)raw[2]);
+	} else if ((task->mode & CDS_MODE_FORMAT_MASK) == Q15_MODE) {
+		task->q31_operand_1 = (int16_t)raw[0];
+		task->q31_operand_2 = (int16_t)raw[2];
+	} else {
+		task->q31_operand_1 = (int32_t)raw[0];
+		task->q31_operand_2 = (int32_t)raw[2];
+	}
+	task->f_operand_1_im = im_1.f;
+	task->f_operand_2_im = im_2.f;
+}
+
+static void codec_get_operands(const struct calculator_task *task, uint32_t *raw)
+{
+	int32_float_union im_1 = { .f = task->f_operand_1_im };
+	int32_float_union im_2 = { .f = task->f_operand_2_im };
+
+	if (task->mode == HALF_MODE) {
+		raw[0] = fp16_from_float(task->f_operand_1);
+		raw[2] = fp16_from_float(task->f_operand_2);
+	} else if ((task->mode & CDS_MODE_FORMAT_MASK) == Q15_MODE) {
+		raw[0] = (uint16_t)task->q31_operand_1;
+		raw[2] = (uint16_t)task->q31_operand_2;
+	} else {
+		raw[0] = (uint32_t)task->q31_operand_1;
+		raw[2] = (uint32_t)task->q31_operand_2;
+	}
+	raw[1] = (task->mode == COMPLEX_FLOAT_MODE) ? (uint32_t)im_1.u : 0;
+	raw[3] = (task->mode == COMPLEX_FLOAT_MODE) ? (uint32_t)im_2.u : 0;
+}
+
+static int decode_operand(const uint8_t *buf, size_t len, uint8_t header, uint8_t width,
+			  uint32_t *prev, uint32_t *raw)
+{
+	size_t used;
+
+	if (header & CDS_WIRE_F_DELTA) {
+		uint32_t zz;
+
+		used = varint_get(buf, len, &zz);
+		if (!used) {
+			return -EINVAL;
+		}
+		*raw = *prev + (uint32_t)zigzag_decode(zz);
+	} else {
+		if (len < width) {
+			return -EINVAL;
+		}
+		*raw = (width == sizeof(uint16_t)) ? sys_get_le16(buf) : sys_get_le32(buf);
+		used = width;
+	}
+	*prev = *raw;
+	return (int)used;
+}
+
+static int decode_v1(const uint8_t *buf, size_t len, struct calculator_task *tasks,
+		     size_t max_tasks)
+{
+	struct codec_state state = { 0 };
+	size_t pos = 1;  // Skip the version marker
+	size_t count = 0;
+
+	while (pos < len) {
+		struct calculator_task *task = &tasks[count];
+		uint8_t header = buf[pos++];
+		uint32_t raw[CODEC_WORDS] = { 0 };
+
+		if (count == max_tasks) {
+			return -ENOMEM;
+		}
+
+		task->operation = header & CDS_WIRE_OP_MASK;
+		if (task->operation == CDS_WIRE_OP_EXT) {
+			if (pos == len) {
+				return -EINVAL;
+			}
+			task->operation = buf[pos++];
+		}
+		task->mode = header >> CDS_WIRE_MODE_SHIFT;
+		if (task->mode == CDS_WIRE_MODE_EXT) {
+			if (pos == len) {
+				return -EINVAL;
+			}
+			task->mode = buf[pos++];
+		}
+		if (!cds_codec_mode_valid(task->mode)) {
+			return -EINVAL;
+		}
+		task->flags = CDS_TASK_FLAG_BATCH | ((header & CDS_WIRE_F_ACC) ? CDS_TASK_FLAG_ACC : 0);
+		task->job = 0;
+
+		uint8_t operands = codec_operand_count(task->operation);
+		uint8_t words = codec_operand_words(task->mode);
+		uint8_t width = codec_operand_width(task->mode);
+
+		for (uint8_t op = (header & CDS_WIRE_F_ACC) ? 1 : 0; op < operands; op++) {
+			for (uint8_t w = 0; w < words; w++) {
+				uint8_t slot = 2 * op + w;
+				int used = decode_operand(&buf[pos], len - pos, header, width,
+							  &state.prev[slot], &raw[slot]);
+
+				if (used < 0) {
+					return used;
+				}
+				pos += used;
+			}
+		}
+		codec_set_operands(task, raw);
+		count++;
+	}
+
+	return (int)count;
+}
+
+int cds_codec_decode(const uint8_t *buf, size_t len, struct calculator_task *tasks,
+		     size_t max_tasks)
+{
+	if (len == 0) {
+		return -EINVAL;
+	}
+
+	if (buf[0] == CDS_CODEC_V1) {
+		return decode_v1(buf, len, tasks, max_tasks);
+	}
+
+	if (len == CDS_CODEC_LEGACY_LEN) {  // Compatibility path for the original format
+		const struct calculator_task_legacy *legacy = (const struct calculator_task_legacy *)buf;
+
+		if (max_tasks < 1) {
+			return -ENOMEM;
+		}
+		if (!cds_codec_mode_valid(legacy->mode) || legacy->mode == HALF_MODE ||  // HALF_MODE uses the 6-byte format
+		    legacy->mode == COMPLEX_FLOAT_MODE) {  // No room for the imaginary parts
+			return -EINVAL;
+		}
+		tasks[0].operation = legacy->operation;
+		tasks[0].q31_operand_1 = legacy->q31_operand_1;
+		tasks[0].q31_operand_2 = legacy->q31_operand_2;
+		tasks[0].f_operand_1_im = 0.0f;
+		tasks[0].f_operand_2_im = 0.0f;
+		tasks[0].mode = legacy->mode;
+		tasks[0].flags = 0;
+		tasks[0].job = 0;
+		return 1;
+	}
+
+	if (len % sizeof(struct calculator_task_f16) == 0) {
+		const struct calculator_task_f16 *task_f16 = (const struct calculator_task_f16 *)buf;
+		size_t count = len / sizeof(struct calculator_task_f16);
+
+		if (count > max_tasks) {
+			return -ENOMEM;
+		}
+		for (size_t i = 0; i < count; i++) {
+			if (task_f16[i].mode != HALF_MODE) {
+				return -EINVAL;
+			}
+			tasks[i].operation = task_f16[i].operation;
+			tasks[i].f_operand_1 = fp16_to_float(sys_le16_to_cpu(task_f16[i].h_operand_1));
+			tasks[i].f_operand_2 = fp16_to_float(sys_le16_to_cpu(task_f16[i].h_operand_2));
+			tasks[i].f_operand_1_im = 0.0f;
+			tasks[i].f_operand_2_im = 0.0f;
+			tasks[i].mode = HALF_MODE;
+			tasks[i].flags = CDS_TASK_FLAG_BATCH;
+			tasks[i].job = 0;
+		}
+		return (int)count;
+	}
+
+	return -EINVAL;
+}
+// -------------------------------------------------------------------------------------------------
+
+int cds_codec_encode(const struct calculator_task *tasks, size_t count, uint8_t *buf,
+		     size_t size)
+{
+	struct codec_state state = { 0 };
+	size_t pos = 0;
+
+	if (size < 1) {
+		return -ENOMEM;
+	}
+	buf[pos++] = CDS_CODEC_V1;
+
+	for (size_t i = 0; i < count; i++) {
+		const struct calculator_task *task = &tasks[i];
+		uint8_t tmp[CDS_CODEC_TASK_MAX_LEN];
+		size_t n = 1;
+		uint8_t header = 0;
+		uint8_t operands = codec_operand_count(task->operation);
+		uint8_t words = codec_operand_words(task->mode);
+		uint8_t width = codec_operand_width(task->mode);
+		bool acc = (task->flags & CDS_TASK_FLAG_ACC) != 0;
+		uint32_t raw[CODEC_WORDS];
+		uint32_t delta[CODEC_WORDS];
+		size_t raw_len = 0;
+		size_t delta_len = 0;
+
+		codec_get_operands(task, raw);
+		for (uint8_t op = acc ? 1 : 0; op < operands; op++) {
+			for (uint8_t w = 0; w < words; w++) {
+				uint8_t slot = 2 * op + w;
+
+				delta[slot] = zigzag_encode((int32_t)(raw[slot] - state.prev[slot]));
+				raw_len += width;
+				delta_len += varint_len(delta[slot]);
+			}
+		}
+
+		header |= (task->operation < CDS_WIRE_OP_EXT) ? task->operation : CDS_WIRE_OP_EXT;
+		header |= acc ? CDS_WIRE_F_ACC : 0;
+		header |= (delta_len < raw_len) ? CDS_WIRE_F_DELTA : 0;
+		header |= ((task->mode < CDS_WIRE_MODE_EXT) ? task->mode : CDS_WIRE_MODE_EXT)
+			  << CDS_WIRE_MODE_SHIFT;
+		if (task->operation >= CDS_WIRE_OP_EXT) {
+			tmp[n++] = task->operation;
+		}
+		if (task->mode >= CDS_WIRE_MODE_EXT) {
+			tmp[n++] = task->mode;
+		}
+
+		for (uint8_t op = acc ? 1 : 0; op < operands; op++) {
+			for (uint8_t w = 0; w < words; w++) {
+				uint8_t slot = 2 * op + w;
+
+				if (header & CDS_WIRE_F_DELTA) {
+					n += varint_put(delta[slot], &tmp[n]);
+				} else if (width == sizeof(uint16_t)) {
+					sys_put_le16((uint16_t)raw[slot], &tmp[n]);
+					n += width;
+				} else {
+					sys_put_le32(raw[slot], &tmp[n]);
+					n += width;
+				}
+				state.prev[slot] = raw[slot];
+			}
+		}
+
+		if (pos + n > size) {
+			return -ENOMEM;
+		}
+		tmp[0] = header;
+		memcpy(&buf[pos], tmp, n);
+		pos += n;
+	}
+
+	return (int)pos;
+}
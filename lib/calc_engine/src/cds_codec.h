@@ -0,0 +1,93 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+#ifndef CDS_CODEC_H_
+#define CDS_CODEC_H_
+
+/**@file
+ * @defgroup cds_codec CDS wire codec
+ * @{
+ * @brief Encoding and decoding of operation frames written to the CDS operation characteristic.
+ *
+ * Three frame formats are accepted:
+ * - Legacy: exactly one 10-byte packed struct calculator_task_legacy.
+ * - FP16 batch: one or more 6-byte struct calculator_task_f16 back to back.
+ * - Version 1: CDS_CODEC_V1 followed by compact tasks. Every task starts with a header byte:
+ *
+ *       bit 7..6  mode (FLOAT_MODE, FIXED_MODE, HALF_MODE, CDS_WIRE_MODE_EXT: full mode byte
+ *                 follows, e.g. Q15_MODE | CDS_MODE_WRAP)
+ *       bit 5     CDS_WIRE_F_DELTA: operands are zigzag varints, delta to the previous task
+ *       bit 4     CDS_WIRE_F_ACC: operand 1 omitted, the engine uses the previous result
+ *       bit 3..0  opcode (CDS_WIRE_OP_EXT: full opcode in the next byte)
+ *
+ *   then the extended opcode and mode bytes if flagged, then the operands. Raw operands are
+ *   little-endian at their native width (4 bytes, 2 bytes for HALF_MODE and Q15). A
+ *   COMPLEX_FLOAT_MODE operand is two words, real then imaginary part. Delta operands are taken
+ *   against the same operand word of the previous task in the frame (0 for the first one).
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "calc_port.h"
+#include "calc_engine.h"
+
+#define CDS_CODEC_V1 0x81  // Version marker, legacy frames start with an opcode < 0x80
+
+#define CDS_WIRE_OP_MASK    0x0F
+#define CDS_WIRE_OP_EXT     0x0F
+#define CDS_WIRE_F_ACC      0x10
+#define CDS_WIRE_F_DELTA    0x20
+#define CDS_WIRE_MODE_SHIFT 6
+#define CDS_WIRE_MODE_EXT   3
+
+#define CDS_CODEC_LEGACY_LEN    sizeof(struct calculator_task_legacy)
+#define CDS_CODEC_TASK_MAX_LEN  23  // Header, extended opcode and mode, four 5-byte varints
+
+/** @brief Check if a mode is accepted on the wire.
+ *
+ * @retval true For the float, half-precision and complex modes, and the fixed-point modes of
+ *         calc_q_mode_valid().
+ */
+bool cds_codec_mode_valid(uint8_t mode);
+
+/** @brief Decode an operation frame.
+ *
+ * @param[in] buf Received frame.
+ * @param[in] len Frame length.
+ * @param[out] tasks Decoded tasks.
+ * @param[in] max_tasks Capacity of tasks.
+ *
+ * @retval Number of decoded tasks. -EINVAL for a malformed frame, -ENOMEM if the frame holds
+ *         more than max_tasks tasks.
+ */
+int cds_codec_decode(const uint8_t *buf, size_t len, struct calculator_task *tasks,
+		     size_t max_tasks);
+
+/** @brief Encode tasks as a version 1 frame.
+ *
+ * Each task uses delta operands when they are shorter than the raw ones.
+ *
+ * @param[in] tasks Tasks to encode.
+ * @param[in] count Number of tasks.
+ * @param[out] buf Frame buffer.
+ * @param[in] size Size of buf.
+ *
+ * @retval Frame length. -ENOMEM if the frame does not fit in buf.
+ */
+int cds_codec_encode(const struct calculator_task *tasks, size_t count, uint8_t *buf,
+		     size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* CDS_CODEC_H_ */
@@ -0,0 +1,241 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+#ifndef FIXED_POINT_HPP_
+#define FIXED_POINT_HPP_
+
+/**@file
+ * @defgroup fixed_point Fixed-point Qm.n types
+ * @{
+ * @brief Header-only fixed-point template, arithmetic and policies are resolved at compile time.
+ *
+ * Q<int_bits, frac_bits> stores a signed value with int_bits integer bits (sign excluded) and
+ * frac_bits fractional bits in the smallest integer type that fits. The overflow policy decides
+ * what an out of range result becomes, the rounding policy how multiplication and format
+ * conversion drop fractional bits. Division always rounds to nearest, ties away from zero.
+ */
+
+#include <stdint.h>
+#include <type_traits>
+
+namespace fxp {
+
+enum class status : uint8_t {
+	ok,
+	overflow,
+	div_by_zero,
+};
+
+// Overflow policies -------------------------------------------------------------------------------
+struct saturate {  // Clamp to the largest/smallest representable value
+	template <int Bits>
+	static constexpr int64_t narrow(int64_t v, status &st)
+	{
+		constexpr int64_t hi = (int64_t{1} << (Bits - 1)) - 1;
+		constexpr int64_t lo = -(int64_t{1} << (Bits - 1));
+
+		if (v > hi || v < lo) {
+			st = status::overflow;
+			return (v > hi) ? hi : lo;
+		}
+		return v;
+	}
+};
+
+struct wrap {  // Two's complement wrap-around, keep the low Bits bits
+	template <int Bits>
+	static constexpr int64_t narrow(int64_t v, status &st)
+	{
+		constexpr uint64_t mask = (uint64_t{1} << Bits) - 1;
+		constexpr uint64_t sign = uint64_t{1} << (Bits - 1);
+		uint64_t low = static_cast<uint64_t>(v) & mask;
+
+		if (static_cast<int64_t>((low ^ sign) - sign) != v) {
+			st = status::overflow;
+		}
+		return static_cast<int64_t>((low ^ sign) - sign);
+	}
+};
+
+struct flush {  // Out of range results become zero (original FIXED_MODE behaviour)
+	template <int Bits>
+	static constexpr int64_t narrow(int64_t v, status &st)
+	{
+		constexpr int64_t hi = (int64_t{1} << (Bits - 1)) - 1;
+		constexpr int64_t lo = -(int64_t{1} << (Bits - 1));
+
+		if (v > hi || v < lo) {
+			st = status::overflow;
+			return 0;
+		}
+		return v;
+	}
+};
+
+// Rounding policies -------------------------------------------------------------------------------
+struct round_floor {  // Arithmetic shift, rounds toward -infinity
+	static constexpr int64_t shift_right(int64_t v, int s)
+	{
+		return v >> s;
+	}
+};
+
+struct round_nearest {  // Round to nearest, ties toward +infinity
+	static constexpr int64_t shift_right(int64_t v, int s)
+	{
+		return (v + (int64_t{1} << (s - 1))) >> s;
+	}
+};
+// -------------------------------------------------------------------------------------------------
+
+template <int IntBits, int FracBits, typename Overflow = saturate, typename Rounding = round_nearest>
+class Q {
+public:
+	static constexpr int int_bits = IntBits;
+	static constexpr int frac_bits = FracBits;
+	static constexpr int bits = 1 + IntBits + FracBits;  // Including the sign bit
+
+	static_assert(IntBits >= 0 && FracBits > 0, "Q format needs fractional bits");
+	static_assert(bits <= 32, "Q format must fit in 32 bits");
+
+	using raw_t = std::conditional_t<(bits <= 8), int8_t,
+					 std::conditional_t<(bits <= 16), int16_t, int32_t>>;
+	using overflow_policy = Overflow;
+	using rounding_policy = Rounding;
+
+	static constexpr int64_t raw_max = (int64_t{1} << (bits - 1)) - 1;
+	static constexpr int64_t raw_min = -(int64_t{1} << (bits - 1));
+
+	constexpr Q() : raw_(0) {}
+
+	/** Wrap a raw value, only the low bits bits are kept. */
+	static constexpr Q from_raw(int32_t raw)
+	{
+		status st = status::ok;
+
+		return Q(static_cast<raw_t>(wrap::narrow<bits>(raw, st)));
+	}
+
+	/** Convert from float, rounding to nearest and saturating. */
+	static constexpr Q from_float(float f)
+	{
+		double scaled = static_cast<double>(f) * static_cast<double>(int64_t{1} << FracBits);
+
+		if (scaled >= static_cast<double>(raw_max)) {
+			return Q(static_cast<raw_t>(raw_max));
+		}
+		if (scaled <= static_cast<double>(raw_min)) {
+			return Q(static_cast<raw_t>(raw_min));
+		}
+		return Q(static_cast<raw_t>(static_cast<int64_t>(scaled + (scaled >= 0 ? 0.5 : -0.5))));
+	}
+
+	constexpr float to_float() const
+	{
+		return static_cast<float>(raw_) / static_cast<float>(int64_t{1} << FracBits);
+	}
+
+	constexpr raw_t raw() const
+	{
+		return raw_;
+	}
+
+	/** Convert to another Q format, using this format's rounding and the target's overflow policy. */
+	template <typename To>
+	constexpr To convert(status &st) const
+	{
+		int64_t v = raw_;
+
+		if constexpr (To::frac_bits > FracBits) {
+			v *= int64_t{1} << (To::frac_bits - FracBits);  // Exact, |raw| < 2^31
+		} else if constexpr (To::frac_bits < FracBits) {
+			v = Rounding::shift_right(v, FracBits - To::frac_bits);
+		}
+		return To::narrow(v, st);
+	}
+
+	static constexpr Q add(Q a, Q b, status &st)
+	{
+		return narrow(int64_t{a.raw_} + b.raw_, st);
+	}
+
+	static constexpr Q sub(Q a, Q b, status &st)
+	{
+		return narrow(int64_t{a.raw_} - b.raw_, st);
+	}
+
+	static constexpr Q mul(Q a, Q b, status &st)
+	{
+		return narrow(Rounding::shift_right(int64_t{a.raw_} * b.raw_, FracBits), st);
+	}
+
+	static constexpr Q div(Q a, Q b, status &st)
+	{
+		if (b.raw_ == 0) {
+			st = status::div_by_zero;
+			return Q();
+		}
+
+		int64_t num = int64_t{a.raw_} * (int64_t{1} << FracBits);  // |num| < 2^62
+
+		num += ((num >= 0) == (b.raw_ >= 0)) ? b.raw_ / 2 : -(b.raw_ / 2);  // Round half away from zero
+		return narrow(num / b.raw_, st);
+	}
+
+	friend constexpr Q operator+(Q a, Q b) { status st = status::ok; return add(a, b, st); }
+	friend constexpr Q operator-(Q a, Q b) { status st = status::ok; return sub(a, b, st); }
+	friend constexpr Q operator*(Q a, Q b) { status st = status::ok; return mul(a, b, st); }
+	friend constexpr Q operator/(Q a, Q b) { status st = status::ok; return div(a, b, st); }
+	friend constexpr bool operator==(Q a, Q b) { return a.raw_ == b.raw_; }
+	friend constexpr bool operator!=(Q a, Q b) { return a.raw_ != b.raw_; }
+
+private:
+	template <int, int, typename, typename>
+	friend class Q;  // convert() narrows into other formats
+
+	constexpr explicit Q(raw_t raw) : raw_(raw) {}
+
+	static constexpr Q narrow(int64_t v, status &st)
+	{
+		return Q(static_cast<raw_t>(Overflow::template narrow<bits>(v, st)));
+	}
+
+	raw_t raw_;
+};
+
+// Formats used by the calculator engine
+template <typename Overflow = saturate, typename Rounding = round_nearest>
+using q31 = Q<0, 31, Overflow, Rounding>;
+template <typename Overflow = saturate, typename Rounding = round_nearest>
+using q15 = Q<0, 15, Overflow, Rounding>;
+template <typename Overflow = saturate, typename Rounding = round_nearest>
+using q7_24 = Q<7, 24, Overflow, Rounding>;
+template <typename Overflow = saturate, typename Rounding = round_nearest>
+using q16_16 = Q<15, 16, Overflow, Rounding>;  // Sign within the 16 integer bits
+
+// Compile-time checks of the policies
+namespace detail {
+template <typename Fmt>
+constexpr int32_t add_raw(int32_t a, int32_t b)
+{
+	status st = status::ok;
+
+	return Fmt::add(Fmt::from_raw(a), Fmt::from_raw(b), st).raw();
+}
+} // namespace detail
+
+static_assert(detail::add_raw<q15<saturate>>(0x7000, 0x2000) == 0x7FFF, "saturate");
+static_assert(detail::add_raw<q15<wrap>>(0x7000, 0x2000) == -0x7000, "wrap");
+static_assert(detail::add_raw<q15<flush>>(0x7000, 0x2000) == 0, "flush");
+static_assert(q16_16<>::from_float(1.5f).raw() == 0x18000, "from_float");
+
+} // namespace fxp
+
+/**
+ * @}
+ */
+
+#endif /* FIXED_POINT_HPP_ */
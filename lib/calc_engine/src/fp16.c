@@ -0,0 +1,130 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief Half-precision (binary16) conversions
+ */
+
+#include "calc_port.h"
+#include "fp16.h"
+
+// Cortex-M4F (FPv4-SP) implements the half-precision extension: VCVTB converts between
+// the bottom half of an S register and a single-precision value, rounding per FPSCR (RNE).
+#if defined(CONFIG_FPU) && defined(__ARM_FP) && (__ARM_FP & 0x2)
+#define FP16_HW_CONVERT 1
+#endif
+
+typedef union {
+	uint32_t u;
+	float f;
+} fp16_bits;
+
+#define FP16_EXP_MASK  0x7C00
+#define FP16_MAX_FINITE 0x7BFF
+#define FP16_QNAN      0x7E00
+// -------------------------------------------------------------------------------------------------
+
+float fp16_to_float(uint16_t h)
+{
+	fp16_bits v;
+
+#if defined(FP16_HW_CONVERT)
+	float out;
+
+	v.u = h;
+	__asm__ ("vcvtb.f32.f16 %0, %1" : "=t"(out) : "t"(v.f));
+	return out;
+#else
+	uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+	int32_t exp = (h >> 10) & 0x1F;
+	uint32_t mant = h & 0x3FF;
+
+	if (exp == 0) {
+		if (mant == 0) {  // +/- zero
+			v.u = sign;
+			return v.f;
+		}
+		exp = 1;  // Subnormal: normalize so the hidden bit is set
+		while (!(mant & 0x400)) {
+			mant <<= 1;
+			exp--;
+		}
+		mant &= 0x3FF;
+	} else if (exp == 0x1F) {  // Infinity or NaN, keep the payload
+		v.u = sign | 0x7F800000 | (mant << 13);
+		return v.f;
+	}
+	v.u = sign | ((uint32_t)(exp + 112) << 23) | (mant << 13);  // Rebias 15 -> 127
+	return v.f;
+#endif
+}
+// -------------------------------------------------------------------------------------------------
+
+uint16_t fp16_from_float(float f)
+{
+	fp16_bits v = { .f = f };
+
+#if defined(FP16_HW_CONVERT) && defined(CONFIG_CDS_FP16_ROUND_NEAREST_EVEN)
+	__asm__ ("vcvtb.f16.f32 %0, %1" : "=t"(v.f) : "t"(f));
+	return (uint16_t)(v.u & 0xFFFF);
+#else
+	uint16_t sign = (v.u >> 16) & 0x8000;
+	uint32_t abs_bits = v.u & 0x7FFFFFFF;
+
+	if (abs_bits >= 0x7F800000) {  // Infinity or NaN
+		return sign | ((abs_bits > 0x7F800000) ? FP16_QNAN : FP16_EXP_MASK);
+	}
+
+	int32_t exp = (int32_t)(abs_bits >> 23) - 127 + 15;  // Rebias 127 -> 15
+	uint32_t mant = abs_bits & 0x7FFFFF;
+
+	if (abs_bits >= 0x00800000) {
+		mant |= 0x800000;  // Hidden bit of a normal float
+	}
+
+	if (exp >= 0x1F) {  // Beyond the binary16 range
+#if defined(CONFIG_CDS_FP16_ROUND_TOWARD_ZERO)
+		return sign | FP16_MAX_FINITE;
+#elif defined(CONFIG_CDS_FP16_ROUND_UP)
+		return sign ? (sign | FP16_MAX_FINITE) : FP16_EXP_MASK;
+#elif defined(CONFIG_CDS_FP16_ROUND_DOWN)
+		return sign ? (sign | FP16_EXP_MASK) : FP16_MAX_FINITE;
+#else
+		return sign | FP16_EXP_MASK;
+#endif
+	}
+
+	// Normal results drop 13 mantissa bits, subnormals drop more. Beyond 25 bits the whole
+	// mantissa is below half an ULP of the smallest subnormal.
+	uint32_t shift = (exp >= 1) ? 13 : (uint32_t)(13 + 1 - exp);
+
+	if (shift > 25) {
+		shift = 25;
+	}
+
+	uint32_t rem = mant & ((1UL << shift) - 1);
+	uint32_t half_ulp = 1UL << (shift - 1);
+	uint16_t result = (exp >= 1) ? (uint16_t)((exp << 10) | ((mant >> 13) & 0x3FF))
+				     : (uint16_t)(mant >> shift);
+
+	// Magnitudes are ordered like their encodings, so an increment carries into the exponent
+	// (and from the largest finite value into infinity) on its own.
+#if defined(CONFIG_CDS_FP16_ROUND_TOWARD_ZERO)
+	(void)rem;
+	(void)half_ulp;
+#elif defined(CONFIG_CDS_FP16_ROUND_UP)
+	(void)half_ulp;
+	result += (rem != 0 && !sign);
+#elif defined(CONFIG_CDS_FP16_ROUND_DOWN)
+	(void)half_ulp;
+	result += (rem != 0 && sign);
+#else
+	result += (rem > half_ulp || (rem == half_ulp && (result & 1)));
+#endif
+
+	return sign | result;
+#endif
+}
@@ -0,0 +1,51 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+#ifndef FP16_H_
+#define FP16_H_
+
+/**@file
+ * @defgroup fp16 Half-precision (binary16) conversions
+ * @{
+ * @brief Conversions between the binary16 wire format and the float32 engine format.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "calc_port.h"
+
+/** @brief Widen a binary16 value to float32.
+ *
+ * The conversion is exact. Uses VCVTB on cores with the FPv4 half-precision extension.
+ *
+ * @param[in] h binary16 bit pattern.
+ *
+ * @retval float The widened value.
+ */
+float fp16_to_float(uint16_t h);
+
+/** @brief Narrow a float32 value to binary16.
+ *
+ * Rounds according to the CONFIG_CDS_FP16_ROUND_* selection. Out of range values
+ * saturate to infinity or to the largest finite value, as the rounding mode dictates.
+ *
+ * @param[in] f float32 value.
+ *
+ * @retval uint16_t binary16 bit pattern.
+ */
+uint16_t fp16_from_float(float f);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* FP16_H_ */
@@ -0,0 +1,270 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief Host regression tests of the calculator engine library
+ *
+ * Plain asserts, no test framework: each test drives calc_engine_execute() (or the codec) the
+ * way the firmware does and checks the result. Run with ctest, or directly to see which failed.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include "calc_engine.h"
+#include "calc_filter.h"
+#include "calc_vec.h"
+#include "cds_codec.h"
+
+static int failures;
+
+#define CHECK(cond)                                                                             \
+	do {                                                                                    \
+		if (!(cond)) {                                                                  \
+			printf("%s:%d: %s: CHECK(%s) failed\n", __FILE__, __LINE__, __func__, #cond); \
+			failures++;                                                             \
+		}                                                                               \
+	} while (0)
+
+// Float vector buffer 'id' with the values 1, 2, ... count
+static void define_buffer(uint8_t id, uint16_t count)
+{
+	for (uint16_t i = 0; i < count; i++) {
+		float value = i + 1;
+
+		if (i == 0) {
+			CHECK(calc_vec_define(id, FLOAT_MODE, count, 1) == 0);
+		}
+		CHECK(calc_vec_write(id, i * sizeof(value), &value, sizeof(value)) == 0);
+	}
+}
+
+static bool buffer_intact(uint8_t id, uint16_t count)
+{
+	int32_float_union out[16];
+	uint8_t type;
+
+	if (calc_vec_read(id, 0, out, count, &type) != count || type != FLOAT_MODE) {
+		return false;
+	}
+	for (uint16_t i = 0; i < count; i++) {
+		if (out[i].f != i + 1) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void reset_session(void)
+{
+	calc_engine_execute((struct calculator_task){ .operation = CALC_OP_SESSION_RESET });
+}
+
+// CONJ/MAG/PHASE sit between the buffer opcodes, they must not be dispatched as a VEC_CLEAR
+static void test_complex_ops_keep_buffers(void)
+{
+	static const uint8_t ops[] = { CALC_OP_CONJ, CALC_OP_MAG, CALC_OP_PHASE };
+	struct calculator_task task = {
+		.f_operand_1 = 3.0f,
+		.f_operand_1_im = 4.0f,
+		.mode = COMPLEX_FLOAT_MODE,
+	};
+	ReturnValue result;
+
+	reset_session();
+	define_buffer(0, 4);
+	for (size_t i = 0; i < sizeof(ops); i++) {
+		task.operation = ops[i];
+		result = calc_engine_execute(task);
+		CHECK(result.type == FLOAT_TYPE);
+		CHECK(buffer_intact(0, 4));
+	}
+	task.operation = CALC_OP_MAG;
+	result = calc_engine_execute(task);
+	CHECK(result.value.f == 5.0f);
+
+	task.mode = COMPLEX_Q15_MODE;
+	task.q31_operand_1 = 0x10000000;
+	for (size_t i = 0; i < sizeof(ops); i++) {
+		task.operation = ops[i];
+		calc_engine_execute(task);
+		CHECK(buffer_intact(0, 4));
+	}
+	reset_session();
+}
+
+// dst of FILT_CREATE/FILT_RESET is a filter id, CALC_VEC_EMIT must not notify the buffer with that id
+static void test_filter_ops_do_not_emit(void)
+{
+	static const uint8_t ops[] = { CALC_OP_FILT_CREATE, CALC_OP_FILT_RESET };
+	struct calculator_task task = {
+		.q31_operand_1 = (int32_t)(CALC_VEC_EMIT | CALC_VEC_DESC(0, 1, CALC_FILTER_FIR)),
+		.mode = FLOAT_MODE,
+	};
+	ReturnValue result;
+
+	reset_session();
+	define_buffer(0, 4);
+	define_buffer(1, 3);  // FIR coefficients of filter 0
+	for (size_t i = 0; i < sizeof(ops); i++) {
+		task.operation = ops[i];
+		result = calc_engine_execute(task);
+		CHECK(result.type == INT32_TYPE && result.value.u == 0);
+		CHECK(buffer_intact(0, 4));
+	}
+	reset_session();
+}
+
+// A divisor the float mode accepts, |b| above EPSILON, is accepted in COMPLEX_FLOAT_MODE too
+static void test_complex_div_small_divisor(void)
+{
+	struct calculator_task task = {
+		.operation = CALC_OP_DIV,
+		.f_operand_1 = 1.0f,
+		.f_operand_2 = 1e-6f,
+		.mode = FLOAT_MODE,
+	};
+	ReturnValue result;
+
+	result = calc_engine_execute(task);
+	CHECK(result.type == FLOAT_TYPE && result.value.f > 9.9e5f && result.value.f < 1.01e6f);
+
+	task.mode = COMPLEX_FLOAT_MODE;
+	result = calc_engine_execute(task);  // Imaginary part, the real one is emitted first
+	CHECK(result.type == FLOAT_TYPE && result.value.f == 0.0f);
+	task.operation = CALC_OP_MAG;
+	task.flags = CDS_TASK_FLAG_ACC;
+	result = calc_engine_execute(task);
+	CHECK(result.value.f > 9.9e5f && result.value.f < 1.01e6f);
+}
+
+// A delta operand is at most 32 bits: the fifth varint byte carries bits 28..31 only
+static void test_codec_varint_overflow(void)
+{
+	uint8_t frame[] = {
+		CDS_CODEC_V1, (FIXED_MODE << CDS_WIRE_MODE_SHIFT) | CDS_WIRE_F_DELTA | CALC_OP_ADD,
+		0xFF, 0xFF, 0xFF, 0xFF, 0x0F,  // Operand 1: zigzag 0xFFFFFFFF, INT32_MIN
+		0x02,                          // Operand 2: 1
+	};
+	struct calculator_task tasks[1];
+
+	CHECK(cds_codec_decode(frame, sizeof(frame), tasks, 1) == 1);
+	CHECK(tasks[0].q31_operand_1 == INT32_MIN && tasks[0].q31_operand_2 == 1);
+
+	frame[6] = 0x10;
+	CHECK(cds_codec_decode(frame, sizeof(frame), tasks, 1) == -EINVAL);
+	frame[6] = 0x8F;  // Sixth byte announced
+	CHECK(cds_codec_decode(frame, sizeof(frame), tasks, 1) == -EINVAL);
+}
+
+// Extension opcodes in each wire format, 0x81 (CDS_CODEC_V1) starts a version 1 frame instead
+static void test_codec_ext_opcodes(void)
+{
+	static const uint8_t opcodes[] = { CALC_OP_EXT_BASE, CDS_CODEC_V1 + 1, 0xFF };
+	struct calculator_task tasks[2];
+
+	for (size_t i = 0; i < sizeof(opcodes); i++) {
+		struct calculator_task_legacy legacy = {
+			.operation = opcodes[i],
+			.q31_operand_1 = 5,
+			.q31_operand_2 = 7,
+			.mode = FIXED_MODE,
+		};
+		struct calculator_task_f16 f16 = {
+			.operation = opcodes[i],
+			.h_operand_1 = 0x3C00,  // 1.0
+			.h_operand_2 = 0x4000,  // 2.0
+			.mode = HALF_MODE,
+		};
+		const uint8_t v1[] = {
+			CDS_CODEC_V1, (FIXED_MODE << CDS_WIRE_MODE_SHIFT) | CDS_WIRE_OP_EXT, opcodes[i],
+			5, 0, 0, 0, 7, 0, 0, 0,
+		};
+
+		CHECK(cds_codec_decode((const uint8_t *)&legacy, sizeof(legacy), tasks, 2) == 1);
+		CHECK(tasks[0].operation == opcodes[i] && tasks[0].mode == FIXED_MODE);
+		CHECK(tasks[0].q31_operand_1 == 5 && tasks[0].q31_operand_2 == 7);
+
+		CHECK(cds_codec_decode((const uint8_t *)&f16, sizeof(f16), tasks, 2) == 1);
+		CHECK(tasks[0].operation == opcodes[i] && tasks[0].mode == HALF_MODE);
+		CHECK(tasks[0].f_operand_1 == 1.0f && tasks[0].f_operand_2 == 2.0f);
+
+		CHECK(cds_codec_decode(v1, sizeof(v1), tasks, 2) == 1);
+		CHECK(tasks[0].operation == opcodes[i]);
+		CHECK(tasks[0].q31_operand_1 == 5 && tasks[0].q31_operand_2 == 7);
+	}
+
+	// Reserved: the version 1 marker, a legacy task with opcode 0x81 is not read as one
+	struct calculator_task_legacy legacy = {
+		.operation = CDS_CODEC_V1,
+		.q31_operand_1 = 5,
+		.q31_operand_2 = 7,
+		.mode = FIXED_MODE,
+	};
+	int count = cds_codec_decode((const uint8_t *)&legacy, sizeof(legacy), tasks, 2);
+
+	CHECK(count <= 0 || tasks[0].operation != CDS_CODEC_V1);
+}
+
+// rows * cols elements overflow the size in bytes on 32-bit targets, the buffer must not be defined
+static void test_vec_define_too_large(void)
+{
+	uint8_t type;
+	int32_float_union out;
+	float value = 1.0f;
+
+	reset_session();
+	CHECK(calc_vec_define(0, FLOAT_MODE, 0x8000, 0x8000) == -ENOMEM);
+	CHECK(calc_vec_read(0, 0, &out, 1, &type) == -EINVAL);
+	CHECK(calc_vec_define(0, FLOAT_MODE, 0xFFFF, 0xFFFF) == -ENOMEM);
+
+	define_buffer(0, 4);
+	CHECK(calc_vec_write(0, SIZE_MAX - 1, &value, sizeof(value)) == -EINVAL);
+	CHECK(buffer_intact(0, 4));
+	reset_session();
+}
+
+// Modes the codec rejects still reach calc_engine_execute() from host simulators and fuzzers
+static void test_invalid_q_mode(void)
+{
+	static const uint8_t modes[] = { 8, 0x0F, FIXED_MODE | 0x30, Q15_MODE | CDS_MODE_SAT | CDS_MODE_WRAP };
+	struct calculator_task task = { .operation = CALC_OP_ADD, .q31_operand_1 = 1, .q31_operand_2 = 2 };
+	ReturnValue result;
+
+	for (size_t i = 0; i < sizeof(modes); i++) {
+		task.mode = modes[i];
+		result = calc_engine_execute(task);
+		CHECK(result.type == INT32_TYPE && result.value.u == -EINVAL);
+	}
+
+	task.mode = FIXED_MODE;
+	calc_engine_execute(task);  // Accumulator 3
+	task.mode = 8;
+	calc_engine_execute(task);
+	task.mode = FIXED_MODE;
+	task.flags = CDS_TASK_FLAG_ACC;
+	result = calc_engine_execute(task);
+	CHECK(result.value.u == 5);
+}
+
+int main(void)
+{
+	test_complex_ops_keep_buffers();
+	test_filter_ops_do_not_emit();
+	test_complex_div_small_divisor();
+	test_codec_varint_overflow();
+	test_vec_define_too_large();
+	test_codec_ext_opcodes();
+	test_invalid_q_mode();
+
+	if (failures) {
+		printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+	printf("All tests passed\n");
+	return 0;
+}
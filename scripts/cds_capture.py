@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+#
+# Rafal Szymura
+# June 2024
+# BLE Calculator Application
+#
+
+"""Build a replay capture from the cds_record console output of the calculator firmware.
+
+Reads "RC <delta_us> <lost> <hex>" lines (flash recorder dump) and calc_trace FRAME/FRAME_DATA
+records ("TR ..."), writes the capture replayed by the benchmark application (bench/):
+records of [delta_us le32][length le16][frames lost le16] followed by the frame.
+"""
+
+import argparse
+import struct
+import sys
+
+# Keep in sync with src/calc_trace.h and src/cds_record.h
+TRACE_FRAME = 6
+TRACE_FRAME_DATA = 7
+TRACE_CHUNK = 6
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("log", nargs="?", type=argparse.FileType("r"), default=sys.stdin)
+    parser.add_argument("-o", "--output", required=True, help="capture file to write")
+    args = parser.parse_args()
+
+    frames = []
+    partial = None  # [delta_us, lost, length, bytearray] of the trace frame being assembled
+    broken = 0
+    for line in args.log:
+        fields = line.split()
+        if len(fields) >= 3 and fields[0] == "RC" and fields[1] not in ("END", "ERR"):
+            data = bytes.fromhex(fields[3]) if len(fields) > 3 else b""
+            frames.append((int(fields[1]), int(fields[2]), data))
+            continue
+        if len(fields) < 7 or fields[0] != "TR" or fields[1] in ("HZ", "LOST"):
+            if len(fields) >= 2 and fields[0] == "TR" and fields[1] == "LOST" and partial:
+                partial = None  # Records of the frame may be gone
+                broken += 1
+            continue
+        _, _, eid, a, b, c = (int(f, 16) for f in fields[1:7])
+        if eid == TRACE_FRAME:
+            if partial:
+                broken += 1
+            partial = [c, a, b, bytearray()]
+        elif eid == TRACE_FRAME_DATA and partial:
+            if a != (len(partial[3]) // TRACE_CHUNK) & 0xFF:
+                partial = None
+                broken += 1
+                continue
+            partial[3] += struct.pack("<HI", b, c)
+        else:
+            continue
+        if partial and len(partial[3]) >= partial[2]:
+            frames.append((partial[0], partial[1], bytes(partial[3][:partial[2]])))
+            partial = None
+
+    with open(args.output, "wb") as out:
+        for delta_us, lost, data in frames:
+            out.write(struct.pack("<IHH", delta_us, len(data), min(lost, 0xFFFF)) + data)
+
+    print("%d frames, %d bytes, %d incomplete frames skipped" %
+          (len(frames), sum(len(f[2]) for f in frames), broken), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+#
+# Rafal Szymura
+# June 2024
+# BLE Calculator Application
+#
+
+"""Decode the calc_trace console lines ("TR ...") of the calculator firmware."""
+
+import argparse
+import struct
+import sys
+
+# Keep in sync with src/calc_trace.h and src/my_cds.h
+EVENTS = {
+    1: "NOTIFY",
+    2: "RESULT",
+    3: "DIV_ZERO",
+    4: "OVERFLOW",
+    5: "OP_ERROR",
+    6: "FRAME",
+    7: "FRAME_DATA",
+}
+TYPES = {0: "INT32", 1: "FLOAT", 2: "HALF", 3: "INT16", 4: "NONE"}
+
+
+def s32(value):
+    return value - (1 << 32) if value & 0x80000000 else value
+
+
+def fmt_value(rtype, value):
+    if rtype == 1:
+        return "%g" % struct.unpack("<f", struct.pack("<I", value))[0]
+    if rtype == 3:
+        return str(value - (1 << 16) if value & 0x8000 else value & 0xFFFF)
+    return str(s32(value))
+
+
+def fmt_event(eid, a, b, c):
+    if eid == 1:
+        return "results=%d type=%s err=%d" % (a, TYPES.get(b, b), s32(c))
+    if eid == 2:
+        return "type=%s value=%s" % (TYPES.get(a, a), fmt_value(a, c))
+    if eid in (3, 4):
+        return "mode=%d op=%d" % (a, b)
+    if eid == 5:
+        return "mode=%d op=%d err=%d" % (a, b, s32(c))
+    if eid == 6:
+        return "len=%d delta=%d us lost=%d" % (b, c, a)
+    if eid == 7:
+        return "chunk=%d %s" % (a, (struct.pack("<H", b) + struct.pack("<I", c)).hex())
+    return "a=%d b=%d c=0x%08x" % (a, b, c)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("log", nargs="?", type=argparse.FileType("r"), default=sys.stdin)
+    parser.add_argument("--hz", type=int, default=0, help="cycle rate, overrides the TR HZ line")
+    args = parser.parse_args()
+
+    hz = args.hz
+    first_ts = None
+    prev_ts = 0
+    wraps = 0
+    for line in args.log:
+        fields = line.split()
+        if len(fields) < 2 or fields[0] != "TR":
+            continue
+        if fields[1] == "HZ":
+            hz = hz or int(fields[2])
+            continue
+        if fields[1] == "LOST":
+            print("-- %s records lost" % fields[2])
+            continue
+        seq, ts, eid, a, b, c = (int(f, 16) for f in fields[1:7])
+        if ts < prev_ts:
+            wraps += 1  # 32-bit cycle counter wrapped
+        prev_ts = ts
+        ts += wraps << 32
+        if first_ts is None:
+            first_ts = ts
+        when = "%12.3f us" % ((ts - first_ts) * 1e6 / hz) if hz else "%12d cyc" % (ts - first_ts)
+        print("%8d %s %-8s %s" % (seq, when, EVENTS.get(eid, "EVT%d" % eid), fmt_event(eid, a, b, c)))
+
+
+if __name__ == "__main__":
+    main()
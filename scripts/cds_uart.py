@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+#
+# Rafal Szymura
+# June 2024
+# BLE Calculator Application
+#
+
+"""Load the calculator firmware over the binary UART transport (src/calc_uart.h).
+
+Sends FP16 batch frames (HALF_MODE additions) with up to --window frames in flight and prints
+UART,<key>,<value> lines: tasks sent, results received, frames rejected (NAK) and the sustained
+ops_per_s. Needs pyserial. On native_sim pass the pty printed at boot for the calc,uart UART.
+"""
+
+import argparse
+import struct
+import sys
+import time
+
+import serial
+
+# Keep in sync with src/calc_uart.h
+UART_TASKS = 0x01
+UART_RESULTS = 0x81
+UART_NAK = 0x82
+HALF_MODE = 2
+CALC_OP_ADD = 1
+
+
+def crc16_kermit(data):
+    crc = 0
+    for byte in data:
+        e = (crc ^ byte) & 0xFF
+        f = (e ^ (e << 4)) & 0xFF
+        crc = ((crc >> 8) ^ (f << 8) ^ (f << 3) ^ (f >> 4)) & 0xFFFF
+    return crc
+
+
+def cobs_encode(data):
+    out = bytearray([0])
+    code_pos = 0
+    for byte in data:
+        if byte:
+            out.append(byte)
+        if not byte or len(out) - code_pos == 0xFF:
+            out[code_pos] = len(out) - code_pos
+            code_pos = len(out)
+            out.append(0)
+    out[code_pos] = len(out) - code_pos
+    return bytes(out)
+
+
+def cobs_decode(data):
+    out = bytearray()
+    pos = 0
+    while pos < len(data):
+        code = data[pos]
+        if code == 0 or pos + code > len(data):
+            return None
+        out += data[pos + 1:pos + code]
+        pos += code
+        if code != 0xFF and pos < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def frame(payload):
+    return cobs_encode(payload + struct.pack("<H", crc16_kermit(payload))) + b"\x00"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("port")
+    parser.add_argument("--baud", type=int, default=1000000)
+    parser.add_argument("--tasks", type=int, default=10000)
+    parser.add_argument("--batch", type=int, default=32, help="tasks per frame")
+    parser.add_argument("--window", type=int, default=4, help="frames in flight")
+    args = parser.parse_args()
+
+    one = struct.pack("<BHHB", CALC_OP_ADD, 0x3C00, 0x4000, HALF_MODE)  # 1.0 + 2.0
+    link = serial.Serial(args.port, args.baud, timeout=0.1)
+    sent = received = naks = bad = seq = 0
+    rx = bytearray()
+    start = time.monotonic()
+    last_rx = start
+    while received + naks * args.batch < args.tasks and time.monotonic() - last_rx < 2.0:
+        in_flight = sent - received - naks * args.batch
+        if sent < args.tasks and in_flight < args.window * args.batch:
+            count = min(args.batch, args.tasks - sent)
+            link.write(frame(bytes([UART_TASKS, seq & 0xFF]) + one * count))
+            sent += count
+            seq += 1
+            continue
+        rx += link.read(max(1, link.in_waiting))
+        while b"\x00" in rx:
+            raw, _, rx = rx.partition(b"\x00")
+            data = cobs_decode(raw)
+            if not data or len(data) < 4 or crc16_kermit(data[:-2]) != struct.unpack("<H", data[-2:])[0]:
+                bad += 1
+                continue
+            last_rx = time.monotonic()
+            if data[0] == UART_RESULTS:
+                received += (len(data) - 4) // 2  # [type][seq] ... [crc]
+            elif data[0] == UART_NAK:
+                naks += 1
+    elapsed = time.monotonic() - start
+
+    for key, value in (("tasks_sent", sent), ("results", received), ("frames_nak", naks),
+                       ("frames_bad", bad), ("ops_per_s", int(received / elapsed))):
+        print(f"UART,{key},{value}")
+    return 0 if received + naks * args.batch >= args.tasks else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,211 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief On-device self-benchmark
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <errno.h>
+#include <string.h>
+#include "calc_bench.h"
+#include "calc_q.h"
+#include "calc_io.h"
+#include "my_cds.h"
+#if defined(CONFIG_CDS_BENCH_DWT)
+#include <cmsis_core.h>
+#endif
+
+static struct calculator_task tasks[CALC_BENCH_BATCH_MAX];  // Engine thread only
+static struct calc_bench_spec bench_spec;  // Written while bench_busy is clear
+static struct calc_bench_result bench_results[CALC_BENCH_OPS_MAX];
+static uint8_t bench_origin;
+static atomic_t bench_busy;  // Spec queued, running or being reported
+static void bench_report(struct k_work *work);
+static K_WORK_DEFINE(bench_work, bench_report);
+// -------------------------------------------------------------------------------------------------
+
+#if defined(CONFIG_CDS_BENCH_DWT)
+static inline uint32_t bench_cycles(void)
+{
+	return DWT->CYCCNT;
+}
+
+static uint32_t bench_hz(void)
+{
+	return SystemCoreClock;
+}
+
+static void bench_timer_init(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+#else
+static inline uint32_t bench_cycles(void)
+{
+	return k_cycle_get_32();
+}
+
+static uint32_t bench_hz(void)
+{
+	return sys_clock_hw_cycles_per_sec();
+}
+
+static void bench_timer_init(void)
+{
+}
+#endif
+
+static bool bench_mode_valid(uint8_t mode)
+{
+	return mode == FLOAT_MODE || mode == HALF_MODE || mode == COMPLEX_Q15_MODE ||
+	       mode == COMPLEX_FLOAT_MODE || calc_q_mode_valid(mode);
+}
+
+static bool bench_op_valid(uint8_t op)
+{
+	return op <= CALC_OP_DIV || op >= CALC_OP_EXT_BASE;
+}
+
+// Non-trivial operands of a mode, varied per task so results are not constant
+static void bench_operands(struct calculator_task *task, uint32_t i)
+{
+	uint8_t format = task->mode & CDS_MODE_FORMAT_MASK;
+
+	if (task->mode == FLOAT_MODE || task->mode == HALF_MODE || task->mode == COMPLEX_FLOAT_MODE) {
+		task->f_operand_1 = 1.5f + (float)(i & 0xFF);
+		task->f_operand_2 = 0.75f + (float)(i & 0x0F);
+		task->f_operand_1_im = -0.5f;
+		task->f_operand_2_im = 0.25f;
+	} else if (format == Q15_MODE) {
+		task->q31_operand_1 = 0x2000 + (i & 0xFF);
+		task->q31_operand_2 = 0x1000 - (i & 0x0F);
+	} else if (format == COMPLEX_Q15_MODE) {
+		task->q31_operand_1 = 0x10002000 + (i & 0xFF);
+		task->q31_operand_2 = 0x08001000 - (i & 0x0F);
+	} else {
+		task->q31_operand_1 = 0x20000000 + (int32_t)(i * 37);
+		task->q31_operand_2 = 0x10000000 - (int32_t)(i * 11);
+	}
+}
+// -------------------------------------------------------------------------------------------------
+
+// Check and decode a spec
+static int bench_parse(const uint8_t *buf, uint16_t len, struct calc_bench_spec *spec)
+{
+	if (len <= CALC_BENCH_SPEC_HDR_LEN || len > CALC_BENCH_SPEC_HDR_LEN + CALC_BENCH_OPS_MAX) {
+		return -EINVAL;
+	}
+	spec->mode = buf[0];
+	spec->batch = buf[1];
+	spec->iterations = sys_get_le16(&buf[2]);
+	spec->op_count = len - CALC_BENCH_SPEC_HDR_LEN;
+	memcpy(spec->ops, &buf[CALC_BENCH_SPEC_HDR_LEN], spec->op_count);
+
+	if (!bench_mode_valid(spec->mode) || spec->batch == 0 || spec->batch > CALC_BENCH_BATCH_MAX ||
+	    spec->iterations == 0) {
+		return -EINVAL;
+	}
+	for (uint8_t i = 0; i < spec->op_count; i++) {
+		if (!bench_op_valid(spec->ops[i])) {
+			return -EINVAL;
+		}
+	}
+	return 0;
+}
+
+// Time one opcode of a spec, cycles per round of spec->batch tasks
+static void bench_run(const struct calc_bench_spec *spec, uint8_t op, struct calc_bench_result *result)
+{
+	uint64_t total = 0;
+
+	bench_timer_init();
+	for (uint8_t i = 0; i < spec->batch; i++) {
+		tasks[i] = (struct calculator_task){
+			.operation = op,
+			.mode = spec->mode,
+			.flags = CDS_TASK_FLAG_WORKLOAD | ((spec->batch > 1) ? CDS_TASK_FLAG_BATCH : 0),
+		};
+		bench_operands(&tasks[i], i);
+	}
+
+	result->min = UINT32_MAX;
+	result->max = 0;
+	for (uint16_t n = 0; n < spec->iterations; n++) {
+		uint32_t start = bench_cycles();
+
+		for (uint8_t i = 0; i < spec->batch; i++) {
+			my_cds_calculate_result(tasks[i]);  // The engine thread dispatch
+		}
+
+		uint32_t cycles = bench_cycles() - start;
+
+		result->min = MIN(result->min, cycles);
+		result->max = MAX(result->max, cycles);
+		total += cycles;
+	}
+	result->avg = (uint32_t)(total / spec->iterations);
+}
+
+// Record of one opcode, CALC_BENCH_RESULT_LEN bytes
+static void bench_encode(const struct calc_bench_spec *spec, uint8_t op,
+			 const struct calc_bench_result *result, uint8_t *buf)
+{
+	buf[0] = op;
+	buf[1] = spec->mode;
+	buf[2] = spec->batch;
+	buf[3] = IS_ENABLED(CONFIG_CDS_BENCH_DWT) ? CALC_BENCH_TIMER_DWT : CALC_BENCH_TIMER_KERNEL;
+	sys_put_le32(result->min, &buf[4]);
+	sys_put_le32(result->avg, &buf[8]);
+	sys_put_le32(result->max, &buf[12]);
+	sys_put_le32(bench_hz(), &buf[16]);
+}
+
+// One record per benchmarked opcode (system workqueue)
+static void bench_report(struct k_work *work)
+{
+	uint8_t value[CALC_BENCH_RESULT_LEN];
+
+	for (uint8_t i = 0; i < bench_spec.op_count; i++) {
+		bench_encode(&bench_spec, bench_spec.ops[i], &bench_results[i], value);
+		calc_io_bench(bench_origin, value, sizeof(value));
+	}
+	atomic_clear(&bench_busy);
+}
+// -------------------------------------------------------------------------------------------------
+
+int calc_bench_request(const uint8_t *buf, uint16_t len, uint8_t origin)
+{
+	struct calculator_task task = { .flags = CDS_TASK_FLAG_BENCH };
+	struct calc_bench_spec spec;
+	int err;
+
+	if (bench_parse(buf, len, &spec)) {
+		return -EINVAL;
+	}
+	if (!atomic_cas(&bench_busy, 0, 1)) {
+		return -EBUSY;
+	}
+	bench_spec = spec;
+	bench_origin = origin;
+
+	err = calc_io_submit(&task, 1, origin, K_NO_WAIT);
+	if (err) {
+		atomic_clear(&bench_busy);
+	}
+	return err;
+}
+
+void calc_bench_execute(void)
+{
+	for (uint8_t i = 0; i < bench_spec.op_count; i++) {
+		bench_run(&bench_spec, bench_spec.ops[i], &bench_results[i]);
+	}
+	k_work_submit(&bench_work);
+}
@@ -0,0 +1,84 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+#ifndef CALC_BENCH_H_
+#define CALC_BENCH_H_
+
+/**@file
+ * @defgroup calc_bench On-device self-benchmark
+ * @{
+ * @brief Synthetic workloads run by the engine thread, requested over the CDS bench characteristic
+ *        or the calc shell command.
+ *
+ * A spec, [mode][batch][iterations le16][opcode...], is queued as a CDS_TASK_FLAG_BENCH task.
+ * When the engine thread takes it, each opcode runs for 'iterations' rounds of 'batch' tasks
+ * through my_cds_calculate_result(), with operands varied per task. Every round is timed with
+ * the DWT cycle counter (CONFIG_CDS_BENCH_DWT) or k_cycle_get_32(). One CALC_BENCH_RESULT_LEN
+ * record per opcode then goes to the bench sink of the requesting transport (calc_io.h):
+ *
+ *       [opcode][mode][batch][timer][min le32][avg le32][max le32][timer hz le32]
+ *
+ * with the min/avg/max cycles of a round. Results of the workload are not notified and the
+ * previous result (CDS_TASK_FLAG_ACC) of the session is kept. One spec runs at a time.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+
+#define CALC_BENCH_OPS_MAX 8
+#define CALC_BENCH_BATCH_MAX 64
+#define CALC_BENCH_SPEC_HDR_LEN 4  // Followed by 1 to CALC_BENCH_OPS_MAX opcodes
+#define CALC_BENCH_RESULT_LEN 20
+
+#define CALC_BENCH_TIMER_KERNEL 0  // k_cycle_get_32()
+#define CALC_BENCH_TIMER_DWT    1  // DWT CYCCNT, CPU clock cycles
+
+struct calc_bench_spec {
+	uint8_t mode;
+	uint8_t batch;
+	uint16_t iterations;
+	uint8_t op_count;
+	uint8_t ops[CALC_BENCH_OPS_MAX];
+};
+
+struct calc_bench_result {
+	uint32_t min;
+	uint32_t avg;
+	uint32_t max;
+};
+
+/** @brief Queue a benchmark spec behind the tasks already queued.
+ *
+ * Scalar arithmetic (CALC_OP_RESET to CALC_OP_DIV) and extension opcodes are accepted, in any
+ * mode the operation characteristic accepts.
+ *
+ * @param[in] buf Spec.
+ * @param[in] len Length of the spec.
+ * @param[in] origin CALC_IO_* origin the records are passed to.
+ *
+ * @retval 0 If the operation was successful.
+ * @retval -EINVAL Incorrect spec.
+ * @retval -EBUSY A benchmark is queued, running or being reported.
+ * @retval -ENOMEM The task queue is full.
+ */
+int calc_bench_request(const uint8_t *buf, uint16_t len, uint8_t origin);
+
+/** @brief Run the queued spec and schedule its records (engine thread). */
+void calc_bench_execute(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* CALC_BENCH_H_ */
@@ -0,0 +1,159 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief Loadable operation kernels
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/llext/llext.h>
+#include <zephyr/llext/buf_loader.h>
+#include <zephyr/llext/symbol.h>
+#include <errno.h>
+#include <string.h>
+#include "calc_ext.h"
+#include "calc_q.h"
+#include "cds_codec.h"
+#include "calc_vec.h"
+#include "fp16.h"
+
+#define EXT_OPS (256 - CALC_OP_EXT_BASE)
+
+struct calc_ext_op {
+	struct llext *ext;
+	calc_ext_fn fn;
+};
+
+// ELF being uploaded (BT RX thread only)
+static uint8_t elf[CONFIG_CDS_EXT_MAX_SIZE] __aligned(4);
+static uint32_t elf_size;
+static uint32_t elf_end;  // Highest byte written
+static uint8_t elf_opcode;
+
+// Dispatch table, written by the BT RX thread and read by the engine thread
+static struct calc_ext_op ops[EXT_OPS];
+static K_MUTEX_DEFINE(ops_lock);
+
+// Engine API the extensions are linked against
+EXPORT_SYMBOL(calc_q_mode_valid);
+EXPORT_SYMBOL(calc_q_execute);
+EXPORT_SYMBOL(fp16_to_float);
+EXPORT_SYMBOL(fp16_from_float);
+EXPORT_SYMBOL(calc_vec_read);
+EXPORT_SYMBOL(calc_vec_write);
+EXPORT_SYMBOL(calc_vec_define);
+EXPORT_SYMBOL(calc_vec_shape);
+// -------------------------------------------------------------------------------------------------
+
+int calc_ext_begin(uint8_t opcode, uint32_t size)
+{
+	if (opcode < CALC_OP_EXT_BASE || size == 0) {
+		return -EINVAL;
+	}
+	if (opcode == CDS_CODEC_V1) {
+		return -EINVAL;  // Legacy and FP16 frames starting with it decode as version 1
+	}
+	if (size > sizeof(elf)) {
+		return -ENOMEM;
+	}
+	elf_opcode = opcode;
+	elf_size = size;
+	elf_end = 0;
+	return 0;
+}
+
+int calc_ext_data(uint32_t offset, const void *data, size_t len)
+{
+	if (elf_opcode == 0 || offset > elf_size || len > elf_size - offset) {
+		return -EINVAL;
+	}
+	memcpy(&elf[offset], data, len);
+	elf_end = MAX(elf_end, offset + len);
+	return 0;
+}
+
+// Unregister an opcode, the extension is unloaded once the engine is not running it
+static void ext_release(uint8_t opcode)
+{
+	struct calc_ext_op *op = &ops[opcode - CALC_OP_EXT_BASE];
+	struct llext *ext;
+
+	k_mutex_lock(&ops_lock, K_FOREVER);
+	ext = op->ext;
+	op->ext = NULL;
+	op->fn = NULL;
+	k_mutex_unlock(&ops_lock);
+
+	if (ext) {
+		llext_unload(&ext);
+	}
+}
+
+int calc_ext_load(void)
+{
+	struct llext_buf_loader buf_loader = LLEXT_BUF_LOADER(elf, elf_size);
+	struct llext_load_param param = LLEXT_LOAD_PARAM_DEFAULT;
+	struct llext *ext = NULL;
+	char name[LLEXT_MAX_NAME_LEN + 1];
+	calc_ext_fn fn;
+	uint8_t opcode = elf_opcode;
+	int err;
+
+	if (opcode == 0 || elf_end != elf_size) {
+		return -EINVAL;
+	}
+	elf_opcode = 0;  // The upload is consumed, successful or not
+
+	// llext_load() returns an already loaded extension of the same name, release it first
+	ext_release(opcode);
+
+	snprintk(name, sizeof(name), "cds_op_%02x", opcode);
+	err = llext_load(&buf_loader.loader, name, &ext, &param);
+	if (err) {
+		return err;
+	}
+
+	fn = (calc_ext_fn)llext_find_sym(&ext->exp_tab, CALC_EXT_ENTRY);
+	if (!fn) {
+		llext_unload(&ext);
+		return -ENOENT;
+	}
+
+	k_mutex_lock(&ops_lock, K_FOREVER);
+	ops[opcode - CALC_OP_EXT_BASE].ext = ext;
+	ops[opcode - CALC_OP_EXT_BASE].fn = fn;
+	k_mutex_unlock(&ops_lock);
+	return 0;
+}
+
+int calc_ext_unload(uint8_t opcode)
+{
+	if (opcode < CALC_OP_EXT_BASE || !ops[opcode - CALC_OP_EXT_BASE].ext) {
+		return -ENOENT;
+	}
+	ext_release(opcode);
+	return 0;
+}
+
+int calc_ext_execute(const struct calculator_task *task, int32_float_union *result)
+{
+	struct calc_ext_op *op;
+	int ret = -ENOENT;
+
+	if (task->operation < CALC_OP_EXT_BASE) {
+		return -ENOENT;
+	}
+	op = &ops[task->operation - CALC_OP_EXT_BASE];
+
+	k_mutex_lock(&ops_lock, K_FOREVER);  // Held across the call, unload waits for it
+	if (op->fn) {
+		ret = op->fn(task, result);
+	}
+	k_mutex_unlock(&ops_lock);
+	return ret;
+}
@@ -0,0 +1,97 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+#ifndef CALC_EXT_H_
+#define CALC_EXT_H_
+
+/**@file
+ * @defgroup calc_ext Loadable operation kernels
+ * @{
+ * @brief Operations loaded at runtime as LLEXT modules over the CDS extension characteristic.
+ *
+ * An extension is a relocatable ELF exporting CALC_EXT_ENTRY (LL_EXTENSION_SYMBOL) with the
+ * calc_ext_fn signature. It is linked against the engine API exported with EXPORT_SYMBOL
+ * (calc_q_mode_valid, calc_q_execute, fp16 conversion and the calc_vec buffer access) and
+ * registered for one opcode from CALC_OP_EXT_BASE up, except CDS_CODEC_V1 (0x81): a legacy or
+ * FP16 frame starting with it would be decoded as a version 1 frame. Tasks with that opcode call it directly
+ * from the engine thread, loading another ELF for the same opcode replaces the previous one.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+#include "my_cds.h"
+
+// Extension characteristic records
+#define CALC_EXT_BEGIN  0  // [0][opcode][ELF size le32]
+#define CALC_EXT_DATA   1  // [1][byte offset le32][ELF bytes...]
+#define CALC_EXT_LOAD   2  // [2]
+#define CALC_EXT_UNLOAD 3  // [3][opcode]
+
+#define CALC_EXT_BEGIN_LEN 6
+#define CALC_EXT_DATA_HDR_LEN 5
+
+#define CALC_EXT_ENTRY "calc_ext_op"
+
+/** @brief Extension entry point.
+ *
+ * @param[in] task Task with an extension opcode, operands in the task mode.
+ * @param[out] result Result value.
+ *
+ * @retval ReturnType of the result. Otherwise, a negative error code.
+ */
+typedef int (*calc_ext_fn)(const struct calculator_task *task, int32_float_union *result);
+
+/** @brief Start the upload of an extension ELF.
+ *
+ * @param[in] opcode Opcode to register, CALC_OP_EXT_BASE or above, not CDS_CODEC_V1.
+ * @param[in] size ELF size, up to CONFIG_CDS_EXT_MAX_SIZE.
+ *
+ * @retval 0 If the operation was successful. Otherwise, -EINVAL or -ENOMEM.
+ */
+int calc_ext_begin(uint8_t opcode, uint32_t size);
+
+/** @brief Store a chunk of the ELF being uploaded.
+ *
+ * @retval 0 If the operation was successful. -EINVAL outside the announced size.
+ */
+int calc_ext_data(uint32_t offset, const void *data, size_t len);
+
+/** @brief Link the uploaded ELF and register its entry point.
+ *
+ * @retval 0 If the operation was successful. -EINVAL if no complete ELF was uploaded,
+ *         -ENOENT if it does not export CALC_EXT_ENTRY, or the llext_load() error.
+ */
+int calc_ext_load(void);
+
+/** @brief Unregister and unload the extension of an opcode.
+ *
+ * @retval 0 If the operation was successful. Otherwise, -ENOENT.
+ */
+int calc_ext_unload(uint8_t opcode);
+
+/** @brief Run the extension registered for the task opcode (engine thread).
+ *
+ * @param[in] task Task with an extension opcode.
+ * @param[out] result Result value.
+ *
+ * @retval ReturnType of the result. -ENOENT if no extension is registered, or the extension
+ *         error.
+ */
+int calc_ext_execute(const struct calculator_task *task, int32_float_union *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* CALC_EXT_H_ */
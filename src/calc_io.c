@@ -0,0 +1,93 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief Task ingress and result egress of the transports
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <errno.h>
+#include "calc_io.h"
+#include "cds_stats.h"
+#include "cds_tracing.h"
+
+extern struct k_msgq calculator_msgq;
+
+static const struct calc_io_sink *sinks[CALC_IO_ORIGINS];  // Registered at init
+static struct k_spinlock submit_lock;  // Room check and puts of a frame, against the job timers
+// -------------------------------------------------------------------------------------------------
+
+void calc_io_register(uint8_t origin, const struct calc_io_sink *sink)
+{
+	if (origin < CALC_IO_ORIGINS) {
+		sinks[origin] = sink;
+	}
+}
+
+static void submit_stamp(struct calculator_task *task, uint8_t origin)
+{
+	task->origin = origin;
+#if defined(CONFIG_CDS_LATENCY)
+	task->t_rx = k_cycle_get_32();
+#endif
+}
+
+int calc_io_submit(struct calculator_task *tasks, size_t count, uint8_t origin, k_timeout_t timeout)
+{
+	size_t queued = 0;
+
+	if (K_TIMEOUT_EQ(timeout, K_NO_WAIT)) {
+		// Accept the whole frame or nothing: no other non-blocking submitter (a job timer, another
+		// transport) takes the room between the check and the puts
+		k_spinlock_key_t key = k_spin_lock(&submit_lock);
+
+		if (k_msgq_num_free_get(&calculator_msgq) >= count) {
+			for (; queued < count; queued++) {
+				submit_stamp(&tasks[queued], origin);
+				k_msgq_put(&calculator_msgq, &tasks[queued], K_NO_WAIT);
+			}
+		}
+		k_spin_unlock(&submit_lock, key);
+	} else {
+		for (; queued < count; queued++) {
+			submit_stamp(&tasks[queued], origin);
+			if (k_msgq_put(&calculator_msgq, &tasks[queued], timeout)) {
+				break;  // The timeout expired
+			}
+		}
+	}
+	if (queued > 0) {
+		cds_stats_received(queued);
+		CDS_TRACING_ENQUEUE(tasks[0].operation, queued);
+	}
+	if (queued < count) {
+		cds_stats_dropped(count - queued);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+int calc_io_send(const ReturnValue *results, size_t count)
+{
+	uint8_t transport = CALC_IO_TRANSPORT(results[0].origin);
+	const struct calc_io_sink *sink = (transport < CALC_IO_ORIGINS) ? sinks[transport] : NULL;
+
+	if (!sink || !sink->results) {
+		return -ENODEV;
+	}
+	return sink->results(results, count);
+}
+
+void calc_io_bench(uint8_t origin, const uint8_t *record, size_t len)
+{
+	uint8_t transport = CALC_IO_TRANSPORT(origin);
+	const struct calc_io_sink *sink = (transport < CALC_IO_ORIGINS) ? sinks[transport] : NULL;
+
+	if (sink && sink->bench) {
+		sink->bench(record, len);
+	}
+}
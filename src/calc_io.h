@@ -0,0 +1,93 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+#ifndef CALC_IO_H_
+#define CALC_IO_H_
+
+/**@file
+ * @defgroup calc_io Task ingress and result egress
+ * @{
+ * @brief Transports sharing the calculator pipeline: the CDS characteristics, the shell and the
+ *        binary UART transport.
+ *
+ * Every transport queues its tasks into calculator_msgq with calc_io_submit(), which tags them
+ * with the transport (origin). BLE tasks also carry the client session in the upper nibble of the
+ * origin with CONFIG_CDS_SESSION. The engine copies the origin to the results, the send_data_thread
+ * coalesces the results of one origin and hands them to the sink registered for it. Results of
+ * an origin without a sink are dropped and counted as failed notifications.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include "calc_engine.h"
+
+#define CALC_IO_BLE     0  // CDS operation characteristic (my_cds.c), the default of a zeroed task
+#define CALC_IO_SHELL   1  // calc shell command (calc_shell.c)
+#define CALC_IO_UART    2  // Binary UART transport (calc_uart.c)
+#define CALC_IO_ORIGINS 3
+
+#define CALC_IO_TRANSPORT(origin) ((origin) & 0x0F)  // Without the session tag (cds_session.h)
+
+/** @brief Result sink of a transport. */
+struct calc_io_sink {
+	/** Results of the transport in queue order (send_data_thread). Batched results come
+	 *  coalesced, up to CDS_NOTIFY_MAX_RESULTS per call. Returns 0 or a negative error code.
+	 */
+	int (*results)(const ReturnValue *results, size_t count);
+	/** One CALC_BENCH_RESULT_LEN self-benchmark record (system workqueue). Can be NULL. */
+	void (*bench)(const uint8_t *record, size_t len);
+};
+
+/** @brief Register the result sink of an origin.
+ *
+ * @param[in] origin CALC_IO_* origin.
+ * @param[in] sink Sink, kept by reference. NULL drops the results of the origin.
+ */
+void calc_io_register(uint8_t origin, const struct calc_io_sink *sink);
+
+/** @brief Queue tasks into calculator_msgq.
+ *
+ * The tasks are tagged with the origin and timestamped (CONFIG_CDS_LATENCY), and counted in the
+ * stats. With K_NO_WAIT the tasks are queued all or none, the room check and the puts are atomic
+ * against the other K_NO_WAIT submitters, job timers included. With another timeout each task
+ * waits for room in turn, so a transport without flow control of its own (the shell) is paced by
+ * the engine. Job timers, session ends and the self-benchmark queue their tasks with K_NO_WAIT
+ * too (ISR context allowed).
+ *
+ * @param[in,out] tasks Decoded tasks.
+ * @param[in] count Number of tasks.
+ * @param[in] origin CALC_IO_* origin.
+ * @param[in] timeout Wait for room in the queue, per task.
+ *
+ * @retval 0 If the operation was successful.
+ * @retval -ENOMEM The queue had no room, the tasks not queued are counted as dropped.
+ */
+int calc_io_submit(struct calculator_task *tasks, size_t count, uint8_t origin, k_timeout_t timeout);
+
+/** @brief Pass results of one origin to its sink (send_data_thread).
+ *
+ * @retval 0 If the operation was successful.
+ * @retval -ENODEV No sink is registered for the origin. Otherwise, the error of the sink.
+ */
+int calc_io_send(const ReturnValue *results, size_t count);
+
+/** @brief Pass a self-benchmark record to the sink of an origin (system workqueue). */
+void calc_io_bench(uint8_t origin, const uint8_t *record, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* CALC_IO_H_ */
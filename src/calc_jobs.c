@@ -0,0 +1,153 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief Standing jobs
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include "calc_jobs.h"
+#include "calc_io.h"
+#include "fp16.h"
+
+struct calc_job {
+	struct k_timer timer;
+	struct calculator_task task;
+	int32_float_union threshold;
+	int32_float_union last;		// Last notified result
+	uint8_t source;
+	uint8_t gen;				// Incremented when the job is set, job_gen of its tasks
+	bool notified;				// last is valid
+	bool active;
+};
+
+static struct calc_job jobs[CONFIG_CDS_JOBS];  // Set up by the engine thread, read by the timers
+static uint32_t sensor_value = 100;  // Simulated sensor, timer context only
+// -------------------------------------------------------------------------------------------------
+
+static bool job_float(uint8_t mode)
+{
+	return mode == FLOAT_MODE || mode == HALF_MODE || mode == COMPLEX_FLOAT_MODE;
+}
+
+static uint32_t simulate_data(void)
+{
+	sensor_value++;
+	if (sensor_value == 200) {
+		sensor_value = 100;
+	}
+	return sensor_value;
+}
+
+static void job_expiry(struct k_timer *timer)
+{
+	struct calc_job *job = CONTAINER_OF(timer, struct calc_job, timer);
+	struct calculator_task task = job->task;
+
+	if (job->source == CALC_JOB_SRC_SENSOR) {
+		uint32_t sample = simulate_data();
+
+		if (job_float(task.mode)) {
+			task.f_operand_1 = (float)sample;
+		} else {
+			task.q31_operand_1 = (int32_t)sample;
+		}
+	}
+	calc_io_submit(&task, 1, task.origin, K_NO_WAIT);  // Skipped this period if the engine is behind
+}
+// -------------------------------------------------------------------------------------------------
+
+int calc_jobs_set(uint8_t id, const struct calculator_task *task, uint8_t source,
+		  uint16_t period_ms, int32_float_union threshold)
+{
+	struct calc_job *job;
+
+	if (id >= CONFIG_CDS_JOBS || source > CALC_JOB_SRC_SENSOR ||
+	    period_ms < CONFIG_CDS_JOB_MIN_PERIOD_MS) {
+		return -EINVAL;
+	}
+
+	job = &jobs[id];
+	if (job->active) {
+		k_timer_stop(&job->timer);
+	} else {
+		k_timer_init(&job->timer, job_expiry, NULL);
+	}
+	job->task = *task;
+	job->task.flags = (task->flags & CDS_TASK_FLAG_ACC) | CDS_TASK_FLAG_JOB;
+	job->task.job = id;
+	job->task.job_gen = ++job->gen;  // Evaluations of the replaced task still queued are stale
+	job->threshold = threshold;
+	job->source = source;
+	job->notified = false;
+	job->active = true;
+	k_timer_start(&job->timer, K_MSEC(period_ms), K_MSEC(period_ms));
+	return 0;
+}
+
+int calc_jobs_clear(uint8_t id)
+{
+	if (id == CALC_JOB_ALL) {
+		for (uint8_t i = 0; i < CONFIG_CDS_JOBS; i++) {
+			calc_jobs_clear(i);
+		}
+		return 0;
+	}
+	if (id >= CONFIG_CDS_JOBS) {
+		return -EINVAL;
+	}
+	if (jobs[id].active) {
+		k_timer_stop(&jobs[id].timer);
+		jobs[id].active = false;
+	}
+	return 0;
+}
+
+void calc_jobs_clear_transport(uint8_t transport)
+{
+	for (uint8_t i = 0; i < CONFIG_CDS_JOBS; i++) {
+		if (jobs[i].active && CALC_IO_TRANSPORT(jobs[i].task.origin) == transport) {
+			calc_jobs_clear(i);
+		}
+	}
+}
+
+bool calc_jobs_current(uint8_t id, uint8_t gen)
+{
+	return id < CONFIG_CDS_JOBS && jobs[id].active && jobs[id].gen == gen;
+}
+
+bool calc_jobs_changed(uint8_t id, const ReturnValue *result)
+{
+	struct calc_job *job;
+	bool changed;
+
+	if (id >= CONFIG_CDS_JOBS || !jobs[id].active || result->type == NONE_TYPE) {
+		return false;  // Stale evaluation queued before the job was cleared
+	}
+	job = &jobs[id];
+
+	if (!job->notified) {
+		changed = true;
+	} else if (result->type == FLOAT_TYPE || result->type == HALF_TYPE) {
+		float now = (result->type == HALF_TYPE) ? fp16_to_float(result->value.h) : result->value.f;
+		float last = (result->type == HALF_TYPE) ? fp16_to_float(job->last.h) : job->last.f;
+
+		changed = fabsf(now - last) > job->threshold.f;
+	} else {
+		changed = llabs((int64_t)result->value.u - job->last.u) > job->threshold.u;
+	}
+
+	if (changed) {
+		job->last = result->value;
+		job->notified = true;
+	}
+	return changed;
+}
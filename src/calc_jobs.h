@@ -0,0 +1,93 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+#ifndef CALC_JOBS_H_
+#define CALC_JOBS_H_
+
+/**@file
+ * @defgroup calc_jobs Standing jobs
+ * @{
+ * @brief Tasks re-evaluated on a k_timer schedule, results pushed only when they change.
+ *
+ * A job repeats a task every period. The timer queues a copy of the task with
+ * CDS_TASK_FLAG_JOB to the calculator engine, which notifies the (job id, result) pair only if
+ * the result moved by more than the job threshold since the last notified one. With the
+ * simulated sensor source, operand 1 is replaced by the next sample of the 100 ... 199
+ * sawtooth of demo/write_notify (a number in the float modes, raw LSBs in the fixed-point ones).
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <zephyr/types.h>
+#include "my_cds.h"
+
+// Job sources
+#define CALC_JOB_SRC_NONE   0  // Operand 1 of the task
+#define CALC_JOB_SRC_SENSOR 1  // Simulated sensor sample
+
+#define CALC_JOB_ALL 0xFF
+
+// Operand 1 of CALC_OP_JOB_SET: job id, source and period in ms
+#define CALC_JOB_DESC(id, src, period_ms) \
+	((uint32_t)(id) | ((uint32_t)(src) << 8) | ((uint32_t)(period_ms) << 16))
+
+/** @brief Start (or replace) a standing job.
+ *
+ * @param[in] id Job id, below CONFIG_CDS_JOBS.
+ * @param[in] task Task to repeat, a scalar task with a single result.
+ * @param[in] source CALC_JOB_SRC_NONE or CALC_JOB_SRC_SENSOR.
+ * @param[in] period_ms Period, at least CONFIG_CDS_JOB_MIN_PERIOD_MS.
+ * @param[in] threshold Change needed to notify a new result, in the task mode (raw for the
+ *                      fixed-point modes).
+ *
+ * @retval 0 If the operation was successful. Otherwise, -EINVAL.
+ */
+int calc_jobs_set(uint8_t id, const struct calculator_task *task, uint8_t source,
+		  uint16_t period_ms, int32_float_union threshold);
+
+/** @brief Stop a standing job.
+ *
+ * @param[in] id Job id, CALC_JOB_ALL for all jobs.
+ *
+ * @retval 0 If the operation was successful. Otherwise, -EINVAL.
+ */
+int calc_jobs_clear(uint8_t id);
+
+/** @brief Stop the jobs set by the tasks of a transport.
+ *
+ * @param[in] transport CALC_IO_* origin, whatever the session tag (calc_io.h).
+ */
+void calc_jobs_clear_transport(uint8_t transport);
+
+/** @brief Whether a queued job evaluation is still due (engine thread).
+ *
+ * @param[in] id Job id, from calculator_task.job.
+ * @param[in] gen Job generation, from calculator_task.job_gen.
+ *
+ * @retval false If the job was cleared or set again since the evaluation was queued.
+ */
+bool calc_jobs_current(uint8_t id, uint8_t gen);
+
+/** @brief Check the result of a job evaluation against the last notified one.
+ *
+ * @param[in] id Job id, from calculator_task.job.
+ * @param[in] result Result of the evaluation.
+ *
+ * @retval true If the result must be notified, it becomes the new reference.
+ */
+bool calc_jobs_changed(uint8_t id, const ReturnValue *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* CALC_JOBS_H_ */
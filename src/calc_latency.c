@@ -0,0 +1,103 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief Pipeline latency
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <string.h>
+#include "calc_latency.h"
+
+#define LAT_SUB_BITS 2
+#define LAT_SUB (1 << LAT_SUB_BITS)
+#define LAT_BUCKETS (LAT_SUB + 24 * LAT_SUB)  // Up to 2^26 us, longer ones land in the last bucket
+
+struct lat_hist {
+	uint32_t count;
+	uint32_t max_us;
+	uint32_t buckets[LAT_BUCKETS];
+};
+
+// Recorded from the engine thread and the BT TX notification callback
+static struct lat_hist hist[CALC_LAT_STAGES];
+static struct k_spinlock lat_lock;
+// -------------------------------------------------------------------------------------------------
+
+// Log-linear bucket: values below LAT_SUB are exact, above it LAT_SUB buckets per power of two
+static uint32_t lat_bucket(uint32_t us)
+{
+	uint32_t exp;
+	uint32_t idx;
+
+	if (us < LAT_SUB) {
+		return us;
+	}
+	exp = 31 - __builtin_clz(us);  // >= LAT_SUB_BITS
+	idx = LAT_SUB + (exp - LAT_SUB_BITS) * LAT_SUB + ((us >> (exp - LAT_SUB_BITS)) & (LAT_SUB - 1));
+	return MIN(idx, LAT_BUCKETS - 1);
+}
+
+// Largest value of a bucket
+static uint32_t lat_bucket_max(uint32_t idx)
+{
+	uint32_t exp;
+	uint32_t sub;
+
+	if (idx < LAT_SUB) {
+		return idx;
+	}
+	exp = (idx - LAT_SUB) / LAT_SUB + LAT_SUB_BITS;
+	sub = (idx - LAT_SUB) % LAT_SUB;
+	return ((LAT_SUB + sub + 1) << (exp - LAT_SUB_BITS)) - 1;
+}
+
+static uint32_t lat_percentile(const struct lat_hist *h, uint32_t permille)
+{
+	uint32_t rank = (uint32_t)(((uint64_t)h->count * permille + 999) / 1000);  // 1-based
+	uint32_t seen = 0;
+
+	for (uint32_t i = 0; i < LAT_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= rank) {
+			return MIN(lat_bucket_max(i), h->max_us);
+		}
+	}
+	return h->max_us;
+}
+
+void calc_latency_record(enum calc_latency_stage stage, uint32_t start, uint32_t end)
+{
+	uint32_t us = k_cyc_to_us_floor32(end - start);  // Wraps with the cycle counter
+	k_spinlock_key_t key = k_spin_lock(&lat_lock);
+	struct lat_hist *h = &hist[stage];
+
+	h->count++;
+	h->max_us = MAX(h->max_us, us);
+	h->buckets[lat_bucket(us)]++;
+	k_spin_unlock(&lat_lock, key);
+}
+
+void calc_latency_summary(enum calc_latency_stage stage, struct calc_latency_summary *summary)
+{
+	k_spinlock_key_t key = k_spin_lock(&lat_lock);
+	const struct lat_hist *h = &hist[stage];
+
+	summary->count = h->count;
+	summary->max_us = h->max_us;
+	summary->p50_us = (h->count > 0) ? lat_percentile(h, 500) : 0;
+	summary->p99_us = (h->count > 0) ? lat_percentile(h, 990) : 0;
+	k_spin_unlock(&lat_lock, key);
+}
+
+void calc_latency_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lat_lock);
+
+	memset(hist, 0, sizeof(hist));
+	k_spin_unlock(&lat_lock, key);
+}
@@ -0,0 +1,69 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+#ifndef CALC_LATENCY_H_
+#define CALC_LATENCY_H_
+
+/**@file
+ * @defgroup calc_latency Pipeline latency
+ * @{
+ * @brief Per-stage latency histograms of the write -> engine -> notification pipeline.
+ *
+ * Tasks are stamped with k_cycle_get_32() in write_operation(), when the engine thread takes
+ * them from calculator_msgq, after my_cds_calculate_result() and when the notification carrying
+ * the result has been sent. Each stage goes to a log-linear histogram (4 sub-buckets per power
+ * of two, so percentiles are within 25 %) of microseconds, p50/p99/max are read back over the
+ * CDS diagnostics characteristic.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <zephyr/types.h>
+
+enum calc_latency_stage {
+	CALC_LAT_QUEUE,		// write_operation() -> engine thread
+	CALC_LAT_COMPUTE,	// Engine thread -> result ready
+	CALC_LAT_NOTIFY,	// Result ready -> notification sent
+	CALC_LAT_TOTAL,		// write_operation() -> notification sent
+	CALC_LAT_STAGES
+};
+
+// Diagnostics characteristic: read returns a calc_latency_summary per stage (le32 fields)
+#define CALC_DIAG_RESET      0  // [0]: clear the histograms
+#define CALC_DIAG_TIMESTAMPS 1  // [1][0|1]: append the device time in us to each notification
+
+struct calc_latency_summary {
+	uint32_t count;
+	uint32_t p50_us;
+	uint32_t p99_us;
+	uint32_t max_us;
+};
+
+/** @brief Record a stage duration.
+ *
+ * @param[in] stage Pipeline stage.
+ * @param[in] start k_cycle_get_32() at the start of the stage.
+ * @param[in] end k_cycle_get_32() at the end of the stage.
+ */
+void calc_latency_record(enum calc_latency_stage stage, uint32_t start, uint32_t end);
+
+/** @brief Read the percentiles of a stage, in microseconds. */
+void calc_latency_summary(enum calc_latency_stage stage, struct calc_latency_summary *summary);
+
+/** @brief Clear all histograms. */
+void calc_latency_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* CALC_LATENCY_H_ */
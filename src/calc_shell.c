@@ -0,0 +1,368 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief calc shell command: tasks and load tests over the console, without BLE
+ *
+ *  calc op <op> <mode> [a] [b] [a_im] [b_im]   One task, its results are printed
+ *  calc batch <count> <op> <mode> [a] [b]      Back-to-back tasks, prints the throughput
+ *  calc bench <mode> <batch> <iterations> <op>...  Self-benchmark, see calc_bench.h
+ *  calc stats                                  Pipeline counters and latency percentiles
+ *
+ *  Tasks go through calculator_msgq and the engine thread like CDS writes, they share the
+ *  engine session (accumulators, buffers) with the BLE client.
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/shell/shell.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "calc_io.h"
+#include "cds_codec.h"
+#include "cds_stats.h"
+#include "fp16.h"
+#if defined(CONFIG_CDS_LATENCY)
+#include "calc_latency.h"
+#endif
+#if defined(CONFIG_CDS_BENCH)
+#include "calc_bench.h"
+#endif
+
+#define BATCH_CHUNK 16  // Tasks per calc_io_submit() of calc batch
+#define BATCH_TIMEOUT K_SECONDS(10)  // After the last task is queued
+
+struct calc_shell_name {
+	const char *name;
+	uint8_t value;
+};
+
+static const struct calc_shell_name op_names[] = {
+	{ "reset", CALC_OP_RESET }, { "add", CALC_OP_ADD }, { "sub", CALC_OP_SUB },
+	{ "mul", CALC_OP_MUL }, { "div", CALC_OP_DIV }, { "conj", CALC_OP_CONJ },
+	{ "mag", CALC_OP_MAG }, { "phase", CALC_OP_PHASE },
+};
+
+static const struct calc_shell_name mode_names[] = {
+	{ "float", FLOAT_MODE }, { "q31", FIXED_MODE }, { "half", HALF_MODE },
+	{ "q15", Q15_MODE }, { "q7.24", Q7_24_MODE }, { "q16.16", Q16_16_MODE },
+	{ "cq15", COMPLEX_Q15_MODE }, { "cfloat", COMPLEX_FLOAT_MODE },
+};
+
+static const struct shell *calc_sh;  // Shell of the last calc command, the results are printed there
+static atomic_t batch_pending;  // Results calc batch waits for, the others are printed
+static uint32_t batch_end;  // k_cycle_get_32() at the last result of the batch
+static K_SEM_DEFINE(batch_done, 0, 1);
+static struct calculator_task batch_tasks[BATCH_CHUNK];  // Shell thread only
+// -------------------------------------------------------------------------------------------------
+
+// Name from the table or a number (0x.. accepted)
+static int parse_name(const char *arg, const struct calc_shell_name *names, size_t count, uint8_t *value)
+{
+	char *end;
+	unsigned long number;
+
+	for (size_t i = 0; i < count; i++) {
+		if (strcmp(arg, names[i].name) == 0) {
+			*value = names[i].value;
+			return 0;
+		}
+	}
+	number = strtoul(arg, &end, 0);
+	if (*end != '\0' || number > UINT8_MAX) {
+		return -EINVAL;
+	}
+	*value = (uint8_t)number;
+	return 0;
+}
+
+static bool name_known(uint8_t value, const struct calc_shell_name *names, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		if (names[i].value == value) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool mode_float(uint8_t mode)
+{
+	return mode == FLOAT_MODE || mode == HALF_MODE || mode == COMPLEX_FLOAT_MODE;
+}
+
+// <op> <mode> [a] [b] [a_im] [b_im], floats in the float modes, raw (Q) integers otherwise
+static int parse_task(const struct shell *sh, size_t argc, char **argv, struct calculator_task *task)
+{
+	float f[4] = { 0 };
+	int32_t q[2] = { 0 };
+	char *end;
+
+	*task = (struct calculator_task){ 0 };
+	if (parse_name(argv[0], op_names, ARRAY_SIZE(op_names), &task->operation) ||
+	    parse_name(argv[1], mode_names, ARRAY_SIZE(mode_names), &task->mode)) {
+		shell_error(sh, "Unknown operation or mode");
+		return -EINVAL;
+	}
+	// Scalar and complex operations only, by name or number. Modes as the codec accepts them.
+	if (!name_known(task->operation, op_names, ARRAY_SIZE(op_names))) {
+		shell_error(sh, "Operation %u not supported", task->operation);
+		return -EINVAL;
+	}
+	if (!cds_codec_mode_valid(task->mode)) {
+		shell_error(sh, "Mode 0x%02x not supported", task->mode);
+		return -EINVAL;
+	}
+	if (argc > ((task->mode == COMPLEX_FLOAT_MODE) ? 6 : 4)) {
+		shell_error(sh, "Too many operands");
+		return -EINVAL;
+	}
+	for (size_t i = 2; i < argc; i++) {
+		if (mode_float(task->mode)) {
+			f[i - 2] = strtof(argv[i], &end);
+		} else {
+			q[i - 2] = (int32_t)strtoll(argv[i], &end, 0);
+		}
+		if (*end != '\0') {
+			shell_error(sh, "Incorrect operand %s", argv[i]);
+			return -EINVAL;
+		}
+	}
+
+	if (mode_float(task->mode)) {
+		task->f_operand_1 = f[0];
+		task->f_operand_2 = f[1];
+		task->f_operand_1_im = f[2];
+		task->f_operand_2_im = f[3];
+	} else {
+		task->q31_operand_1 = q[0];
+		task->q31_operand_2 = q[1];
+	}
+	return 0;
+}
+
+static void print_result(const ReturnValue *result)
+{
+	switch (result->type) {
+	case FLOAT_TYPE:
+		shell_print(calc_sh, "%f", (double)result->value.f);
+		break;
+	case HALF_TYPE:
+		shell_print(calc_sh, "%f (0x%04x)", (double)fp16_to_float(result->value.h), result->value.h);
+		break;
+	default:
+		shell_print(calc_sh, "%d (0x%08x)", result->value.u, (uint32_t)result->value.u);
+		break;
+	}
+}
+// -------------------------------------------------------------------------------------------------
+
+// Results of the shell tasks (send_data_thread)
+static int shell_results(const ReturnValue *results, size_t count)
+{
+	if (atomic_get(&batch_pending) > 0) {
+		if (atomic_sub(&batch_pending, count) <= (atomic_val_t)count) {
+			batch_end = k_cycle_get_32();
+			k_sem_give(&batch_done);
+		}
+		return 0;
+	}
+	if (!calc_sh) {
+		return -ENODEV;
+	}
+	for (size_t i = 0; i < count; i++) {
+		print_result(&results[i]);
+	}
+	return 0;
+}
+
+#if defined(CONFIG_CDS_BENCH)
+// [opcode][mode][batch][timer][min][avg][max][timer hz] (system workqueue)
+static void shell_bench(const uint8_t *record, size_t len)
+{
+	if (!calc_sh || len < CALC_BENCH_RESULT_LEN) {
+		return;
+	}
+	shell_print(calc_sh, "op %u mode 0x%02x batch %u: min %u avg %u max %u cycles, %s %u Hz",
+		    record[0], record[1], record[2], sys_get_le32(&record[4]), sys_get_le32(&record[8]),
+		    sys_get_le32(&record[12]), (record[3] == CALC_BENCH_TIMER_DWT) ? "DWT" : "kernel timer",
+		    sys_get_le32(&record[16]));
+}
+#endif
+
+static const struct calc_io_sink shell_sink = {
+	.results = shell_results,
+#if defined(CONFIG_CDS_BENCH)
+	.bench = shell_bench,
+#endif
+};
+
+static void shell_attach(const struct shell *sh)
+{
+	calc_sh = sh;
+	calc_io_register(CALC_IO_SHELL, &shell_sink);
+}
+// -------------------------------------------------------------------------------------------------
+
+static int cmd_op(const struct shell *sh, size_t argc, char **argv)
+{
+	struct calculator_task task;
+	int err = parse_task(sh, argc - 1, &argv[1], &task);
+
+	if (err) {
+		return err;
+	}
+	shell_attach(sh);
+	err = calc_io_submit(&task, 1, CALC_IO_SHELL, K_NO_WAIT);
+	if (err) {
+		shell_error(sh, "Task queue full");
+	}
+	return err;
+}
+
+static int cmd_batch(const struct shell *sh, size_t argc, char **argv)
+{
+	struct calculator_task task;
+	unsigned long count = strtoul(argv[1], NULL, 0);
+	uint32_t per_task;
+	uint32_t start;
+	int err = parse_task(sh, argc - 2, &argv[2], &task);
+
+	if (err) {
+		return err;
+	}
+	if (count == 0 || count > 1000000 || task.operation > CALC_OP_PHASE ||
+	    (task.operation > CALC_OP_DIV && task.operation < CALC_OP_CONJ)) {
+		shell_error(sh, "1 to 1000000 tasks of add, sub, mul, div, reset, conj, mag or phase");
+		return -EINVAL;
+	}
+	// One result per task, the complex float operations pass the real and imaginary parts
+	per_task = (task.mode == COMPLEX_FLOAT_MODE && task.operation != CALC_OP_MAG &&
+		    task.operation != CALC_OP_PHASE) ? 2 : 1;
+	task.flags = CDS_TASK_FLAG_BATCH;
+
+	shell_attach(sh);
+	k_sem_reset(&batch_done);
+	atomic_set(&batch_pending, count * per_task);
+	start = k_cycle_get_32();
+	for (unsigned long queued = 0; queued < count; queued += BATCH_CHUNK) {
+		size_t chunk = MIN(count - queued, BATCH_CHUNK);
+
+		for (size_t i = 0; i < chunk; i++) {
+			batch_tasks[i] = task;
+		}
+		calc_io_submit(batch_tasks, chunk, CALC_IO_SHELL, K_FOREVER);  // Paced by the engine
+	}
+
+	if (k_sem_take(&batch_done, BATCH_TIMEOUT)) {
+		shell_error(sh, "Timeout, %ld results missing", (long)atomic_set(&batch_pending, 0));
+		return -ETIMEDOUT;
+	}
+
+	uint64_t us = k_cyc_to_us_floor64(batch_end - start);
+
+	shell_print(sh, "%lu tasks in %llu us, %llu tasks/s", count, (unsigned long long)us,
+		    (unsigned long long)((us > 0) ? (uint64_t)count * USEC_PER_SEC / us : 0));
+	return 0;
+}
+
+#if defined(CONFIG_CDS_BENCH)
+static int cmd_bench(const struct shell *sh, size_t argc, char **argv)
+{
+	uint8_t spec[CALC_BENCH_SPEC_HDR_LEN + CALC_BENCH_OPS_MAX];
+	uint8_t op_count = argc - 4;
+	int err;
+
+	if (op_count > CALC_BENCH_OPS_MAX ||
+	    parse_name(argv[1], mode_names, ARRAY_SIZE(mode_names), &spec[0])) {
+		shell_error(sh, "Unknown mode or more than %u operations", CALC_BENCH_OPS_MAX);
+		return -EINVAL;
+	}
+	spec[1] = (uint8_t)strtoul(argv[2], NULL, 0);
+	sys_put_le16((uint16_t)strtoul(argv[3], NULL, 0), &spec[2]);
+	for (uint8_t i = 0; i < op_count; i++) {
+		if (parse_name(argv[4 + i], op_names, ARRAY_SIZE(op_names),
+			       &spec[CALC_BENCH_SPEC_HDR_LEN + i])) {
+			shell_error(sh, "Unknown operation %s", argv[4 + i]);
+			return -EINVAL;
+		}
+	}
+
+	shell_attach(sh);
+	err = calc_bench_request(spec, CALC_BENCH_SPEC_HDR_LEN + op_count, CALC_IO_SHELL);
+	if (err == -EINVAL) {
+		shell_error(sh, "Incorrect spec");
+	} else if (err == -EBUSY) {
+		shell_error(sh, "Benchmark running");
+	} else if (err) {
+		shell_error(sh, "Task queue full");
+	}
+	return err;
+}
+#endif
+
+static void print_stats_word(const struct shell *sh, const char *name, const uint8_t *word)
+{
+	uint32_t value = sys_get_le32(word);
+
+	if (value == CDS_STATS_NA) {
+		shell_print(sh, "%-24s n/a", name);
+	} else {
+		shell_print(sh, "%-24s %u", name, value);
+	}
+}
+
+static int cmd_stats(const struct shell *sh, size_t argc, char **argv)
+{
+	static const char *const names[] = {
+		"tasks received", "tasks dropped", "results computed", "notifications failed",
+		"queue high-water mark", "queue size",
+		"engine cpu (permille)", "engine stack used", "engine stack size",
+		"send cpu (permille)", "send stack used", "send stack size",
+	};
+	uint8_t value[CDS_STATS_WORDS * sizeof(uint32_t)];
+
+	cds_stats_encode(value);
+	for (size_t i = 0; i < ARRAY_SIZE(names); i++) {
+		print_stats_word(sh, names[i], &value[i * sizeof(uint32_t)]);
+	}
+	for (size_t i = 0; i < CDS_STATS_OPS; i++) {
+		uint32_t ops = sys_get_le32(&value[(ARRAY_SIZE(names) + i) * sizeof(uint32_t)]);
+
+		if (ops > 0 && i < CDS_STATS_OPS - 1) {
+			shell_print(sh, "op %-21u %u", (unsigned int)i, ops);
+		} else if (ops > 0) {
+			shell_print(sh, "%-24s %u", "op ext", ops);
+		}
+	}
+
+#if defined(CONFIG_CDS_LATENCY)
+	static const char *const stages[CALC_LAT_STAGES] = { "queue", "compute", "notify", "total" };
+	struct calc_latency_summary summary;
+
+	for (int i = 0; i < CALC_LAT_STAGES; i++) {
+		calc_latency_summary(i, &summary);
+		shell_print(sh, "latency %-8s count %u p50 %u us p99 %u us max %u us", stages[i],
+			    summary.count, summary.p50_us, summary.p99_us, summary.max_us);
+	}
+#endif
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(calc_cmds,
+	SHELL_CMD_ARG(op, NULL, "Run a task: <op> <mode> [a] [b] [a_im] [b_im]", cmd_op, 3, 4),
+	SHELL_CMD_ARG(batch, NULL, "Throughput of back-to-back tasks: <count> <op> <mode> [a] [b]",
+		      cmd_batch, 4, 2),
+	SHELL_COND_CMD_ARG(CONFIG_CDS_BENCH, bench, NULL,
+			   "Self-benchmark: <mode> <batch> <iterations> <op>...", cmd_bench, 5,
+			   CALC_BENCH_OPS_MAX - 1),
+	SHELL_CMD_ARG(stats, NULL, "Pipeline counters and latency percentiles", cmd_stats, 1, 0),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(calc, &calc_cmds, "Calculator engine", NULL);
@@ -0,0 +1,97 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief Binary event trace
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/barrier.h>
+#include <zephyr/sys/printk.h>
+#include "calc_trace.h"
+
+#define TRACE_MASK (CONFIG_CDS_TRACE_RECORDS - 1)
+#define TRACE_DRAIN_BATCH 16
+
+BUILD_ASSERT((CONFIG_CDS_TRACE_RECORDS & TRACE_MASK) == 0, "Trace ring size must be a power of two");
+
+static struct calc_trace_rec ring[CONFIG_CDS_TRACE_RECORDS];
+static atomic_t head;	// Next sequence number to claim
+static uint32_t tail;	// Next sequence number to read, consumer only
+// -------------------------------------------------------------------------------------------------
+
+void calc_trace(uint8_t id, uint8_t a, uint16_t b, uint32_t c)
+{
+	uint32_t seq = (uint32_t)atomic_inc(&head);
+	struct calc_trace_rec *rec = &ring[seq & TRACE_MASK];
+
+	rec->seq = 0;
+	barrier_dmem_fence_full();
+	rec->ts = k_cycle_get_32();
+	rec->id = id;
+	rec->a = a;
+	rec->b = b;
+	rec->c = c;
+	barrier_dmem_fence_full();
+	rec->seq = seq + 1;  // Publish
+}
+
+size_t calc_trace_read(struct calc_trace_rec *out, size_t max, uint32_t *lost)
+{
+	uint32_t claimed = (uint32_t)atomic_get(&head);
+	size_t count = 0;
+
+	if (claimed - tail > CONFIG_CDS_TRACE_RECORDS) {  // Lapped by the producers
+		*lost += claimed - tail - CONFIG_CDS_TRACE_RECORDS;
+		tail = claimed - CONFIG_CDS_TRACE_RECORDS;
+	}
+
+	while (tail != claimed && count < max) {
+		const struct calc_trace_rec *rec = &ring[tail & TRACE_MASK];
+
+		out[count] = *rec;
+		barrier_dmem_fence_full();
+		if (out[count].seq == tail + 1 && rec->seq == tail + 1) {
+			count++;  // Published and not overwritten while copied
+		} else if (out[count].seq == 0 || (int32_t)(out[count].seq - (tail + 1)) < 0) {
+			break;  // Claimed but not written yet, retry on the next drain
+		} else {
+			(*lost)++;  // Overwritten by a newer record
+		}
+		tail++;
+	}
+	return count;
+}
+
+#if defined(CONFIG_CDS_TRACE_CONSOLE)
+static void trace_drain_thread(void)
+{
+	static struct calc_trace_rec recs[TRACE_DRAIN_BATCH];
+	uint32_t lost = 0;
+
+	printk("TR HZ %u\n", sys_clock_hw_cycles_per_sec());  // Timestamp unit for the decoder
+	while (1) {
+		size_t count = calc_trace_read(recs, ARRAY_SIZE(recs), &lost);
+
+		if (lost) {
+			printk("TR LOST %u\n", lost);
+			lost = 0;
+		}
+		for (size_t i = 0; i < count; i++) {
+			printk("TR %08x %08x %02x %02x %04x %08x\n", recs[i].seq - 1, recs[i].ts,
+			       recs[i].id, recs[i].a, recs[i].b, recs[i].c);
+		}
+		if (count < ARRAY_SIZE(recs)) {
+			k_sleep(K_MSEC(CONFIG_CDS_TRACE_DRAIN_MS));
+		}
+	}
+}
+
+K_THREAD_DEFINE(trace_drain_thread_id, 1024, trace_drain_thread, NULL, NULL, NULL,
+		K_LOWEST_APPLICATION_THREAD_PRIO, 0, 0);
+#endif
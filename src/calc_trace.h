@@ -0,0 +1,72 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+#ifndef CALC_TRACE_H_
+#define CALC_TRACE_H_
+
+/**@file
+ * @defgroup calc_trace Binary event trace
+ * @{
+ * @brief Fixed-size event records in a lock-free ring, formatted off the hot path.
+ *
+ * calc_trace() claims a slot with one atomic increment and stores a cycle timestamp and the raw
+ * arguments, float values are stored as their bit pattern. Producers never block: when the
+ * consumer is behind, the oldest records are overwritten and reported as lost. A
+ * lowest-priority thread drains the ring to the console as "TR <hex record>" lines, decoded on
+ * the host by scripts/cds_trace_decode.py.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <zephyr/types.h>
+
+// Event ids, keep scripts/cds_trace_decode.py in sync
+#define CALC_TRACE_NOTIFY    1  // a: results, b: first result type, c: error
+#define CALC_TRACE_RESULT    2  // a: ReturnType, c: value (float bit pattern for FLOAT_TYPE)
+#define CALC_TRACE_DIV_ZERO  3  // a: mode, b: operation
+#define CALC_TRACE_OVERFLOW  4  // a: mode, b: operation
+#define CALC_TRACE_OP_ERROR  5  // a: mode, b: operation, c: error
+#define CALC_TRACE_FRAME     6  // Recorded frame (cds_record.h), a: frames lost, b: length, c: delta_us
+#define CALC_TRACE_FRAME_DATA 7  // a: chunk index, b/c: next 6 frame bytes (le16, le32)
+
+struct calc_trace_rec {
+	uint32_t seq;	// Sequence number + 1, 0 while the slot is written
+	uint32_t ts;	// k_cycle_get_32()
+	uint8_t id;		// CALC_TRACE_*
+	uint8_t a;
+	uint16_t b;
+	uint32_t c;
+};
+
+#if defined(CONFIG_CDS_TRACE)
+/** @brief Record an event, from any context. */
+void calc_trace(uint8_t id, uint8_t a, uint16_t b, uint32_t c);
+
+/** @brief Take the oldest records from the ring (single consumer).
+ *
+ * @param[out] out Records.
+ * @param[in] max Size of out.
+ * @param[out] lost Incremented by the number of records overwritten before they were read.
+ *
+ * @retval Number of records taken.
+ */
+size_t calc_trace_read(struct calc_trace_rec *out, size_t max, uint32_t *lost);
+#else
+static inline void calc_trace(uint8_t id, uint8_t a, uint16_t b, uint32_t c) {}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* CALC_TRACE_H_ */
@@ -0,0 +1,405 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief Binary UART transport, COBS framed (see calc_uart.h)
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/ring_buffer.h>
+#include <zephyr/logging/log.h>
+#include <errno.h>
+#include <string.h>
+#include "calc_uart.h"
+#include "calc_io.h"
+#include "cds_codec.h"
+#include "my_cds.h"
+#if defined(CONFIG_CDS_LATENCY)
+#include "calc_latency.h"
+#endif
+#if defined(CONFIG_CDS_BENCH)
+#include "calc_bench.h"
+#endif
+#if defined(CONFIG_CDS_UART_ASYNC_ADAPTER)
+#include "uart_async_adapter.h"
+#endif
+
+LOG_MODULE_DECLARE(BLE_Calculator_App);
+
+#define COBS_MAX_LEN(len) ((len) + (len) / 254 + 1)  // Encoded length, without the delimiter
+
+#define RX_FRAME_MAX (CONFIG_CDS_UART_FRAME_MAX + 4)  // Type, seq and CRC around an operation frame
+#define TX_PAYLOAD_MAX (CDS_NOTIFY_MAX_RESULTS * sizeof(int32_t))
+#define TX_FRAME_MAX (2 + TX_PAYLOAD_MAX + sizeof(uint16_t))  // Type and seq before the results
+#define TX_BUF_SIZE (COBS_MAX_LEN(TX_FRAME_MAX) + 1)
+
+#define UART_RETRY_DELAY K_MSEC(50)  // Reception re-enabled after an error
+#define CALC_UART_PRIORITY 7  // As the send_data_thread
+
+#if defined(CONFIG_CDS_BENCH)
+BUILD_ASSERT(CALC_BENCH_RESULT_LEN <= TX_PAYLOAD_MAX);
+#endif
+
+#if defined(CONFIG_CDS_UART_ASYNC_ADAPTER)
+UART_ASYNC_ADAPTER_INST_DEFINE(async_adapter);
+#endif
+
+static const struct device *uart = DEVICE_DT_GET(DT_CHOSEN(calc_uart));
+
+// Reception: two DMA buffers, chained by UART_RX_BUF_REQUEST, copied into the ring
+static uint8_t rx_bufs[2][CONFIG_CDS_UART_RX_BUF_SIZE];
+static uint8_t rx_next;  // Buffer handed out on the next request (UART callback only)
+RING_BUF_DECLARE(rx_ring, CONFIG_CDS_UART_RING_SIZE);
+static K_SEM_DEFINE(rx_sem, 0, 1);
+static void rx_restart(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(rx_work, rx_restart);
+
+// Transmission: one buffer on the wire, the other one encoded and queued behind it
+static uint8_t tx_bufs[2][TX_BUF_SIZE];
+static size_t tx_lens[2];
+static uint8_t tx_raw[TX_FRAME_MAX];  // Frame being built, under tx_mutex
+static uint8_t tx_fill;  // Buffer encoded next, under tx_mutex
+static int8_t tx_active = -1;  // On the wire, under tx_lock
+static int8_t tx_queued = -1;  // Waiting for tx_active, under tx_lock
+static K_SEM_DEFINE(tx_free, 2, 2);
+static K_MUTEX_DEFINE(tx_mutex);  // Send thread (results), calc_uart thread (NAK), system workqueue (bench)
+static struct k_spinlock tx_lock;
+#if defined(CONFIG_CDS_LATENCY)
+static ReturnValue tx_last[2];  // Last result carried by each buffer, for the notify stage
+#endif
+// -------------------------------------------------------------------------------------------------
+
+// COBS: no 0x00 in the output, at most one overhead byte per 254 bytes
+static size_t cobs_encode(const uint8_t *src, size_t len, uint8_t *dst)
+{
+	size_t code_pos = 0;
+	size_t pos = 1;
+	uint8_t code = 1;
+
+	for (size_t i = 0; i < len; i++) {
+		if (src[i] != 0) {
+			dst[pos++] = src[i];
+			code++;
+		}
+		if (src[i] == 0 || code == 0xFF) {
+			dst[code_pos] = code;
+			code_pos = pos++;
+			code = 1;
+		}
+	}
+	dst[code_pos] = code;
+	return pos;
+}
+
+// Decode in place, returns the decoded length or -EINVAL
+static int cobs_decode(uint8_t *buf, size_t len)
+{
+	size_t in = 0;
+	size_t out = 0;
+
+	while (in < len) {
+		uint8_t code = buf[in++];
+
+		if (code == 0 || in + code - 1 > len) {
+			return -EINVAL;
+		}
+		for (uint8_t i = 1; i < code; i++) {
+			buf[out++] = buf[in++];
+		}
+		if (code != 0xFF && in < len) {
+			buf[out++] = 0;
+		}
+	}
+	return out;
+}
+// -------------------------------------------------------------------------------------------------
+
+// Start the next queued buffer (under tx_lock)
+static void tx_start(void)
+{
+	if (tx_active >= 0 || tx_queued < 0) {
+		return;
+	}
+	tx_active = tx_queued;
+	tx_queued = -1;
+	if (uart_tx(uart, tx_bufs[tx_active], tx_lens[tx_active], SYS_FOREVER_US)) {
+		tx_active = -1;
+		k_sem_give(&tx_free);
+	}
+}
+
+// Buffer on the wire sent or aborted (UART callback)
+static void tx_done(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&tx_lock);
+
+	if (tx_active < 0) {
+		k_spin_unlock(&tx_lock, key);
+		return;
+	}
+#if defined(CONFIG_CDS_LATENCY)
+	const ReturnValue *last = &tx_last[tx_active];
+
+	if (last->type != NONE_TYPE) {
+		uint32_t now = k_cycle_get_32();
+
+		calc_latency_record(CALC_LAT_NOTIFY, last->t_done, now);
+		calc_latency_record(CALC_LAT_TOTAL, last->t_rx, now);
+	}
+#endif
+	tx_active = -1;
+	k_sem_give(&tx_free);
+	tx_start();
+	k_spin_unlock(&tx_lock, key);
+}
+
+// Frame tx_raw[0 .. len), CRC appended here (under tx_mutex)
+static int tx_send(size_t len, const ReturnValue *last)
+{
+	k_spinlock_key_t key;
+
+	if (k_sem_take(&tx_free, K_MSEC(CONFIG_CDS_UART_TX_TIMEOUT_MS))) {
+		return -EAGAIN;  // Host not reading (flow control) or link too slow
+	}
+	sys_put_le16(crc16_ccitt(0, tx_raw, len), &tx_raw[len]);
+	tx_lens[tx_fill] = cobs_encode(tx_raw, len + sizeof(uint16_t), tx_bufs[tx_fill]);
+	tx_bufs[tx_fill][tx_lens[tx_fill]++] = 0x00;  // Delimiter
+#if defined(CONFIG_CDS_LATENCY)
+	tx_last[tx_fill] = last ? *last : (ReturnValue){ .type = NONE_TYPE };
+#endif
+
+	key = k_spin_lock(&tx_lock);
+	tx_queued = tx_fill;
+	tx_start();
+	k_spin_unlock(&tx_lock, key);
+	tx_fill ^= 1;
+	return 0;
+}
+
+static void tx_nak(uint8_t seq, int err)
+{
+	k_mutex_lock(&tx_mutex, K_FOREVER);
+	tx_raw[0] = CALC_UART_NAK;
+	tx_raw[1] = seq;
+	tx_raw[2] = (uint8_t)err;
+	tx_send(3, NULL);
+	k_mutex_unlock(&tx_mutex);
+}
+
+// Results of the UART tasks (send_data_thread)
+static int uart_results(const ReturnValue *results, size_t count)
+{
+	size_t pos = 2;
+	int err;
+
+	k_mutex_lock(&tx_mutex, K_FOREVER);
+	tx_raw[0] = CALC_UART_RESULTS;
+	tx_raw[1] = results[0].origin_gen;  // seq of the TASKS frame, not coalesced across frames
+	for (size_t i = 0; i < count; i++) {
+		if (results[i].type == HALF_TYPE || results[i].type == INT16_TYPE) {
+			sys_put_le16((uint16_t)results[i].value.u, &tx_raw[pos]);
+			pos += sizeof(uint16_t);
+		} else {
+			sys_put_le32((uint32_t)results[i].value.u, &tx_raw[pos]);
+			pos += sizeof(uint32_t);
+		}
+	}
+	err = tx_send(pos, &results[count - 1]);
+	k_mutex_unlock(&tx_mutex);
+	return err;
+}
+
+#if defined(CONFIG_CDS_BENCH)
+// Self-benchmark record (system workqueue)
+static void uart_bench(const uint8_t *record, size_t len)
+{
+	k_mutex_lock(&tx_mutex, K_FOREVER);
+	tx_raw[0] = CALC_UART_BENCH_RESULT;
+	memcpy(&tx_raw[1], record, len);
+	tx_send(1 + len, NULL);
+	k_mutex_unlock(&tx_mutex);
+}
+#endif
+
+static const struct calc_io_sink uart_sink = {
+	.results = uart_results,
+#if defined(CONFIG_CDS_BENCH)
+	.bench = uart_bench,
+#endif
+};
+// -------------------------------------------------------------------------------------------------
+
+static void uart_cb(const struct device *dev, struct uart_event *evt, void *user_data)
+{
+	ARG_UNUSED(dev);
+
+	switch (evt->type) {
+	case UART_TX_DONE:
+	case UART_TX_ABORTED:
+		tx_done();
+		break;
+
+	case UART_RX_RDY:
+		// With the calc_uart thread behind, the tail is lost: the bytes after the loss join the
+		// frame it hit up to the next delimiter, which then fails its CRC and is dropped
+		if (ring_buf_put(&rx_ring, &evt->data.rx.buf[evt->data.rx.offset], evt->data.rx.len) <
+		    evt->data.rx.len) {
+			LOG_DBG("UART: Receive ring full");
+		}
+		k_sem_give(&rx_sem);
+		break;
+
+	case UART_RX_BUF_REQUEST:
+		uart_rx_buf_rsp(uart, rx_bufs[rx_next], sizeof(rx_bufs[rx_next]));
+		rx_next ^= 1;
+		break;
+
+	case UART_RX_STOPPED:
+		LOG_WRN("UART reception stopped (reason %d)", evt->data.rx_stop.reason);
+		break;
+
+	case UART_RX_DISABLED:
+		k_work_reschedule(&rx_work, UART_RETRY_DELAY);
+		break;
+
+	default:
+		break;
+	}
+}
+
+static int rx_enable(void)
+{
+	rx_next = 1;  // The second buffer follows the first one
+	return uart_rx_enable(uart, rx_bufs[0], sizeof(rx_bufs[0]), CONFIG_CDS_UART_RX_TIMEOUT_US);
+}
+
+static void rx_restart(struct k_work *work)
+{
+	if (rx_enable()) {
+		k_work_reschedule(&rx_work, UART_RETRY_DELAY);
+	}
+}
+// -------------------------------------------------------------------------------------------------
+
+static void uart_frame_tasks(const uint8_t *frame, size_t len)
+{
+	static struct calculator_task tasks[CONFIG_CDS_TASK_QUEUE_LEN];  // calc_uart thread only
+	uint8_t seq = frame[0];
+	int count = cds_codec_decode(&frame[1], len - 1, tasks, ARRAY_SIZE(tasks));
+
+	if (count <= 0) {
+		LOG_DBG("UART: Malformed frame %u", seq);
+		tx_nak(seq, (count == -ENOMEM) ? -ENOMEM : -EINVAL);
+		return;
+	}
+	for (int i = 0; i < count; i++) {
+		tasks[i].origin_gen = seq;  // Echoed by CALC_UART_RESULTS
+	}
+	if (calc_io_submit(tasks, count, CALC_IO_UART, K_NO_WAIT)) {
+		LOG_DBG("UART: Task queue full, frame %u", seq);
+		tx_nak(seq, -ENOMEM);
+	}
+}
+
+// Decoded frame: [type][payload][crc le16]
+static void uart_frame(const uint8_t *frame, size_t len)
+{
+	if (len < 1 + sizeof(uint16_t) ||
+	    crc16_ccitt(0, frame, len - sizeof(uint16_t)) != sys_get_le16(&frame[len - sizeof(uint16_t)])) {
+		LOG_DBG("UART: Frame with a bad CRC");
+		return;
+	}
+	len -= sizeof(uint16_t);
+
+	if (frame[0] == CALC_UART_TASKS && len > 2) {
+		uart_frame_tasks(&frame[1], len - 1);
+#if defined(CONFIG_CDS_BENCH)
+	} else if (frame[0] == CALC_UART_BENCH) {
+		int err = calc_bench_request(&frame[1], len - 1, CALC_IO_UART);
+
+		if (err) {
+			LOG_DBG("UART: Bench request failed (err %d)", err);
+		}
+#endif
+	} else {
+		LOG_DBG("UART: Unknown frame type 0x%02x", frame[0]);
+	}
+}
+
+// Split the received bytes into frames at the 0x00 delimiters
+static void calc_uart_thread(void)
+{
+	static uint8_t frame[COBS_MAX_LEN(RX_FRAME_MAX)];
+	size_t pos = 0;
+	bool drop = false;  // Until the next delimiter
+	uint8_t *data;
+	uint32_t len;
+
+	while (1) {
+		k_sem_take(&rx_sem, K_FOREVER);
+		while ((len = ring_buf_get_claim(&rx_ring, &data, sizeof(frame))) > 0) {
+			for (uint32_t i = 0; i < len; i++) {
+				if (data[i] != 0x00) {
+					drop |= pos == sizeof(frame);
+					if (!drop) {
+						frame[pos++] = data[i];
+					}
+					continue;
+				}
+				int decoded = drop ? -EINVAL : cobs_decode(frame, pos);
+
+				if (decoded > 0) {
+					uart_frame(frame, decoded);
+				} else if (pos > 0) {
+					LOG_DBG("UART: Frame dropped");
+				}
+				pos = 0;
+				drop = false;
+			}
+			ring_buf_get_finish(&rx_ring, len);
+		}
+	}
+}
+// -------------------------------------------------------------------------------------------------
+
+#if defined(CONFIG_CDS_UART_ASYNC_ADAPTER)
+static bool uart_test_async_api(const struct device *dev)
+{
+	const struct uart_driver_api *api = (const struct uart_driver_api *)dev->api;
+
+	return (api->callback_set != NULL);
+}
+#endif
+
+int calc_uart_init(void)
+{
+	int err;
+
+	if (!device_is_ready(uart)) {
+		return -ENODEV;
+	}
+#if defined(CONFIG_CDS_UART_ASYNC_ADAPTER)
+	if (!uart_test_async_api(uart)) {
+		uart_async_adapter_init(async_adapter, uart);  // Interrupt-driven UART, e.g. the native_sim pty
+		uart = async_adapter;
+	}
+#endif
+
+	err = uart_callback_set(uart, uart_cb, NULL);
+	if (err) {
+		return err;
+	}
+	calc_io_register(CALC_IO_UART, &uart_sink);
+	return rx_enable();
+}
+
+K_THREAD_DEFINE(calc_uart_thread_id, CONFIG_CDS_UART_STACK_SIZE, calc_uart_thread, NULL, NULL, NULL,
+		CALC_UART_PRIORITY, 0, 0);
@@ -0,0 +1,65 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+#ifndef CALC_UART_H_
+#define CALC_UART_H_
+
+/**@file
+ * @defgroup calc_uart Binary UART transport
+ * @{
+ * @brief Calculator tasks and results over a wired serial link, alongside the BLE clients.
+ *
+ * Frames are COBS encoded and end with a 0x00 delimiter. A decoded frame is
+ *
+ *       [type][payload...][crc le16]
+ *
+ * with the CRC-16/KERMIT (crc16_ccitt() seeded with 0) of type and payload.
+ *
+ * Host to device:
+ *   CALC_UART_TASKS  [seq][operation frame]  Any frame the CDS operation characteristic accepts
+ *                                            (cds_codec.h), queued all or none.
+ *   CALC_UART_BENCH  [spec]                  Self-benchmark spec, see calc_bench.h.
+ *
+ * Device to host:
+ *   CALC_UART_RESULTS [seq][result...]       Results in task order, each at its native width
+ *                                            (le16 for HALF_TYPE and INT16_TYPE, le32 otherwise).
+ *                                            seq is the one of the TASKS frame the results come
+ *                                            from, a RESULTS frame never spans two TASKS frames.
+ *   CALC_UART_NAK     [seq][error]           A TASKS frame was not queued, error is a negative
+ *                                            errno: -EINVAL malformed, -ENOMEM queue full.
+ *   CALC_UART_BENCH_RESULT [record]          One CALC_BENCH_RESULT_LEN record per opcode.
+ *
+ * Frames with a bad CRC or longer than CONFIG_CDS_UART_FRAME_MAX are dropped without a NAK,
+ * so are the frames bytes were lost from when the reception ring overflowed.
+ * Reception is double buffered (DMA on UARTE) into a ring drained by the calc_uart thread.
+ * Transmission alternates two frame buffers, one on the wire while the next one is encoded.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CALC_UART_TASKS        0x01
+#define CALC_UART_BENCH        0x02
+#define CALC_UART_RESULTS      0x81
+#define CALC_UART_NAK          0x82
+#define CALC_UART_BENCH_RESULT 0x83
+
+/** @brief Start reception on the calc,uart chosen UART.
+ *
+ * @retval 0 If the operation was successful. Otherwise, a (negative) error code is returned.
+ */
+int calc_uart_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* CALC_UART_H_ */
@@ -0,0 +1,188 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief Task stream recorder
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+#include <errno.h>
+#include <string.h>
+#include "cds_record.h"
+#if defined(CONFIG_CDS_RECORD_FLASH)
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/fs/fcb.h>
+#else
+#include "calc_trace.h"
+#endif
+
+LOG_MODULE_DECLARE(BLE_Calculator_App);
+
+#define RECORD_STACKSIZE 1024
+#define RECORD_TRACE_CHUNK 6  // Frame bytes per CALC_TRACE_FRAME_DATA record
+
+struct record_frame {
+	uint8_t hdr[CDS_RECORD_HDR_LEN];
+	uint8_t frame[ROUND_UP(CDS_RECORD_FRAME_MAX, 4)];  // Padded to the flash write block
+};
+
+K_MSGQ_DEFINE(record_msgq, sizeof(struct record_frame), CONFIG_CDS_RECORD_QUEUE_LEN, 4);
+
+// Producer state (BT RX thread only)
+static int64_t last_ticks = -1;
+static uint32_t lost;
+// -------------------------------------------------------------------------------------------------
+
+void cds_record_frame(const void *frame, uint16_t len)
+{
+	static struct record_frame rec;
+	int64_t now = k_uptime_ticks();
+	uint64_t delta_us = (last_ticks < 0) ? 0 : k_ticks_to_us_floor64(now - last_ticks);
+
+	last_ticks = now;
+	if (len > CDS_RECORD_FRAME_MAX) {
+		lost++;
+		return;
+	}
+
+	sys_put_le32((uint32_t)MIN(delta_us, UINT32_MAX), &rec.hdr[0]);
+	sys_put_le16(len, &rec.hdr[4]);
+	sys_put_le16((uint16_t)MIN(lost, UINT16_MAX), &rec.hdr[6]);
+	memcpy(rec.frame, frame, len);
+
+	if (k_msgq_put(&record_msgq, &rec, K_NO_WAIT)) {
+		lost++;
+	} else {
+		lost = 0;
+	}
+}
+// -------------------------------------------------------------------------------------------------
+
+#if defined(CONFIG_CDS_RECORD_FLASH)
+#if FIXED_PARTITION_EXISTS(cds_record_partition)
+#define RECORD_PARTITION_ID FIXED_PARTITION_ID(cds_record_partition)
+#else
+#define RECORD_PARTITION_ID FIXED_PARTITION_ID(storage_partition)
+#endif
+#define RECORD_FCB_MAGIC 0x43445352  // "CDSR"
+#define RECORD_SECTORS_MAX 32
+
+static struct fcb fcb;
+static struct flash_sector sectors[RECORD_SECTORS_MAX];
+
+static int record_flash_init(void)
+{
+	uint32_t count = ARRAY_SIZE(sectors);
+	int err = flash_area_get_sectors(RECORD_PARTITION_ID, &count, sectors);
+
+	if (err) {
+		return err;
+	}
+	fcb.f_magic = RECORD_FCB_MAGIC;
+	fcb.f_version = 1;
+	fcb.f_sector_cnt = count;
+	fcb.f_scratch_cnt = 0;  // Full ring: the oldest sector is erased by fcb_rotate()
+	fcb.f_sectors = sectors;
+	return fcb_init(RECORD_PARTITION_ID, &fcb);
+}
+
+static int record_store(struct record_frame *rec)
+{
+	uint16_t len = sys_get_le16(&rec->hdr[4]);
+	uint16_t size = ROUND_UP(CDS_RECORD_HDR_LEN + len, 4);
+	struct fcb_entry loc;
+	int err;
+
+	memset(&rec->frame[len], 0, size - CDS_RECORD_HDR_LEN - len);
+
+	err = fcb_append(&fcb, size, &loc);
+	if (err == -ENOSPC) {
+		err = fcb_rotate(&fcb);
+		if (!err) {
+			err = fcb_append(&fcb, size, &loc);
+		}
+	}
+	if (!err) {
+		err = flash_area_write(fcb.fap, FCB_ENTRY_FA_DATA_OFF(loc), rec, size);
+	}
+	if (!err) {
+		err = fcb_append_finish(&fcb, &loc);
+	}
+	return err;
+}
+
+#if defined(CONFIG_CDS_RECORD_DUMP)
+static int record_dump_entry(struct fcb_entry_ctx *ctx, void *arg)
+{
+	struct record_frame *rec = arg;
+	uint16_t size = MIN(ctx->loc.fe_data_len, sizeof(*rec));
+	uint16_t len;
+
+	if (size < CDS_RECORD_HDR_LEN ||
+	    flash_area_read(ctx->fap, FCB_ENTRY_FA_DATA_OFF(ctx->loc), rec, size)) {
+		return 0;  // Skip the entry
+	}
+	len = MIN(sys_get_le16(&rec->hdr[4]), size - CDS_RECORD_HDR_LEN);
+
+	printk("RC %u %u ", sys_get_le32(&rec->hdr[0]), sys_get_le16(&rec->hdr[6]));
+	for (uint16_t i = 0; i < len; i++) {
+		printk("%02x", rec->frame[i]);
+	}
+	printk("\n");
+	return 0;
+}
+#endif
+#else
+static int record_store(struct record_frame *rec)
+{
+	uint16_t len = sys_get_le16(&rec->hdr[4]);
+
+	calc_trace(CALC_TRACE_FRAME, (uint8_t)MIN(sys_get_le16(&rec->hdr[6]), UINT8_MAX), len,
+		   sys_get_le32(&rec->hdr[0]));
+	for (uint16_t off = 0; off < len; off += RECORD_TRACE_CHUNK) {
+		uint8_t chunk[RECORD_TRACE_CHUNK] = { 0 };
+
+		memcpy(chunk, &rec->frame[off], MIN(RECORD_TRACE_CHUNK, len - off));
+		calc_trace(CALC_TRACE_FRAME_DATA, (uint8_t)(off / RECORD_TRACE_CHUNK),
+			   sys_get_le16(&chunk[0]), sys_get_le32(&chunk[2]));
+	}
+	return 0;
+}
+#endif
+
+static void record_thread(void)
+{
+	static struct record_frame rec;
+	int err;
+
+#if defined(CONFIG_CDS_RECORD_FLASH)
+	err = record_flash_init();
+	if (err) {
+		LOG_ERR("Recorder flash init failed (err %d)", err);
+		return;
+	}
+#if defined(CONFIG_CDS_RECORD_DUMP)
+	fcb_walk(&fcb, NULL, record_dump_entry, &rec);  // Capture of the previous run
+	printk("RC END\n");
+	fcb_clear(&fcb);
+#endif
+#endif
+
+	while (1) {
+		k_msgq_get(&record_msgq, &rec, K_FOREVER);
+		err = record_store(&rec);
+		if (err) {
+			LOG_ERR("Recorder store failed (err %d)", err);
+		}
+	}
+}
+
+K_THREAD_DEFINE(record_thread_id, RECORD_STACKSIZE, record_thread, NULL, NULL, NULL,
+		K_LOWEST_APPLICATION_THREAD_PRIO, 0, 0);
@@ -0,0 +1,59 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+#ifndef CDS_RECORD_H_
+#define CDS_RECORD_H_
+
+/**@file
+ * @defgroup cds_record Task stream recorder
+ * @{
+ * @brief Capture of the frames written to the operation characteristic, for replay.
+ *
+ * Every frame is recorded as received (rejected ones too) with the time since the previous
+ * frame. write_operation() only copies it into a queue, a low-priority thread stores it:
+ *
+ * - CONFIG_CDS_RECORD_FLASH: an FCB ring in the cds_record_partition (or storage_partition)
+ *   flash area, the flash simulator on native_sim. The oldest sector is erased when the ring
+ *   is full. With CONFIG_CDS_RECORD_DUMP the capture is printed as "RC <delta_us> <lost> <hex>"
+ *   lines on boot and erased.
+ * - CONFIG_CDS_RECORD_TRACE: calc_trace records, a CALC_TRACE_FRAME header followed by
+ *   CALC_TRACE_FRAME_DATA records of 6 frame bytes each.
+ *
+ * scripts/cds_capture.py turns either console output into a capture file, a sequence of
+ * CDS_RECORD_HDR_LEN headers [delta_us le32][frame length le16][frames lost before it le16],
+ * each followed by the frame. The replay suite of the benchmark application feeds a capture back
+ * into the engine.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <zephyr/types.h>
+
+#define CDS_RECORD_HDR_LEN 8
+#define CDS_RECORD_FRAME_MAX (CONFIG_BT_L2CAP_TX_MTU - 3)  // Largest ATT write
+
+#if defined(CONFIG_CDS_RECORD)
+/** @brief Record a frame written to the operation characteristic (BT RX thread).
+ *
+ * Never blocks, the frame is counted as lost when the recorder queue is full.
+ */
+void cds_record_frame(const void *frame, uint16_t len);
+#else
+static inline void cds_record_frame(const void *frame, uint16_t len) {}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* CDS_RECORD_H_ */
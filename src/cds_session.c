@@ -0,0 +1,376 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief Client session resume
+ */
+
+#include <zephyr/types.h>
+#include <string.h>
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/addr.h>
+#include <zephyr/bluetooth/conn.h>
+#include "cds_session.h"
+#include "my_cds.h"
+
+LOG_MODULE_DECLARE(BLE_Calculator_App);
+
+#define SESSION_RESULTS CONFIG_CDS_SESSION_RESULTS
+
+BUILD_ASSERT(CONFIG_CDS_SESSION_PEERS < 16, "Session tags take the upper origin nibble");
+
+struct cds_session {
+	bt_addr_le_t addr;						// Identity address of the client
+	struct k_work_delayable expiry;
+	struct cds_session_regs regs;			// Parked registers (engine thread)
+	int64_t left;							// k_uptime_get() when the link dropped
+	uint32_t next;							// Sequence number of the next result
+	uint32_t sent;							// Next result to notify
+	uint8_t gen;							// Incremented when the slot is reused, origin_gen
+	bool used;
+	bool connected;
+	bool paused;							// Kept results wait for CDS_SESSION_RESUME
+	bool resumed;							// Kept when the client connected
+	ReturnValue results[SESSION_RESULTS];	// Result seq in results[seq % SESSION_RESULTS]
+};
+
+static struct cds_session sessions[CONFIG_CDS_SESSION_PEERS];
+static struct cds_session *active;  // Session of the connected client
+static struct k_spinlock session_lock;
+static K_MUTEX_DEFINE(send_lock);  // One notifier at a time, the results go out in sequence
+static int engine_slot = -1;  // Registers held by the engine (engine thread)
+static uint8_t engine_gen;
+// -------------------------------------------------------------------------------------------------
+
+static uint32_t oldest(const struct cds_session *s)
+{
+	return s->next - MIN(s->next, SESSION_RESULTS);
+}
+
+// Notify the kept results from s->sent on, while the client is connected and subscribed
+static int session_send(struct cds_session *s)
+{
+	static ReturnValue run[CDS_NOTIFY_MAX_RESULTS];  // Under send_lock
+	k_spinlock_key_t key;
+	uint32_t start;
+	size_t count;
+	int err = 0;
+
+	k_mutex_lock(&send_lock, K_FOREVER);
+	while (!err) {
+		key = k_spin_lock(&session_lock);
+		if (!s->connected || s->paused || s->sent == s->next) {
+			k_spin_unlock(&session_lock, key);
+			break;
+		}
+		// Batched results are packed together as the send_data_thread coalesced them
+		start = s->sent;
+		count = 0;
+		do {
+			run[count] = s->results[(start + count) % SESSION_RESULTS];
+			count++;
+		} while (run[0].batched && count < ARRAY_SIZE(run) && start + count != s->next &&
+			 s->results[(start + count) % SESSION_RESULTS].batched);
+		k_spin_unlock(&session_lock, key);
+
+		err = my_cds_send_result_notify(run, count);
+
+		key = k_spin_lock(&session_lock);
+		if (!err && s->sent == start) {  // Not rewound by a resume meanwhile
+			s->sent = start + count;
+		}
+		k_spin_unlock(&session_lock, key);
+	}
+	k_mutex_unlock(&send_lock);
+	return err;
+}
+
+static void send_active(struct k_work *work)
+{
+	k_spinlock_key_t key = k_spin_lock(&session_lock);
+	struct cds_session *s = active;
+
+	k_spin_unlock(&session_lock, key);
+	if (s) {
+		session_send(s);
+	}
+}
+
+static K_WORK_DEFINE(send_work, send_active);
+
+// Release the jobs and buffers of a freed slot, if the engine still holds them
+static void queue_end(int slot, uint8_t gen)
+{
+	struct calculator_task task = {
+		.operation = CALC_OP_SESSION_RESET,
+		.flags = CDS_TASK_FLAG_SESSION,
+		.origin_gen = gen,
+	};
+
+	if (calc_io_submit(&task, 1, CDS_SESSION_ORIGIN(slot), K_NO_WAIT)) {
+		LOG_WRN("Session %d: task queue full, released with the next client", slot);
+	}
+}
+
+static void session_expired(struct k_work *work)
+{
+	struct cds_session *s = CONTAINER_OF(k_work_delayable_from_work(work), struct cds_session,
+					     expiry);
+	k_spinlock_key_t key = k_spin_lock(&session_lock);
+	bool expired = s->used && !s->connected;
+
+	if (expired) {
+		s->used = false;
+	}
+	k_spin_unlock(&session_lock, key);
+
+	if (expired) {
+		LOG_DBG("Session %d expired", (int)(s - sessions));
+		queue_end(s - sessions, s->gen);
+	}
+}
+
+void cds_session_init(void)
+{
+	for (int i = 0; i < CONFIG_CDS_SESSION_PEERS; i++) {
+		k_work_init_delayable(&sessions[i].expiry, session_expired);
+	}
+}
+
+void cds_session_connected(struct bt_conn *conn)
+{
+	const bt_addr_le_t *addr = bt_conn_get_dst(conn);
+	struct cds_session *s = NULL;
+	bool evicted = false;
+	uint8_t evicted_gen = 0;
+	k_spinlock_key_t key = k_spin_lock(&session_lock);
+
+	for (int i = 0; i < CONFIG_CDS_SESSION_PEERS && !s; i++) {
+		if (sessions[i].used && !sessions[i].connected && bt_addr_le_eq(&sessions[i].addr, addr)) {
+			s = &sessions[i];
+			s->resumed = true;  // Paused since the link dropped
+		}
+	}
+	for (int i = 0; i < CONFIG_CDS_SESSION_PEERS && !s; i++) {
+		if (!sessions[i].used) {
+			s = &sessions[i];
+		}
+	}
+	for (int i = 0; i < CONFIG_CDS_SESSION_PEERS && !s; i++) {
+		if (!sessions[i].connected) {  // Evict the session whose client left first
+			s = &sessions[i];
+			for (int j = i + 1; j < CONFIG_CDS_SESSION_PEERS; j++) {
+				if (!sessions[j].connected && sessions[j].left < s->left) {
+					s = &sessions[j];
+				}
+			}
+			evicted = true;
+		}
+	}
+	if (s && !s->resumed) {
+		evicted_gen = s->gen;
+		bt_addr_le_copy(&s->addr, addr);
+		memset(&s->regs, 0, sizeof(s->regs));
+		s->gen++;
+		s->next = 0;
+		s->sent = 0;
+		s->used = true;
+		s->paused = false;
+	}
+	if (s) {
+		s->connected = true;
+	}
+	active = s;
+	k_spin_unlock(&session_lock, key);
+
+	if (!s) {
+		LOG_WRN("No session slot, results are not kept");
+		return;
+	}
+	k_work_cancel_delayable(&s->expiry);
+	if (evicted) {
+		queue_end(s - sessions, evicted_gen);  // Its queued tasks and results are dropped
+	}
+	LOG_INF("Session %d %s", (int)(s - sessions), s->resumed ? "resumed" : "started");
+}
+
+void cds_session_disconnected(struct bt_conn *conn)
+{
+	k_spinlock_key_t key = k_spin_lock(&session_lock);
+	struct cds_session *s = active;
+
+	if (s) {
+		s->connected = false;
+		s->paused = true;
+		s->resumed = false;
+		s->left = k_uptime_get();
+	}
+	active = NULL;
+	k_spin_unlock(&session_lock, key);
+
+	if (s) {
+		k_work_reschedule(&s->expiry, K_MSEC(CONFIG_CDS_SESSION_RETAIN_MS));
+	}
+}
+
+uint8_t cds_session_submit(uint8_t *gen, uint32_t *seq)
+{
+	uint8_t origin = CALC_IO_BLE;
+	k_spinlock_key_t key = k_spin_lock(&session_lock);
+	const struct cds_session *s = active;
+
+	*gen = 0;
+	*seq = 0;
+	if (s) {
+		origin = CDS_SESSION_ORIGIN(s - sessions);
+		*gen = s->gen;
+		*seq = s->next;
+	}
+	k_spin_unlock(&session_lock, key);
+	return origin;
+}
+
+void cds_session_accepted(uint8_t origin, uint8_t gen, uint32_t seq)
+{
+	int slot = CDS_SESSION_SLOT(origin);
+	k_spinlock_key_t key = k_spin_lock(&session_lock);
+	struct cds_session *s = active;
+	bool flush = false;
+
+	if (s && s - sessions == slot && s->gen == gen && s->paused) {
+		if ((int32_t)(seq - s->sent) > 0) {
+			s->sent = seq;  // Not resumed, the results missed are dropped, not the ones since
+		}
+		s->paused = false;
+		flush = true;
+	}
+	k_spin_unlock(&session_lock, key);
+
+	if (flush) {
+		k_work_submit(&send_work);
+	}
+}
+
+void cds_session_info(uint8_t *value)
+{
+	k_spinlock_key_t key = k_spin_lock(&session_lock);
+	const struct cds_session *s = active;
+
+	value[0] = s && s->resumed;
+	sys_put_le32(s ? s->next : 0, &value[1]);
+	sys_put_le32(s ? oldest(s) : 0, &value[5]);
+	k_spin_unlock(&session_lock, key);
+}
+
+int cds_session_resume(uint32_t seq)
+{
+	int err = 0;
+	k_spinlock_key_t key = k_spin_lock(&session_lock);
+	struct cds_session *s = active;
+
+	if (!s) {
+		err = -ENOTCONN;
+	} else if (seq - oldest(s) > s->next - oldest(s)) {
+		err = -ERANGE;
+	} else {
+		s->sent = seq;
+		s->paused = false;
+	}
+	k_spin_unlock(&session_lock, key);
+
+	if (!err) {
+		k_work_submit(&send_work);
+	}
+	return err;
+}
+
+void cds_session_flush(void)
+{
+	k_work_submit(&send_work);
+}
+
+int cds_session_results(const ReturnValue *results, size_t count)
+{
+	int slot = CDS_SESSION_SLOT(results[0].origin);
+	struct cds_session *s;
+	k_spinlock_key_t key;
+	int err;
+
+	if (slot < 0 || slot >= CONFIG_CDS_SESSION_PEERS) {
+		return my_cds_send_result_notify(results, count);
+	}
+	s = &sessions[slot];
+
+	key = k_spin_lock(&session_lock);
+	if (!s->used || s->gen != results[0].origin_gen) {
+		k_spin_unlock(&session_lock, key);
+		return -ENOTCONN;  // Expired or evicted while the tasks were queued
+	}
+	for (size_t i = 0; i < count; i++) {
+		s->results[s->next % SESSION_RESULTS] = results[i];
+		s->next++;
+	}
+	if (s->next - s->sent > SESSION_RESULTS) {
+		s->sent = s->next - SESSION_RESULTS;  // Overwritten before they were notified
+	}
+	k_spin_unlock(&session_lock, key);
+
+	err = session_send(s);
+	return (err == -EACCES) ? 0 : err;  // Kept until the client subscribes
+}
+// -------------------------------------------------------------------------------------------------
+
+// Engine thread -----------------------------------------------------------------------------------
+bool cds_session_live(uint8_t origin, uint8_t gen)
+{
+	int slot = CDS_SESSION_SLOT(origin);
+	k_spinlock_key_t key;
+	bool live;
+
+	if (slot < 0) {
+		return true;
+	}
+	key = k_spin_lock(&session_lock);
+	live = sessions[slot].used && sessions[slot].gen == gen;
+	k_spin_unlock(&session_lock, key);
+	return live;
+}
+
+bool cds_session_current(uint8_t origin)
+{
+	int slot = CDS_SESSION_SLOT(origin);
+
+	return slot < 0 || (slot == engine_slot && sessions[slot].gen == engine_gen);
+}
+
+bool cds_session_swap(uint8_t origin, struct cds_session_regs *regs)
+{
+	int slot = CDS_SESSION_SLOT(origin);
+	bool held = engine_slot >= 0;
+	k_spinlock_key_t key = k_spin_lock(&session_lock);
+
+	if (held && sessions[engine_slot].used && sessions[engine_slot].gen == engine_gen) {
+		sessions[engine_slot].regs = *regs;  // Not if the slot was reused meanwhile
+	}
+	*regs = sessions[slot].regs;
+	engine_slot = slot;
+	engine_gen = sessions[slot].gen;
+	k_spin_unlock(&session_lock, key);
+	return held;
+}
+
+bool cds_session_release(uint8_t origin, uint8_t gen)
+{
+	if (CDS_SESSION_SLOT(origin) != engine_slot || gen != engine_gen) {
+		return false;  // Parked, the engine holds another session
+	}
+	engine_slot = -1;
+	return true;
+}
+// -------------------------------------------------------------------------------------------------
@@ -0,0 +1,141 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+#ifndef CDS_SESSION_H_
+#define CDS_SESSION_H_
+
+/**@file
+ * @defgroup cds_session Client session resume
+ * @{
+ * @brief Results and registers of a BLE client kept across a dropped link.
+ *
+ * A session is kept per client identity address (bonded clients with a resolvable private
+ * address, or clients with a public or static address). Its tasks carry the session in their
+ * origin (CDS_SESSION_ORIGIN) and the generation of its slot in origin_gen, so their results land
+ * in the session even after the link dropped. The tasks and results of an evicted or expired
+ * session are dropped, they never reach the session that reuses its slot.
+ * Each result gets a sequence number, counted from 0 for a new session, and the last
+ * CONFIG_CDS_SESSION_RESULTS of them are kept.
+ *
+ * When the link drops, the tasks still queued are computed and the session is kept for
+ * CONFIG_CDS_SESSION_RETAIN_MS. A client reconnecting within this time reads the session
+ * characteristic, [resumed u8][next seq le32][oldest seq le32], subscribes to the result
+ * characteristic and writes [CDS_SESSION_RESUME][seq le32] with the number of results it
+ * received. The results from seq on are notified again, followed by the new ones. A resumed
+ * client writing a task without resuming first drops the results it missed.
+ *
+ * The accumulators (CDS_TASK_FLAG_ACC) and the previous task of each session are kept apart.
+ * Standing jobs, buffers and the session arena stay with the client whose tasks ran last: they
+ * are released when the tasks of another client reach the engine, or when the session expires.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <zephyr/types.h>
+#include <zephyr/bluetooth/conn.h>
+#include "calc_engine.h"
+#include "calc_io.h"
+
+#define CDS_SESSION_RESUME   0x01  // [seq le32] Notify the results from seq on
+#define CDS_SESSION_RESUME_LEN 5
+#define CDS_SESSION_INFO_LEN 9     // [resumed][next seq le32][oldest seq le32]
+
+#define CDS_SESSION_ORIGIN(slot) (CALC_IO_BLE | (((slot) + 1) << 4))  // Session tag in the origin
+#define CDS_SESSION_SLOT(origin) (((origin) >> 4) - 1)                 // -1 if untagged
+
+/** @brief Registers of a session, swapped by the engine thread. */
+struct cds_session_regs {
+	struct calc_engine_state acc;
+	struct calculator_task last_task;  // Repeated by CALC_OP_JOB_SET
+};
+
+/** @brief Initialize the session table. */
+void cds_session_init(void);
+
+/** @brief Resume the session of the client, or start a new one (connected callback). */
+void cds_session_connected(struct bt_conn *conn);
+
+/** @brief Keep the session of the client for CONFIG_CDS_SESSION_RETAIN_MS (disconnected callback). */
+void cds_session_disconnected(struct bt_conn *conn);
+
+/** @brief Origin of the tasks of a write of the connected client (BT RX thread).
+ *
+ * @param[out] gen Generation of the session slot, the origin_gen of the tasks.
+ * @param[out] seq Sequence number of the next result, for cds_session_accepted().
+ */
+uint8_t cds_session_submit(uint8_t *gen, uint32_t *seq);
+
+/** @brief The write was decoded and queued (BT RX thread).
+ *
+ * Drops the results before seq that a resumed client did not ask for with CDS_SESSION_RESUME.
+ * Nothing is dropped for a write that was refused.
+ *
+ * @param[in] origin Returned by cds_session_submit() for the write.
+ * @param[in] gen Generation returned with it.
+ * @param[in] seq Sequence number returned with it.
+ */
+void cds_session_accepted(uint8_t origin, uint8_t gen, uint32_t seq);
+
+/** @brief Encode the session characteristic, CDS_SESSION_INFO_LEN bytes. */
+void cds_session_info(uint8_t *value);
+
+/** @brief Notify the results of the connected client from seq on (BT RX thread).
+ *
+ * @retval 0 If the operation was successful.
+ * @retval -ENOTCONN No session.
+ * @retval -ERANGE The result seq is no longer kept, or not computed yet.
+ */
+int cds_session_resume(uint32_t seq);
+
+/** @brief Notify the results kept for the connected client (e.g. once it subscribed). */
+void cds_session_flush(void);
+
+/** @brief Result sink of CALC_IO_BLE (send_data_thread).
+ *
+ * Results of a session are kept and notified while its client is connected and subscribed,
+ * untagged results are passed to my_cds_send_result_notify().
+ */
+int cds_session_results(const ReturnValue *results, size_t count);
+
+/** @brief Whether the session of a task is still kept, not expired or evicted (engine thread).
+ *
+ * Untagged origins are always live.
+ */
+bool cds_session_live(uint8_t origin, uint8_t gen);
+
+/** @brief Whether the engine holds the registers of the session of origin (engine thread).
+ *
+ * Untagged origins (shell, UART, self-benchmark) use the registers held.
+ */
+bool cds_session_current(uint8_t origin);
+
+/** @brief Park the registers held by the engine and take the ones of origin (engine thread).
+ *
+ * @param[in] origin Tagged origin of the task about to run.
+ * @param[in,out] regs Registers of the engine, replaced by the ones of the session of origin.
+ *
+ * @retval true The engine held another session, its jobs and buffers are to be released.
+ */
+bool cds_session_swap(uint8_t origin, struct cds_session_regs *regs);
+
+/** @brief Forget the session of origin in the engine (engine thread, CDS_TASK_FLAG_SESSION).
+ *
+ * @retval true The engine held it, its jobs and buffers are to be released.
+ */
+bool cds_session_release(uint8_t origin, uint8_t gen);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* CDS_SESSION_H_ */
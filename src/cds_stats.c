@@ -0,0 +1,128 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief CDS runtime statistics
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include "cds_stats.h"
+
+extern struct k_msgq calculator_msgq;
+extern const k_tid_t calculator_engine_thread_id;
+extern const k_tid_t send_data_thread_id;
+
+// Counted from the BT RX thread, the job timers, the engine and the send threads
+static atomic_t received;
+static atomic_t dropped;
+static atomic_t computed;
+static atomic_t notify_failed;
+static atomic_t queue_high_water;
+static uint32_t op_counts[CDS_STATS_OPS];  // Engine thread only
+
+#if defined(CONFIG_THREAD_RUNTIME_STATS)
+static uint64_t prev_cycles[2];  // Engine and send threads, at the previous encode, under cpu_lock
+static uint64_t prev_total;
+static struct k_spinlock cpu_lock;  // cds_stats_encode() runs in the read callback and stats_push
+#endif
+// -------------------------------------------------------------------------------------------------
+
+void cds_stats_received(uint32_t count)
+{
+	atomic_val_t used = k_msgq_num_used_get(&calculator_msgq);
+	atomic_val_t high;
+
+	atomic_add(&received, count);
+	do {
+		high = atomic_get(&queue_high_water);
+	} while (used > high && !atomic_cas(&queue_high_water, high, used));
+}
+
+void cds_stats_dropped(uint32_t count)
+{
+	atomic_add(&dropped, count);
+}
+
+void cds_stats_computed(uint8_t operation)
+{
+	atomic_inc(&computed);
+	op_counts[MIN(operation, CDS_STATS_OPS - 1)]++;
+}
+
+void cds_stats_notify_failed(void)
+{
+	atomic_inc(&notify_failed);
+}
+
+// CPU use of the pipeline threads, permille since the previous call
+static void stats_cpu(const k_tid_t tids[2], uint32_t cpu[2])
+{
+	cpu[0] = CDS_STATS_NA;
+	cpu[1] = CDS_STATS_NA;
+
+#if defined(CONFIG_THREAD_RUNTIME_STATS)
+	k_thread_runtime_stats_t thread;
+	k_thread_runtime_stats_t all;
+	k_spinlock_key_t key = k_spin_lock(&cpu_lock);  // Both readers would share one interval
+
+	if (k_thread_runtime_stats_all_get(&all) == 0) {
+		uint64_t total = all.execution_cycles - prev_total;
+
+		for (int i = 0; i < 2; i++) {
+			if (k_thread_runtime_stats_get(tids[i], &thread) == 0) {
+				cpu[i] = (total > 0) ?
+					 (uint32_t)((thread.execution_cycles - prev_cycles[i]) * 1000 / total) : 0;
+				prev_cycles[i] = thread.execution_cycles;
+			}
+		}
+		prev_total = all.execution_cycles;
+	}
+	k_spin_unlock(&cpu_lock, key);
+#endif
+}
+
+// CPU use and stack high-water mark of a pipeline thread
+static void stats_thread(k_tid_t tid, uint32_t cpu, uint8_t *buf)
+{
+	uint32_t stack_used = CDS_STATS_NA;
+	uint32_t stack_size = CDS_STATS_NA;
+
+#if defined(CONFIG_THREAD_ANALYZER)
+	size_t unused;
+
+	if (k_thread_stack_space_get(tid, &unused) == 0) {
+		stack_size = tid->stack_info.size;
+		stack_used = stack_size - unused;
+	}
+#endif
+	sys_put_le32(cpu, &buf[0]);
+	sys_put_le32(stack_used, &buf[4]);
+	sys_put_le32(stack_size, &buf[8]);
+}
+
+void cds_stats_encode(uint8_t *buf)
+{
+	sys_put_le32(atomic_get(&received), &buf[0]);
+	sys_put_le32(atomic_get(&dropped), &buf[4]);
+	sys_put_le32(atomic_get(&computed), &buf[8]);
+	sys_put_le32(atomic_get(&notify_failed), &buf[12]);
+	sys_put_le32(atomic_get(&queue_high_water), &buf[16]);
+	sys_put_le32(calculator_msgq.max_msgs, &buf[20]);
+
+	const k_tid_t tids[2] = { calculator_engine_thread_id, send_data_thread_id };
+	uint32_t cpu[2];
+
+	stats_cpu(tids, cpu);
+	stats_thread(tids[0], cpu[0], &buf[24]);
+	stats_thread(tids[1], cpu[1], &buf[36]);
+
+	for (int i = 0; i < CDS_STATS_OPS; i++) {
+		sys_put_le32(op_counts[i], &buf[48 + i * 4]);
+	}
+}
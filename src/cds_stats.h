@@ -0,0 +1,70 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+#ifndef CDS_STATS_H_
+#define CDS_STATS_H_
+
+/**@file
+ * @defgroup cds_stats CDS runtime statistics
+ * @{
+ * @brief Pipeline counters read from (or pushed by) the CDS stats characteristic.
+ *
+ * The stats value is a sequence of le32 words:
+ *
+ *       0  tasks received          1  tasks dropped (calculator_msgq full)
+ *       2  results computed        3  notifications failed
+ *       4  calculator_msgq high-water mark (tasks)
+ *       5  calculator_msgq size
+ *       6  engine thread CPU use   7  engine thread stack high-water mark (bytes)
+ *       8  engine thread stack size
+ *       9  send thread CPU use    10  send thread stack high-water mark
+ *      11  send thread stack size
+ *      12  per-op task counts, CDS_STATS_OPS words, the last one counts the extension ops
+ *
+ * CPU use is in permille of all cycles since the previous read or push, it needs
+ * CONFIG_THREAD_RUNTIME_STATS. The stack high-water marks need CONFIG_THREAD_ANALYZER.
+ * Unavailable words read CDS_STATS_NA.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <zephyr/types.h>
+#include "my_cds.h"
+
+#define CDS_STATS_OPS (CALC_OP_ARENA_STATS + 2)  // Core opcodes and one bucket for the others
+#define CDS_STATS_WORDS (12 + CDS_STATS_OPS)
+#define CDS_STATS_NA 0xFFFFFFFFu
+
+/** @brief Count tasks accepted into calculator_msgq, and track its high-water mark. */
+void cds_stats_received(uint32_t count);
+
+/** @brief Count tasks dropped because calculator_msgq was full. */
+void cds_stats_dropped(uint32_t count);
+
+/** @brief Count a task calculated by the engine thread. */
+void cds_stats_computed(uint8_t operation);
+
+/** @brief Count a failed result notification. */
+void cds_stats_notify_failed(void);
+
+/** @brief Encode the stats value.
+ *
+ * @param[out] buf Buffer of CDS_STATS_WORDS le32 words.
+ */
+void cds_stats_encode(uint8_t *buf);
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* CDS_STATS_H_ */
@@ -0,0 +1,54 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+#ifndef CDS_TRACING_H_
+#define CDS_TRACING_H_
+
+/**@file
+ * @defgroup cds_tracing Task lifecycle tracing
+ * @{
+ * @brief Named events of the calculator pipeline for the Zephyr tracing subsystem.
+ *
+ * With CONFIG_TRACING (e.g. CTF with the native_sim file backend, see overlay-tracing.conf)
+ * each task emits named events next to the kernel thread switch and ISR events, so a
+ * Trace Compass timeline shows how long tasks wait in calculator_msgq and result_msgq and
+ * what preempts the engine. Without CONFIG_TRACING the hooks compile to nothing.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(CONFIG_TRACING)
+#include <zephyr/tracing/tracing.h>
+
+// write_operation(): frame queued. Operation of the first task, tasks in the frame
+#define CDS_TRACING_ENQUEUE(op, count) sys_trace_named_event("cds_enqueue", (op), (count))
+// calculator_engine_thread: task taken from calculator_msgq. Operation, mode
+#define CDS_TRACING_DEQUEUE(op, mode) sys_trace_named_event("cds_dequeue", (op), (mode))
+// calculator_engine_thread: result ready. Operation, result type
+#define CDS_TRACING_COMPUTED(op, type) sys_trace_named_event("cds_computed", (op), (type))
+// send_data_thread: notification of a batch of results. Results, first result type
+#define CDS_TRACING_NOTIFY_ENTER(count, type) sys_trace_named_event("cds_notify_enter", (count), (type))
+// send_data_thread: notification sent. Results, error
+#define CDS_TRACING_NOTIFY_EXIT(count, err) sys_trace_named_event("cds_notify_exit", (count), (err))
+#else
+#define CDS_TRACING_ENQUEUE(op, count)
+#define CDS_TRACING_DEQUEUE(op, mode)
+#define CDS_TRACING_COMPUTED(op, type)
+#define CDS_TRACING_NOTIFY_ENTER(count, type)
+#define CDS_TRACING_NOTIFY_EXIT(count, err)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+/**
+ * @}
+ */
+
+#endif /* CDS_TRACING_H_ */
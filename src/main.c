@@ -20,6 +20,24 @@
 #include <zephyr/bluetooth/conn.h>  	// Header file for managing Bluetooth LE Connections
 #include <dk_buttons_and_leds.h>    	// Header file for buttons and LEDs on a Nordic devkit
 #include "my_cds.h"    					// Header file of custom Calculator Data Service
+#include "calc_func.h"				// Function store, loaded from flash at startup
+#include "cds_stats.h"				// Pipeline counters of the stats characteristic
+#include "calc_trace.h"				// Binary event trace, instead of printk in the threads
+#include "calc_engine.h"			// Calculator engine library (lib/calc_engine)
+#include "calc_io.h"				// Transports sharing the pipeline (CDS, shell, UART)
+#include "cds_tracing.h"			// Named events for CONFIG_TRACING (CTF)
+#if defined(CONFIG_CDS_LATENCY)
+#include "calc_latency.h"			// Pipeline stage latency histograms
+#endif
+#if defined(CONFIG_CDS_EXT)
+#include "calc_ext.h"				// Loadable operation kernels
+#endif
+#if defined(CONFIG_CDS_UART)
+#include "calc_uart.h"				// Binary UART transport
+#endif
+#if defined(CONFIG_CDS_SESSION)
+#include "cds_session.h"			// Client sessions kept across reconnects
+#endif
 
 static struct bt_le_adv_param *adv_param = BT_LE_ADV_PARAM(
 	(BT_LE_ADV_OPT_CONNECTABLE |
@@ -30,14 +48,13 @@ static struct bt_le_adv_param *adv_param = BT_LE_ADV_PARAM(
 
 LOG_MODULE_REGISTER(BLE_Calculator_App, LOG_LEVEL_INF);
 
-// Semaphor ----------------------------------------------------------------------------------------
-K_SEM_DEFINE(result_sem, 0, 1);
-extern struct k_sem result_sem;
 // Message queue -----------------------------------------------------------------------------------
-#define CALC_MSGQ_MAX_MSGS 10
+#define CALC_MSGQ_MAX_MSGS CONFIG_CDS_TASK_QUEUE_LEN  // A single write may carry a batch of tasks
 #define CALC_MSGQ_MSG_SIZE sizeof(struct calculator_task)
 K_MSGQ_DEFINE(calculator_msgq, CALC_MSGQ_MSG_SIZE, CALC_MSGQ_MAX_MSGS, 4);
 extern struct k_msgq calculator_msgq;
+// Result queue (calculator_engine_thread -> send_data_thread) -------------------------------------
+K_MSGQ_DEFINE(result_msgq, sizeof(ReturnValue), CONFIG_CDS_RESULT_QUEUE_LEN, 4);
 // -------------------------------------------------------------------------------------------------
 
 #define DEVICE_NAME CONFIG_BT_DEVICE_NAME
@@ -64,8 +81,6 @@ typedef struct adv_mfg_data {
 static adv_mfg_data_type adv_mfg_data = { COMPANY_ID_CODE, 0x00 };
 // -------------------------------------------------------------------------------------------------
 
-static ReturnValue app_result_value;  // Data to notify over BLE
-
 // Create the advertising parameter for connectable advertising ------------------------------------
 static const struct bt_data ad[] = {
 	// Set the flags and populate the device name in the advertising packet
@@ -91,6 +106,34 @@ static void app_mode_cb(bool mode_state) // Mode (float or fixed) LED indicator
 static struct my_cds_cb app_callbacks = {
 	.mode_cb = app_mode_cb,
 };
+
+// Intermediate results of multi-result operations, ahead of the result of the engine thread
+static void engine_emit(const ReturnValue *result)
+{
+	ReturnValue queued = *result;
+
+#if defined(CONFIG_CDS_LATENCY)
+	queued.t_done = k_cycle_get_32();
+#endif
+	k_msgq_put(&result_msgq, &queued, K_FOREVER);
+}
+
+BUILD_ASSERT(CALC_ENGINE_LOG_DIV_ZERO == CALC_TRACE_DIV_ZERO &&
+	     CALC_ENGINE_LOG_OVERFLOW == CALC_TRACE_OVERFLOW &&
+	     CALC_ENGINE_LOG_OP_ERROR == CALC_TRACE_OP_ERROR);
+
+static void engine_log(uint8_t event, uint8_t mode, uint8_t operation, int32_t value)
+{
+	calc_trace(event, mode, operation, value);
+}
+
+static const struct calc_engine_ops engine_ops = {
+	.emit = engine_emit,
+	.log = engine_log,
+#if defined(CONFIG_CDS_EXT)
+	.ext = calc_ext_execute,
+#endif
+};
 // ----------- END: Callback functions -------------------------------------------------------------
 
 
@@ -102,12 +145,20 @@ static void on_connected(struct bt_conn *conn, uint8_t err)
 		return;
 	}
 	printk("** Connected! **\n");
+#if defined(CONFIG_CDS_SESSION)
+	cds_session_connected(conn);  // Resume the session of a returning client
+#endif
 	dk_set_led_on(CON_STATUS_LED);  // Turn the connection status LED on
 }
 
 static void on_disconnected(struct bt_conn *conn, uint8_t reason)
 {
 	printk("** Disconnected (reason %u) **\n", reason);
+#if defined(CONFIG_CDS_SESSION)
+	cds_session_disconnected(conn);  // Kept for CONFIG_CDS_SESSION_RETAIN_MS, queued tasks still run
+#else
+	my_cds_session_end();  // Release the session arena and stop the jobs
+#endif
 	dk_set_led_off(CON_STATUS_LED);  // Turn the connection status LED off
 }
 
@@ -115,18 +166,51 @@ struct bt_conn_cb connection_callbacks = {
 	.connected = on_connected,
 	.disconnected = on_disconnected,
 };
+
+#if defined(CONFIG_CDS_EXT)
+// Extensions run native code, their characteristic needs an authenticated (passkey) pairing
+static void auth_passkey_display(struct bt_conn *conn, unsigned int passkey)
+{
+	printk("Passkey: %06u\n", passkey);
+}
+
+static void auth_cancel(struct bt_conn *conn)
+{
+	printk("Pairing cancelled\n");
+}
+
+static struct bt_conn_auth_cb auth_callbacks = {
+	.passkey_display = auth_passkey_display,
+	.cancel = auth_cancel,
+};
+#endif
 // ----------- END: Connection Callback functions --------------------------------------------------
 
 
 // ----------- Thread functions --------------------------------------------------------------------
 void send_data_thread(void)
 {
-    while (1) {
-        k_sem_take(&result_sem, K_FOREVER);  // Wait for the semaphore
+    static ReturnValue results[CDS_NOTIFY_MAX_RESULTS];  // Data to notify over BLE (or to the shell)
+    ReturnValue next;
+    size_t count;
 
-        int err = my_cds_send_result_notify(app_result_value);
+    while (1) {
+        k_msgq_get(&result_msgq, &results[0], K_FOREVER);  // Wait for the first result
+        count = 1;
+
+        // Batched results are streamed: coalesce the ones already queued into a single notification
+        while (results[0].batched && count < ARRAY_SIZE(results) &&
+               k_msgq_peek(&result_msgq, &next) == 0 && next.batched &&
+               next.origin == results[0].origin && next.origin_gen == results[0].origin_gen) {
+            k_msgq_get(&result_msgq, &results[count++], K_NO_WAIT);
+        }
+
+        CDS_TRACING_NOTIFY_ENTER(count, results[0].type);
+        int err = calc_io_send(results, count);  // Sink of the transport the tasks came from
+        CDS_TRACING_NOTIFY_EXIT(count, err);
+		calc_trace(CALC_TRACE_NOTIFY, MIN(count, UINT8_MAX), results[0].type, err);
 		if (err) {
-			LOG_ERR("Failed to send notification (err %d)\n", err);
+			cds_stats_notify_failed();
 		}
     }
 }
@@ -134,12 +218,29 @@ void send_data_thread(void)
 void calculator_engine_thread(void)
 {
     struct calculator_task task;
+    ReturnValue result;
 
     while (1) {
         // Wait indefinitely for data
         k_msgq_get(&calculator_msgq, &task, K_FOREVER);  // Get the task from the message queue
-        app_result_value = my_cds_calculate_result(task);// Perform calculations based on the task
-        k_sem_give(&result_sem);  // Set semaphore to notify the send_data_thread that the result is ready
+        CDS_TRACING_DEQUEUE(task.operation, task.mode);
+#if defined(CONFIG_CDS_LATENCY)
+        uint32_t t_deq = k_cycle_get_32();
+#endif
+        result = my_cds_calculate_result(task);  // Perform calculations based on the task
+        CDS_TRACING_COMPUTED(task.operation, result.type);
+        cds_stats_computed(task.operation);
+        result.origin = task.origin;
+        result.origin_gen = task.origin_gen;
+#if defined(CONFIG_CDS_LATENCY)
+        result.t_rx = task.t_rx;
+        result.t_done = k_cycle_get_32();
+        calc_latency_record(CALC_LAT_QUEUE, task.t_rx, t_deq);
+        calc_latency_record(CALC_LAT_COMPUTE, t_deq, result.t_done);
+#endif
+        if (result.type != NONE_TYPE) {
+            k_msgq_put(&result_msgq, &result, K_FOREVER);  // Hand the result over to the send_data_thread
+        }
     }
 }
 // ----------- END: Thread functions ---------------------------------------------------------------
@@ -160,12 +261,25 @@ int main(void)
 		return -1;
 	}
 
+	calc_engine_set_ops(&engine_ops);
+	err = calc_func_init();  // Persisted function tables, before the engine gets any task
+	if (err) {
+		LOG_ERR("Function store init failed (err %d)\n", err);
+	}
+
 	err = bt_enable(NULL);
 	if (err) {
 		LOG_ERR("Bluetooth init failed (err %d)\n", err);
 		return -1;
 	}
 	bt_conn_cb_register(&connection_callbacks);  // Register connection callbacks
+#if defined(CONFIG_CDS_EXT)
+	err = bt_conn_auth_cb_register(&auth_callbacks);  // Passkey pairing for extension uploads
+	if (err) {
+		LOG_ERR("Auth callbacks failed (err %d)\n", err);
+		return -1;
+	}
+#endif
 	// Pass application callback functions stored in app_callbacks to the Calculator Service
 	err = my_cds_init(&app_callbacks);
 	if (err) {
@@ -175,6 +289,13 @@ int main(void)
 	
 	LOG_INF("Bluetooth initialized\n");
 
+#if defined(CONFIG_CDS_UART)
+	err = calc_uart_init();  // Wired hosts, next to the BLE clients
+	if (err) {
+		LOG_ERR("UART transport init failed (err %d)\n", err);
+	}
+#endif
+
 	err = bt_le_adv_start(adv_param, ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
 	if (err) {
 		LOG_ERR("Advertising failed to start (err %d)\n", err);
@@ -22,14 +22,39 @@
 #include <zephyr/bluetooth/uuid.h>
 #include <zephyr/bluetooth/gatt.h>  // GATT (Generic Attribute Profile) header
 #include "my_cds.h"
+#include "cds_codec.h"
+#include "calc_vec.h"
+#include "calc_jobs.h"
+#include "calc_io.h"
+#include "cds_stats.h"
+#include "calc_trace.h"
+#include "cds_record.h"
+#if defined(CONFIG_CDS_LATENCY)
+#include "calc_latency.h"
+#endif
+#if defined(CONFIG_CDS_EXT)
+#include "calc_ext.h"
+#endif
+#if defined(CONFIG_CDS_BENCH)
+#include "calc_bench.h"
+#endif
+#if defined(CONFIG_CDS_SESSION)
+#include "cds_session.h"
+#endif
 
 LOG_MODULE_DECLARE(BLE_Calculator_App);
 
 // -------------------------------------------------------------------------------------------------
 static bool notify_result_enabled;
 static struct my_cds_cb  cds_cb;
+static uint16_t notify_payload_max = BT_ATT_DEFAULT_LE_MTU - 3;  // ATT MTU minus opcode and handle
+// Client writes in calculator_msgq. The ones queued before the link dropped are skipped by the
+// engine thread, the tasks of the other transports stay queued (my_cds_session_end).
+static struct k_spinlock ble_queue_lock;
+static uint32_t ble_queued;  // Queued by my_cds_submit_write, not dequeued yet
+static uint32_t ble_stale;   // Of them, the ones of the closed session
+static bool engine_shared;   // A wired transport ran tasks since the buffers were last released
 // -------------------------------------------------------------------------------------------------
-extern struct k_sem result_sem;  // Semaphor
 extern struct k_msgq calculator_msgq;  // Message queue
 // -------------------------------------------------------------------------------------------------
 
@@ -37,56 +62,305 @@ extern struct k_msgq calculator_msgq;  // Message queue
 static void mycdsbc_ccc_result_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value)
 {
 	notify_result_enabled = (value == BT_GATT_CCC_NOTIFY);  // Check if notifications are enabled
+	if (!notify_result_enabled) {
+		notify_payload_max = BT_ATT_DEFAULT_LE_MTU - 3;  // Unsubscribed or disconnected
+	}
+#if defined(CONFIG_CDS_SESSION)
+	if (notify_result_enabled) {
+		cds_session_flush();  // Results computed before the client subscribed
+	}
+#endif
+}
+
+// Stats characteristic, pushed every CONFIG_CDS_STATS_PERIOD_MS while notifications are enabled
+static void stats_push(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(stats_work, stats_push);
+static bool notify_stats_enabled;
+
+static void mycds_ccc_stats_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+	notify_stats_enabled = (value == BT_GATT_CCC_NOTIFY);
+	if (notify_stats_enabled && CONFIG_CDS_STATS_PERIOD_MS > 0) {
+		k_work_reschedule(&stats_work, K_MSEC(CONFIG_CDS_STATS_PERIOD_MS));
+	} else {
+		k_work_cancel_delayable(&stats_work);
+	}
+}
+
+static ssize_t read_stats(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf,
+			  uint16_t len, uint16_t offset)
+{
+	static uint8_t value[CDS_STATS_WORDS * sizeof(uint32_t)];  // Kept for the long read continuation
+
+	if (offset == 0) {
+		cds_stats_encode(value);
+	}
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, value, sizeof(value));
+}
+
+// Track the negotiated ATT MTU, coalesced notifications are sized from it
+static void mycds_att_mtu_updated(struct bt_conn *conn, uint16_t tx, uint16_t rx)
+{
+	notify_payload_max = MIN(tx, rx) - 3;
+}
+
+static struct bt_gatt_cb gatt_callbacks = {
+	.att_mtu_updated = mycds_att_mtu_updated,
+};
+
+int my_cds_submit_write(struct calculator_task *tasks, int count)
+{
+	uint8_t origin = CALC_IO_BLE;
+	k_spinlock_key_t key;
+
+#if defined(CONFIG_CDS_SESSION)
+	uint8_t gen;
+	uint32_t seq;
+
+	origin = cds_session_submit(&gen, &seq);  // Results are kept in the session of the client
+	for (int i = 0; i < count; i++) {
+		tasks[i].origin_gen = gen;
+	}
+#endif
+	key = k_spin_lock(&ble_queue_lock);
+	ble_queued += count;  // Before the engine thread can dequeue them
+	k_spin_unlock(&ble_queue_lock, key);
+	if (calc_io_submit(tasks, count, origin, K_NO_WAIT)) {  // Accept the whole frame or nothing
+		key = k_spin_lock(&ble_queue_lock);
+		ble_queued -= count;
+		k_spin_unlock(&ble_queue_lock, key);
+		return -ENOMEM;
+	}
+#if defined(CONFIG_CDS_SESSION)
+	cds_session_accepted(origin, gen, seq);
+#endif
+	return 0;
 }
 
 static ssize_t write_operation(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf,
 			 uint16_t len, uint16_t offset, uint8_t flags)
 {	
-    LOG_DBG("Attribute write, handle: %u, conn: %p", attr->handle, (void *)conn);
+	static struct calculator_task tasks[CONFIG_CDS_TASK_QUEUE_LEN];  // Decoded frame (BT RX thread only)
 
-	if (len != sizeof(struct calculator_task)) { 
-		LOG_DBG("Write operation: Incorrect data length");
-		return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
-	}
+    LOG_DBG("Attribute write, handle: %u, conn: %p", attr->handle, (void *)conn);
 
 	if (offset != 0) {
 		LOG_DBG("Write operation: Incorrect data offset");
 		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
 	}
-	// Cast the buffer to the calculator_task struct
-    struct calculator_task *task = (struct calculator_task *)buf;  // Read the received value
+	cds_record_frame(buf, len);  // As received, rejected frames are replayed too
 
-	// Unused
-	// struct calculator_task *task;
-    // memcpy(task, buf, sizeof(task));  // Copy the received data into the task variable
+	// Legacy 10-byte task, batch of 6-byte FP16 tasks or a versioned compact frame
+	int count = cds_codec_decode(buf, len, tasks, ARRAY_SIZE(tasks));
 
-/*	// Display the contents of the struct
-	printk("Operation: %u\n", task->operation);
-	if (task->mode) {
-		printk("Float Operand 1: %f\n", task.f_operand_1);
-		printk("Float Operand 2: %f\n", task.f_operand_2);
-	} else {
-		printk("Float Operand: %f\n", task->f_operand);
+	if (count == -ENOMEM) {
+		LOG_DBG("Write operation: Too many tasks");
+		return BT_GATT_ERR(BT_ATT_ERR_INSUFFICIENT_RESOURCES);
+	} else if (count <= 0) {
+		LOG_DBG("Write operation: Malformed frame");
+		return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
 	}
-	printk("Mode: %u\n", task->mode);
-	printk("----------------\n");
-*/
-    k_msgq_put(&calculator_msgq, task, K_NO_WAIT);  // Put the task into the message queue
 
-	// LED mode indicator: LED on: FIXED_MODE, LED off: FLOAT_MODE
+	if (my_cds_submit_write(tasks, count)) {
+		LOG_DBG("Write operation: Task queue full");
+		return BT_GATT_ERR(BT_ATT_ERR_INSUFFICIENT_RESOURCES);
+	}
+
+	// LED mode indicator: LED on: fixed-point modes, LED off: FLOAT_MODE/HALF_MODE/COMPLEX_FLOAT_MODE
 	if (cds_cb.mode_cb) {
-		if (task->mode == FLOAT_MODE || task->mode == FIXED_MODE) {
-			// Call the application callback function to update the mode state
-			cds_cb.mode_cb(task->mode ? true : false);  // LED on when FIXED_MODE
-		} else {
-			LOG_DBG("Write mode: Incorrect value");
-			return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
-		}
+		uint8_t mode = tasks[count - 1].mode;
+
+		// Call the application callback function to update the mode state
+		cds_cb.mode_cb(mode != FLOAT_MODE && mode != HALF_MODE &&
+			       mode != COMPLEX_FLOAT_MODE);  // LED on when fixed-point
 	}
 
 	return len;  // Return the length of the received data
 }
 
+// Operand buffer upload: DEFINE and DATA records, DATA records may arrive as long (prepared) writes
+static ssize_t write_buffer(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf,
+			 uint16_t len, uint16_t offset, uint8_t flags)
+{
+	static uint8_t data_hdr[CALC_BUF_DATA_HDR_LEN];  // Header of the DATA record being written
+	const uint8_t *data = buf;
+	size_t payload_offset;
+	int err;
+
+	if (flags & BT_GATT_WRITE_FLAG_PREPARE) {
+		return 0;  // Checked when the queued writes are executed
+	}
+
+	if (offset == 0) {
+		if (len == CALC_BUF_DEFINE_LEN && data[0] == CALC_BUF_DEFINE) {
+			data_hdr[0] = CALC_BUF_DEFINE;  // No DATA record to continue
+			err = calc_vec_define(data[1], data[2], sys_get_le16(&data[3]), sys_get_le16(&data[5]));
+			if (err) {
+				LOG_DBG("Write buffer: Define failed (err %d)", err);
+				return BT_GATT_ERR((err == -ENOMEM) ? BT_ATT_ERR_INSUFFICIENT_RESOURCES
+								 : BT_ATT_ERR_VALUE_NOT_ALLOWED);
+			}
+			return len;
+		}
+		if (len < CALC_BUF_DATA_HDR_LEN || data[0] != CALC_BUF_DATA) {
+			LOG_DBG("Write buffer: Incorrect record");
+			return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+		}
+		memcpy(data_hdr, data, sizeof(data_hdr));
+		data += CALC_BUF_DATA_HDR_LEN;
+		payload_offset = 0;
+	} else if (data_hdr[0] == CALC_BUF_DATA && offset >= CALC_BUF_DATA_HDR_LEN) {
+		payload_offset = offset - CALC_BUF_DATA_HDR_LEN;  // Continuation of a long write
+	} else {
+		LOG_DBG("Write buffer: Incorrect data offset");
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+
+	err = calc_vec_write(data_hdr[1], sys_get_le16(&data_hdr[2]) * sizeof(int32_float_union) + payload_offset,
+			     data, len - (data - (const uint8_t *)buf));
+	if (err) {
+		LOG_DBG("Write buffer: Data outside the buffer");
+		return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+	}
+
+	return len;
+}
+
+#if defined(CONFIG_CDS_LATENCY)
+static bool notify_timestamps;  // Append the device time in us to each notification
+
+// Per-stage latency summaries, CALC_LAT_STAGES x (count, p50, p99, max) in us
+static ssize_t read_diag(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf,
+			 uint16_t len, uint16_t offset)
+{
+	uint8_t value[CALC_LAT_STAGES * sizeof(struct calc_latency_summary)];
+	struct calc_latency_summary summary;
+
+	for (int i = 0; i < CALC_LAT_STAGES; i++) {
+		calc_latency_summary(i, &summary);
+		sys_put_le32(summary.count, &value[i * sizeof(summary)]);
+		sys_put_le32(summary.p50_us, &value[i * sizeof(summary) + 4]);
+		sys_put_le32(summary.p99_us, &value[i * sizeof(summary) + 8]);
+		sys_put_le32(summary.max_us, &value[i * sizeof(summary) + 12]);
+	}
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, value, sizeof(value));
+}
+
+static ssize_t write_diag(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf,
+			  uint16_t len, uint16_t offset, uint8_t flags)
+{
+	const uint8_t *data = buf;
+
+	if (offset != 0) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+	if (len == 1 && data[0] == CALC_DIAG_RESET) {
+		calc_latency_reset();
+	} else if (len == 2 && data[0] == CALC_DIAG_TIMESTAMPS) {
+		notify_timestamps = data[1] != 0;
+	} else {
+		LOG_DBG("Write diagnostics: Incorrect record");
+		return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+	}
+	return len;
+}
+#endif
+
+#if defined(CONFIG_CDS_EXT)
+// Extension upload: BEGIN, DATA (one write each, up to the ATT MTU), LOAD and UNLOAD records
+static ssize_t write_ext(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf,
+			 uint16_t len, uint16_t offset, uint8_t flags)
+{
+	const uint8_t *data = buf;
+	int err;
+
+	if (offset != 0 || len == 0) {
+		LOG_DBG("Write extension: Incorrect data offset");
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+
+	if (data[0] == CALC_EXT_BEGIN && len == CALC_EXT_BEGIN_LEN) {
+		err = calc_ext_begin(data[1], sys_get_le32(&data[2]));
+	} else if (data[0] == CALC_EXT_DATA && len > CALC_EXT_DATA_HDR_LEN) {
+		err = calc_ext_data(sys_get_le32(&data[1]), &data[CALC_EXT_DATA_HDR_LEN],
+				    len - CALC_EXT_DATA_HDR_LEN);
+	} else if (data[0] == CALC_EXT_LOAD && len == 1) {
+		err = calc_ext_load();  // Links in the BT RX thread, the engine keeps running
+	} else if (data[0] == CALC_EXT_UNLOAD && len == 2) {
+		err = calc_ext_unload(data[1]);
+	} else {
+		LOG_DBG("Write extension: Incorrect record");
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+	}
+
+	if (err) {
+		LOG_DBG("Write extension: Record %u failed (err %d)", data[0], err);
+		return BT_GATT_ERR((err == -ENOMEM) ? BT_ATT_ERR_INSUFFICIENT_RESOURCES
+						 : BT_ATT_ERR_VALUE_NOT_ALLOWED);
+	}
+	return len;
+}
+#endif
+
+#if defined(CONFIG_CDS_BENCH)
+// Self-benchmark spec, run by the engine thread after the tasks already queued
+static ssize_t write_bench(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf,
+			   uint16_t len, uint16_t offset, uint8_t flags)
+{
+	int err;
+
+	if (offset != 0) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+	err = calc_bench_request(buf, len, CALC_IO_BLE);
+	if (err == -EINVAL) {
+		LOG_DBG("Write bench: Incorrect spec");
+		return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+	} else if (err == -EBUSY) {
+		LOG_DBG("Write bench: Benchmark running");
+		return BT_GATT_ERR(BT_ATT_ERR_PROCEDURE_IN_PROGRESS);
+	} else if (err) {
+		LOG_DBG("Write bench: Task queue full");
+		return BT_GATT_ERR(BT_ATT_ERR_INSUFFICIENT_RESOURCES);
+	}
+	return len;
+}
+#endif
+
+#if defined(CONFIG_CDS_SESSION)
+// Session of the connected client, [resumed][next seq le32][oldest seq le32]
+static ssize_t read_session(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf,
+			    uint16_t len, uint16_t offset)
+{
+	uint8_t value[CDS_SESSION_INFO_LEN];
+
+	cds_session_info(value);
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, value, sizeof(value));
+}
+
+// Resume a kept session from the number of results the client received
+static ssize_t write_session(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf,
+			     uint16_t len, uint16_t offset, uint8_t flags)
+{
+	const uint8_t *data = buf;
+	int err;
+
+	if (offset != 0) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+	if (len != CDS_SESSION_RESUME_LEN || data[0] != CDS_SESSION_RESUME) {
+		LOG_DBG("Write session: Incorrect record");
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+	}
+	err = cds_session_resume(sys_get_le32(&data[1]));
+	if (err) {
+		LOG_DBG("Write session: Resume failed (err %d)", err);
+		return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+	}
+	return len;
+}
+#endif
+
 // GATT Calculator Data Service (CDS) Declaration --------------------------------------------------
 BT_GATT_SERVICE_DEFINE(  // Statically add the service to the attributes table of our board (the GATT server) 
 	my_cds_svc, BT_GATT_PRIMARY_SERVICE(BT_UUID_CDS),  // Primary service with a custom UUID
@@ -95,162 +369,394 @@ BT_GATT_SERVICE_DEFINE(  // Statically add the service to the attributes table o
 	BT_GATT_CHARACTERISTIC(BT_UUID_CDS_RESULT, BT_GATT_CHRC_NOTIFY,
 				BT_GATT_PERM_NONE, NULL, NULL, NULL),  // Notify result Characteristic
 	BT_GATT_CCC(mycdsbc_ccc_result_cfg_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(BT_UUID_CDS_BUFFER, BT_GATT_CHRC_WRITE,
+				BT_GATT_PERM_WRITE | BT_GATT_PERM_PREPARE_WRITE, NULL, write_buffer, NULL), // Operand buffer upload Characteristic
+	BT_GATT_CHARACTERISTIC(BT_UUID_CDS_STATS, BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+				BT_GATT_PERM_READ, read_stats, NULL, NULL),  // Runtime statistics Characteristic
+	BT_GATT_CCC(mycds_ccc_stats_cfg_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	COND_CODE_1(CONFIG_CDS_LATENCY, (BT_GATT_CHARACTERISTIC(BT_UUID_CDS_DIAG,
+				BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
+				read_diag, write_diag, NULL),), ())  // Latency diagnostics Characteristic
+	COND_CODE_1(CONFIG_CDS_EXT, (BT_GATT_CHARACTERISTIC(BT_UUID_CDS_EXT, BT_GATT_CHRC_WRITE,
+				BT_GATT_PERM_WRITE_AUTHEN, NULL, write_ext, NULL),), ())  // Extension upload, MITM-paired clients only
+	COND_CODE_1(CONFIG_CDS_BENCH, (BT_GATT_CHARACTERISTIC(BT_UUID_CDS_BENCH,
+				BT_GATT_CHRC_WRITE | BT_GATT_CHRC_NOTIFY, BT_GATT_PERM_WRITE, NULL,
+				write_bench, NULL),
+	BT_GATT_CCC(NULL, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),), ())  // Self-benchmark control Characteristic
+	COND_CODE_1(CONFIG_CDS_SESSION, (BT_GATT_CHARACTERISTIC(BT_UUID_CDS_SESSION,
+				BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
+				read_session, write_session, NULL),), ())  // Session resume Characteristic
 );
 
 // Register application callbacks for the CDS characteristics --------------------------------------
+static void stats_push(struct k_work *work)
+{
+	static uint8_t value[CDS_STATS_WORDS * sizeof(uint32_t)];  // System workqueue only
+
+	if (!notify_stats_enabled) {
+		return;
+	}
+	cds_stats_encode(value);  // As much as the ATT MTU allows, a read returns the per-op counts
+	bt_gatt_notify(NULL, &my_cds_svc.attrs[9], value, MIN(notify_payload_max, sizeof(value)));
+	k_work_reschedule(&stats_work, K_MSEC(CONFIG_CDS_STATS_PERIOD_MS));
+}
+
+#if defined(CONFIG_CDS_BENCH)
+// One notification per benchmarked opcode (system workqueue)
+static void bench_notify(const uint8_t *record, size_t len)
+{
+	const struct bt_gatt_attr *attr = bt_gatt_find_by_uuid(my_cds_svc.attrs, my_cds_svc.attr_count,
+							       BT_UUID_CDS_BENCH);
+
+	bt_gatt_notify(NULL, attr, record, len);
+}
+#endif
+
+static const struct calc_io_sink cds_sink = {
+#if defined(CONFIG_CDS_SESSION)
+	.results = cds_session_results,  // Kept per client, notified through my_cds_send_result_notify()
+#else
+	.results = my_cds_send_result_notify,
+#endif
+#if defined(CONFIG_CDS_BENCH)
+	.bench = bench_notify,
+#endif
+};
+
 int my_cds_init(struct my_cds_cb *callbacks)
 {
 	if (callbacks) {
 		cds_cb.mode_cb = callbacks->mode_cb;
 	}
 
+	bt_gatt_cb_register(&gatt_callbacks);
+#if defined(CONFIG_CDS_SESSION)
+	cds_session_init();
+#endif
+	calc_io_register(CALC_IO_BLE, &cds_sink);
+
 	return 0;
 }
 
 
 // Thread functions --------------------------------------------------------------------------------
+#if defined(CONFIG_CDS_LATENCY)
+#define NOTIFY_STAMPS CONFIG_BT_CONN_TX_MAX  // Notifications in flight at most
+
+struct notify_stamp {
+	uint32_t t_rx;
+	uint32_t t_done;
+	atomic_t busy;  // Until notify_sent()
+};
+
+static struct notify_stamp notify_stamps[NOTIFY_STAMPS];
+static uint8_t notify_stamp_next;  // send_data_thread only
+static atomic_t notify_stamps_skipped;  // Notifications sent without a stamp, all stamps busy
+
+// Notification sent (BT TX context): last pipeline stage of the results it carried
+static void notify_sent(struct bt_conn *conn, void *user_data)
+{
+	struct notify_stamp *stamp = user_data;
+	uint32_t now = k_cycle_get_32();
+
+	calc_latency_record(CALC_LAT_NOTIFY, stamp->t_done, now);
+	calc_latency_record(CALC_LAT_TOTAL, stamp->t_rx, now);
+	atomic_clear(&stamp->busy);
+}
+#endif
+
+// Notify a payload of the result characteristic, 'last' is the last result it carries
+static int notify_result(const void *data, uint16_t len, const ReturnValue *last)
+{
+#if defined(CONFIG_CDS_LATENCY)
+	static uint8_t stamped[CDS_NOTIFY_MAX_RESULTS * sizeof(int32_t) + sizeof(uint32_t)];
+	struct notify_stamp *stamp = &notify_stamps[notify_stamp_next];
+	struct bt_gatt_notify_params params = {
+		.attr = &my_cds_svc.attrs[4],
+		.data = data,
+		.len = len,
+	};
+	int err;
+
+	if (atomic_cas(&stamp->busy, 0, 1)) {
+		notify_stamp_next = (notify_stamp_next + 1) % NOTIFY_STAMPS;
+		stamp->t_rx = last->t_rx;
+		stamp->t_done = last->t_done;
+		params.func = notify_sent;
+		params.user_data = stamp;
+	} else {  // Not recorded rather than overwrite the stamp of a notification in flight
+		LOG_DBG("Notification not stamped (%ld skipped)", atomic_inc(&notify_stamps_skipped) + 1);
+		stamp = NULL;
+	}
+	if (notify_timestamps) {  // Device time for one-way latency measurements on the client
+		memcpy(stamped, data, len);
+		sys_put_le32(k_cyc_to_us_floor32(k_cycle_get_32()), &stamped[len]);
+		params.data = stamped;
+		params.len = len + sizeof(uint32_t);
+	}
+	err = bt_gatt_notify_cb(NULL, &params);
+	if (err && stamp) {
+		atomic_clear(&stamp->busy);  // notify_sent() is not called
+	}
+	return err;
+#else
+	return bt_gatt_notify(NULL, &my_cds_svc.attrs[4], data, len);
+#endif
+}
+
 // Function to send notifications for the result characteristic (send_data_thread) -----------------
-int my_cds_send_result_notify(ReturnValue result_value)
+int my_cds_send_result_notify(const ReturnValue *results, size_t count)
 {
 	if (!notify_result_enabled) {
 		return -EACCES;
 	}
-	printk("...notifying...");
-	if (result_value.type == FLOAT_TYPE) {
-		float result_f = result_value.value.f;
-		printk("Result = %f\n\n", result_value.value.f);
-		return bt_gatt_notify(NULL, &my_cds_svc.attrs[4], &result_f, sizeof(result_f));
-	} else if (result_value.type == INT32_TYPE) {
-		int32_t result_u = result_value.value.u;
-		printk("Result = %d\n\n", result_value.value.u);
-		return bt_gatt_notify(NULL, &my_cds_svc.attrs[4], &result_u, sizeof(result_u));
+	if (results[0].batched) {
+		static uint8_t payload[CDS_NOTIFY_MAX_RESULTS * sizeof(int32_t)];
+		size_t payload_max = MIN(notify_payload_max, sizeof(payload));
+
+#if defined(CONFIG_CDS_LATENCY)
+		if (notify_timestamps) {
+			payload_max = MIN(notify_payload_max - sizeof(uint32_t), sizeof(payload));
+		}
+#endif
+		size_t pos = 0;
+		int err = 0;
+
+		// Pack at native width, flush whenever the next result would not fit in the ATT MTU
+		for (size_t i = 0; i < count && !err; i++) {
+			size_t width = (results[i].type == HALF_TYPE || results[i].type == INT16_TYPE) ?
+				       sizeof(uint16_t) : sizeof(int32_t);
+
+			if (pos + width > payload_max) {
+				err = notify_result(payload, pos, &results[i - 1]);
+				pos = 0;
+			}
+			if (width == sizeof(uint16_t)) {
+				sys_put_le16((uint16_t)results[i].value.u, &payload[pos]);
+			} else {
+				sys_put_le32((uint32_t)results[i].value.u, &payload[pos]);
+			}
+			pos += width;
+		}
+		if (!err) {
+			err = notify_result(payload, pos, &results[count - 1]);
+		}
+		return err;
+	}
+
+	ReturnValue result_value = results[0];  // Not coalesced, one result per notification
+
+	if (result_value.type == FLOAT_TYPE || result_value.type == INT32_TYPE ||
+	    result_value.type == INT16_TYPE) {
+		int32_t result_u = result_value.value.u;  // Float bit pattern, no FPU use in this thread
+
+		calc_trace(CALC_TRACE_RESULT, result_value.type, 0, result_u);
+		return notify_result(&result_u, sizeof(result_u), &result_value);
 	}
 	return -1;
 }
 // -------------------------------------------------------------------------------------------------
 
-// Function to calculate the equation result (calculator_engine_thread) ----------------------------
-ReturnValue my_cds_calculate_result(struct calculator_task task)
-{  
-	/* // Display the contents of the struct
-    printk("Operation in calculator thread: %u\n", task.operation);
-	if (task.mode == FLOAT_MODE) {
-		printk("Float Operand 1: %d\n", (int32_t)task.f_operand_1);
-		printk("Float Operand 2: %d\n", (int32_t)task.f_operand_2);
-		printk("FLOAT_MODE\n");
-    } else { // FIXED_MODE
-		printk("Q31 Operand 1: %d\n", task.q31_operand_1);
-		printk("Q31 Operand 2: %d\n", task.q31_operand_2);
-		printk("FIXED_MODE\n");
-	}
-	printk("----------------\n");
-	*/
-
-	float result_f = 0.0f;	// Initialize the floating-point result to 0
-	int32_t result_q31 = 0;	// Initialize the fixed-point result to 0
+// Engine thread dispatch (calculator_engine_thread) -----------------------------------------------
+// Standing jobs and the self-benchmark need kernel timers and work items, they are scheduled here
+// around the calculator engine library (calc_engine.h).
+static struct calculator_task last_task;  // Previous client task, repeated by CALC_OP_JOB_SET
+
+// Jobs compare one scalar result with the last notified one, see calc_jobs_changed()
+static bool job_task_valid(const struct calculator_task *task)
+{
+	switch (task->operation) {
+	case CALC_OP_ADD:
+	case CALC_OP_SUB:
+	case CALC_OP_MUL:
+	case CALC_OP_DIV:
+		return task->mode != COMPLEX_FLOAT_MODE;  // Two results, re and im
+	case CALC_OP_MAG:
+	case CALC_OP_PHASE:
+		return task->mode == COMPLEX_Q15_MODE || task->mode == COMPLEX_FLOAT_MODE;
+	default:
+		return false;  // Buffers, statistics, sessions and extensions
+	}
+}
+
+static ReturnValue calculate_job_op(const struct calculator_task *task)
+{
+	uint32_t desc = (uint32_t)task->q31_operand_1;
+	int32_float_union threshold = { .u = task->q31_operand_2 };
+	ReturnValue result = { .type = INT32_TYPE, .batched = (task->flags & CDS_TASK_FLAG_BATCH) != 0 };
+
+	if (task->operation == CALC_OP_JOB_CLEAR) {
+		result.value.u = calc_jobs_clear(desc & 0xFF);
+	} else if (task->mode == HALF_MODE || (task->mode & CDS_MODE_FORMAT_MASK) == Q15_MODE) {
+		result.value.u = -EINVAL;  // The descriptor needs a 32-bit operand
+	} else if (!job_task_valid(&last_task)) {
+		result.value.u = -EINVAL;
+	} else {
+		result.value.u = calc_jobs_set(desc & 0xFF, &last_task, (desc >> 8) & 0xFF, desc >> 16,
+					       threshold);
+	}
+	return result;
+}
 
+// Evaluate a standing job, the (job id, result) pair is notified only if the result changed
+static ReturnValue calculate_job(struct calculator_task task)
+{
+	uint8_t job = task.job;
 	ReturnValue result;
+	int32_float_union id = { .u = job };
 
-	if (task.mode == FLOAT_MODE) { 
-		switch (task.operation) {
-			case 0: // Reset
-				result_f = 0.0f;
-				break;
-			case 1: // Add
-				result_f = task.f_operand_1 + task.f_operand_2;
-				break;
-			case 2: // Subtract
-				result_f = task.f_operand_1 - task.f_operand_2;
-				break;
-			case 3: // Multiply
-				result_f = task.f_operand_1 * task.f_operand_2;
-				break;
-			case 4: // Divide
-				if (task.f_operand_2 > EPSILON || task.f_operand_2 < -EPSILON) { // Division by zero, also checked in TEST TOOL python app
-					result_f = task.f_operand_1 / task.f_operand_2;
-				} else {
-					printk("Error: Division by zero.");
-					result_f = 0.0f;
-				}
-				break;
-			default:
-				break;
-			/*
-			 if (isinf(result_f) || isnan(result_f)){
-				printk("Float Overflow!");
-			result_q31 = 0.0f;
-			 }
-			*/
-		}
-	} else { // FIXED_MODE - https://en.wikipedia.org/wiki/Q_(number_format)
-		switch (task.operation) {
-			case 0: // Reset
-				result_q31 = 0;
-				break;
-			case 1: // Add
-				result_q31 = task.q31_operand_1 + task.q31_operand_2;
-				if (((task.q31_operand_2 > 0) && (task.q31_operand_1 > INT_MAX - task.q31_operand_2)) ||
-					((task.q31_operand_2 < 0) && (task.q31_operand_1 < INT_MIN - task.q31_operand_2))) {
-					printk("Integer Overflow in addition!");
-					result_q31 = 0;
-				}
-				break;
-			case 2: // Subtract
-				result_q31 = task.q31_operand_1 - task.q31_operand_2;
-				if (((task.q31_operand_2 > 0) && (task.q31_operand_1 < INT_MIN + task.q31_operand_2)) ||
-					((task.q31_operand_2 < 0) && (task.q31_operand_1 > INT_MAX + task.q31_operand_2))) {
-					printk("Integer Overflow in subtraction!");
-					result_q31 = 0;
-				}
-				break;
-			case 3: // Multiply
-				int64_t result_q62 = (int64_t)task.q31_operand_1 * (int64_t)task.q31_operand_2;  // Convert 'q31_operand' to Q62 format (prevent overflow)
-				result_q62 = (result_q62 >> 31);
-
-				if ((result_q62 > INT32_MAX) || (result_q62 < INT32_MIN)) {
-					printk("Integer Overflow in multiplication!");
-				 	result_q62 = 0;
-				}
-				result_q31 = (int32_t )result_q62;  // Convert result back to Q31 format
-				break;
-			case 4: // Divide
-				if (task.q31_operand_2 > EPSILON || task.q31_operand_2 < -EPSILON) {  // Division by zero, also checked in TEST TOOL python app
-					result_q31 = q_div(task.q31_operand_1, task.q31_operand_2);
-				} else {
-					printk("Error: Division by zero.");
-					result_q62 = 0;
-				}
-				break;
-			default:
-				break;
-		}
+	if (!calc_jobs_current(job, task.job_gen)) {  // Queued before the job was cleared or set again
+		return (ReturnValue){ .type = NONE_TYPE };
+	}
+	task.flags &= ~CDS_TASK_FLAG_JOB;
+	result = calc_engine_execute(task);
+	if (!calc_jobs_changed(job, &result)) {
+		result.type = NONE_TYPE;
+		return result;
+	}
+	calc_engine_emit(INT16_TYPE, id);
+	result.batched = true;
+	return result;
+}
+
+void my_cds_session_end(void)
+{
+	struct calculator_task task = {
+		.operation = CALC_OP_SESSION_RESET,
+		.flags = CDS_TASK_FLAG_SESSION,
+	};
+	k_spinlock_key_t key = k_spin_lock(&ble_queue_lock);
+
+	ble_stale = ble_queued;  // Tasks of the closed session, the shell and UART ones still run
+	k_spin_unlock(&ble_queue_lock, key);
+	calc_io_submit(&task, 1, CALC_IO_BLE, K_NO_WAIT);
+}
+
+// Count a dequeued client write, false if it was queued before the link dropped
+static bool ble_task_current(const struct calculator_task *task)
+{
+	k_spinlock_key_t key;
+	bool current = true;
+
+	if (CALC_IO_TRANSPORT(task->origin) != CALC_IO_BLE) {
+		engine_shared = true;
+		return true;
+	}
+	if (task->flags & (CDS_TASK_FLAG_JOB | CDS_TASK_FLAG_BENCH | CDS_TASK_FLAG_SESSION |
+			   CDS_TASK_FLAG_WORKLOAD)) {
+		return true;  // Not queued by my_cds_submit_write
+	}
+	key = k_spin_lock(&ble_queue_lock);
+	if (ble_queued > 0) {  // Not if a partly queued frame was taken back by my_cds_submit_write
+		ble_queued--;
+	}
+	if (ble_stale > 0) {
+		ble_stale--;
+		current = false;
+	}
+	k_spin_unlock(&ble_queue_lock, key);
+	return current;
+}
+
+// BLE client gone: stop its jobs, release the buffers unless a wired transport may still use them
+static void release_client(void)
+{
+	calc_jobs_clear_transport(CALC_IO_BLE);
+	if (!engine_shared) {
+		calc_engine_execute((struct calculator_task){ .operation = CALC_OP_SESSION_RESET });
+	}
+}
+
+#if defined(CONFIG_CDS_SESSION)
+// Task of another client: park the registers of the previous one, its jobs and buffers are released
+static void session_swap(uint8_t origin)
+{
+	struct cds_session_regs regs = { .last_task = last_task };
+
+	calc_engine_state_save(&regs.acc);
+	if (cds_session_swap(origin, &regs)) {
+		release_client();
 	}
+	calc_engine_state_restore(&regs.acc);
+	last_task = regs.last_task;
+}
 
-    // Notify result
-    if (task.mode == FLOAT_MODE) {
-		result.value.f = result_f;
-		result.type = FLOAT_TYPE;
-    } else { // FIXED_MODE
-		result.value.u = result_q31;
-		result.type = INT32_TYPE;
-    }
+// Kept session expired (or evicted), the engine releases its jobs and buffers if it still holds them
+static ReturnValue session_end(uint8_t origin, uint8_t gen)
+{
+	ReturnValue result = { .type = NONE_TYPE };
 
+	if (cds_session_release(origin, gen)) {
+		release_client();
+	}
 	return result;
 }
-// -------------------------------------------------------------------------------------------------
+#endif
 
-int32_t q_div(int32_t a, int32_t b)
+#if defined(CONFIG_CDS_BENCH)
+// Run the queued self-benchmark spec, the session accumulators are restored afterwards
+static ReturnValue calculate_bench(void)
+{
+	ReturnValue result = { .type = NONE_TYPE };
+	struct calculator_task saved_last_task = last_task;
+	struct calc_engine_state saved;
+	const struct calc_engine_ops *ops = calc_engine_set_ops(NULL);
+	struct calc_engine_ops muted = { .ext = ops ? ops->ext : NULL };  // Workload results are discarded
+
+	calc_engine_state_save(&saved);
+	calc_engine_set_ops(&muted);
+	calc_bench_execute();
+	calc_engine_set_ops(ops);
+	calc_engine_state_restore(&saved);
+	last_task = saved_last_task;
+	return result;
+}
+#endif
+
+ReturnValue my_cds_calculate_result(struct calculator_task task)
 {
-    int64_t temp = (int64_t)a << 31;
-    if ((temp >= 0 && b >= 0) || (temp < 0 && b < 0)) {   
-        temp += b / 2;
-    } else {
-        temp -= b / 2;
-    }
-	temp = (temp / b);
-	if ((temp > INT32_MAX) || (temp < INT32_MIN)) {
-		printk("Integer Overflow in division!");
-		temp = 0;
-	}
-    return (int32_t)temp;
+	if (!ble_task_current(&task)) {
+		return (ReturnValue){ .type = NONE_TYPE };  // Write of a closed session
+	}
+#if defined(CONFIG_CDS_SESSION)
+	if (task.flags & CDS_TASK_FLAG_SESSION) {
+		return session_end(task.origin, task.origin_gen);
+	}
+	if (!cds_session_live(task.origin, task.origin_gen)) {
+		return (ReturnValue){ .type = NONE_TYPE };  // Queued before its session was evicted
+	}
+	if (!cds_session_current(task.origin)) {
+		if (task.flags & CDS_TASK_FLAG_JOB) {
+			return (ReturnValue){ .type = NONE_TYPE };  // Job of a parked session, cleared since
+		}
+		session_swap(task.origin);
+	}
+#endif
+	if (task.flags & CDS_TASK_FLAG_JOB) {
+		return calculate_job(task);
+	}
+#if defined(CONFIG_CDS_BENCH)
+	if (task.flags & CDS_TASK_FLAG_BENCH) {
+		return calculate_bench();
+	}
+#endif
+	if (task.operation == CALC_OP_JOB_SET || task.operation == CALC_OP_JOB_CLEAR) {
+		return calculate_job_op(&task);
+	}
+#if !defined(CONFIG_CDS_SESSION)
+	if (task.flags & CDS_TASK_FLAG_SESSION) {
+		release_client();
+		return (ReturnValue){ .type = NONE_TYPE };
+	}
+#endif
+	if (task.operation == CALC_OP_SESSION_RESET || task.operation == CALC_OP_VEC_CLEAR) {
+		engine_shared = false;  // All buffers dropped, whoever created them
+	}
+	if (task.operation == CALC_OP_SESSION_RESET) {
+		calc_jobs_clear(CALC_JOB_ALL);  // Before the engine drops the buffers they evaluate
+	} else if (task.operation != CALC_OP_ARENA_STATS) {
+		last_task = task;
+	}
+	return calc_engine_execute(task);
 }
+// -------------------------------------------------------------------------------------------------
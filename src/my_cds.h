@@ -17,44 +17,9 @@
 extern "C" {
 #endif
 
-#include <zephyr/types.h>
+#include "calc_engine.h"
 
-// MODES:
-#define FLOAT_MODE 0  // 32-bit floating-point mode
-#define FIXED_MODE 1  // Q31 fixed-point mode
-// -------------------------------------------------------------------------------------------------
-#pragma pack(push, 1) // Preserve current packing settings and set packing to 1 byte
-struct calculator_task {		// Define a structure for calculator tasks
-	uint8_t operation;			// Operation to be performed (e.g., add, subtract)
-	union {						// Union for 1 argument, allowing either float or fixed-point integer.
-		float f_operand_1;		// 32-bit floating-point operand
-        int32_t q31_operand_1;	// Fixed-point (Q31) operand
-	};
-	union {						// Union for 2 argument, allowing either float or fixed-point integer.
-		float f_operand_2;		// 32-bit floating-point operand
-		int32_t q31_operand_2;	// Fixed-point (Q31) operand
-	};
-	bool mode;					// Mode: floating-point (0) or fixed-point (1)
-};
-#pragma pack(pop) // Restore original packing
-// -------------------------------------------------------------------------------------------------
-typedef union {
-    int32_t u;
-    float f;
-} int32_float_union;
-
-typedef enum {
-    INT32_TYPE,
-    FLOAT_TYPE
-} ReturnType;
-
-typedef struct {
-    int32_float_union value;
-    ReturnType type;
-} ReturnValue;
-// -------------------------------------------------------------------------------------------------
-
-#define EPSILON 1e-10  // Division by zero
+#define CDS_NOTIFY_MAX_RESULTS 64  // Max. batched results coalesced by the send_data_thread
 
 // -------------------------------------------------------------------------------------------------
 // UUID generated with: https://www.uuidgenerator.net/
@@ -67,10 +32,34 @@ typedef struct {
 /** @brief Calculated equation result Characteristic UUID. */
 #define BT_UUID_CDS_RESULT_VAL BT_UUID_128_ENCODE(0x4d19fe91,0x2164,0x49a8,0x9022,0x55ba662ce6fc)
 
+/** @brief Vector/matrix operand buffer Characteristic UUID. */
+#define BT_UUID_CDS_BUFFER_VAL BT_UUID_128_ENCODE(0x7059858e,0x3b53,0x4ffd,0xab0c,0xcf01be366fa0)
+
+/** @brief Runtime statistics Characteristic UUID. */
+#define BT_UUID_CDS_STATS_VAL BT_UUID_128_ENCODE(0x0c6d3b4e,0x71a2,0x4f08,0xb3d9,0x58e21f6ac047)
+
+/** @brief Pipeline latency diagnostics Characteristic UUID. */
+#define BT_UUID_CDS_DIAG_VAL BT_UUID_128_ENCODE(0x91c4e7a2,0x5b08,0x4d3f,0x9e61,0x27f0ac4d8b15)
+
+/** @brief Loadable operation kernel (LLEXT) upload Characteristic UUID. */
+#define BT_UUID_CDS_EXT_VAL BT_UUID_128_ENCODE(0x2f3c8a61,0x9d47,0x4b1e,0x8c52,0x6a0e7d91b3f4)
+
+/** @brief Self-benchmark control Characteristic UUID. */
+#define BT_UUID_CDS_BENCH_VAL BT_UUID_128_ENCODE(0x5a1d90c3,0x2e6b,0x47f8,0xa4c5,0x0d38b1e7f692)
+
+/** @brief Session resume Characteristic UUID. */
+#define BT_UUID_CDS_SESSION_VAL BT_UUID_128_ENCODE(0xb6e2f04d,0x8a17,0x4c39,0x95de,0x3f71c2a08e54)
+
 // Convert the array to a generic UUID
 #define BT_UUID_CDS 			BT_UUID_DECLARE_128(BT_UUID_CDS_VAL)
 #define BT_UUID_CDS_OPERATION	BT_UUID_DECLARE_128(BT_UUID_CDS_OPERATION_VAL)
 #define BT_UUID_CDS_RESULT 		BT_UUID_DECLARE_128(BT_UUID_CDS_RESULT_VAL)
+#define BT_UUID_CDS_BUFFER 		BT_UUID_DECLARE_128(BT_UUID_CDS_BUFFER_VAL)
+#define BT_UUID_CDS_STATS 		BT_UUID_DECLARE_128(BT_UUID_CDS_STATS_VAL)
+#define BT_UUID_CDS_DIAG 		BT_UUID_DECLARE_128(BT_UUID_CDS_DIAG_VAL)
+#define BT_UUID_CDS_EXT 		BT_UUID_DECLARE_128(BT_UUID_CDS_EXT_VAL)
+#define BT_UUID_CDS_BENCH 		BT_UUID_DECLARE_128(BT_UUID_CDS_BENCH_VAL)
+#define BT_UUID_CDS_SESSION 	BT_UUID_DECLARE_128(BT_UUID_CDS_SESSION_VAL)
 
 
 /** @brief Callback type for when a operation is received. */
@@ -96,19 +85,39 @@ struct my_cds_cb {
  */
 int my_cds_init(struct my_cds_cb *callbacks);
 
-/** @brief Send the result value as notification.
+/** @brief Send the result values as notification.
  *
- * This function sends an int32_t or float equation result value. 
+ * This function sends int32_t, float or binary16 equation result values.
+ * Batched results are packed back to back at their native width, as many as fit in the
+ * ATT MTU per notification. Results of legacy single tasks are sent one per notification.
+ * my_cds_init() registers it as the result sink of CALC_IO_BLE (calc_io.h), behind
+ * cds_session_results() with CONFIG_CDS_SESSION.
  *
- * @param[in] result_value The equation result value.
+ * @param[in] results The equation result values.
+ * @param[in] count Number of result values.
  *
  * @retval 0 If the operation was successful. Otherwise, a (negative) error code is returned.
  */
-int my_cds_send_result_notify(ReturnValue result_value);
+int my_cds_send_result_notify(const ReturnValue *results, size_t count);
 
-/** @brief Calculate the result value.
+/** @brief Queue the decoded tasks of a client write (BT RX thread).
+ *
+ * The tasks are counted as client writes, so that my_cds_session_end() skips the ones still
+ * queued when the link drops.
  *
- * This function calculates an int32_t or float equation result value. 
+ * @param[in,out] tasks Decoded tasks, tagged with the origin.
+ * @param[in] count Number of tasks.
+ *
+ * @retval 0 If the operation was successful.
+ * @retval -ENOMEM The queue had no room for the whole frame.
+ */
+int my_cds_submit_write(struct calculator_task *tasks, int count);
+
+/** @brief Calculate the result value (calculator_engine_thread).
+ *
+ * Runs standing job evaluations, job set-up and the self-benchmark, and passes every other
+ * task to calc_engine_execute(). Operations with several results (e.g. CALC_OP_STAT_SNAPSHOT)
+ * hand all but the last one to the emit hook of the engine.
  *
  * @param[in] task The equation struct.
  *
@@ -116,16 +125,14 @@ int my_cds_send_result_notify(ReturnValue result_value);
  */
 ReturnValue my_cds_calculate_result(struct calculator_task task);
 
-/** @brief Calculate the result of q31 division.
- *
- * This function calculates an int32_t division result value. 
- *
- * @param[in] a dividend
-* @param[in] b divider
+/** @brief End the client session.
  *
- * @retval int32_t result value.
+ * The engine thread skips the client writes still queued and stops the jobs of the BLE client.
+ * It releases the buffers and the session arena too, unless a wired transport (shell, UART)
+ * ran tasks since they were last released. Tasks of the other transports are kept. Called on
+ * disconnect, unless the session is kept (CONFIG_CDS_SESSION).
  */
-int32_t q_div(int32_t a, int32_t b);
+void my_cds_session_end(void);
 
 #ifdef __cplusplus
 }
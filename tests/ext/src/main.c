@@ -0,0 +1,94 @@
+/*
+ * Rafal Szymura
+ * June 2024
+ * BLE Calculator Application
+ */
+
+/** @file
+ *  @brief Loadable operation kernel tests
+ *
+ * ext/calc_ext_sumsq.c is uploaded in chunks as over the extension characteristic, linked,
+ * called from CALC_OP_EXT_BASE in the float and Q31 modes and unloaded.
+ */
+
+#include <zephyr/ztest.h>
+#include <errno.h>
+#include "calc_ext.h"
+#include "cds_codec.h"
+
+#define EXT_CHUNK 64  // Bytes per CALC_EXT_DATA record
+
+static const uint8_t sumsq_elf[] __aligned(4) = {
+#include "calc_ext_sumsq.inc"
+};
+// -------------------------------------------------------------------------------------------------
+
+static int upload(uint8_t opcode)
+{
+	int err = calc_ext_begin(opcode, sizeof(sumsq_elf));
+
+	for (uint32_t offset = 0; !err && offset < sizeof(sumsq_elf); offset += EXT_CHUNK) {
+		err = calc_ext_data(offset, &sumsq_elf[offset],
+				    MIN(EXT_CHUNK, sizeof(sumsq_elf) - offset));
+	}
+	return err ? err : calc_ext_load();
+}
+
+static void after(void *fixture)
+{
+	calc_ext_unload(CALC_OP_EXT_BASE);
+}
+
+ZTEST(calc_ext, test_load_call_unload)
+{
+	struct calculator_task task = {
+		.operation = CALC_OP_EXT_BASE,
+		.mode = FLOAT_MODE,
+		.f_operand_1 = 3.0f,
+		.f_operand_2 = 4.0f,
+	};
+	int32_float_union result;
+
+	zassert_ok(upload(CALC_OP_EXT_BASE));
+
+	zassert_equal(calc_ext_execute(&task, &result), FLOAT_TYPE);
+	zassert_within(result.f, 25.0f, 1e-6f);
+
+	task.mode = FIXED_MODE | CDS_MODE_SAT;
+	task.q31_operand_1 = 0x40000000;  // 0.5^2 + 0.5^2
+	task.q31_operand_2 = 0x40000000;
+	zassert_equal(calc_ext_execute(&task, &result), INT32_TYPE);
+	zassert_equal((int32_t)result.u, 0x40000000);
+
+	zassert_ok(calc_ext_unload(CALC_OP_EXT_BASE));
+	zassert_equal(calc_ext_execute(&task, &result), -ENOENT);
+	zassert_equal(calc_ext_unload(CALC_OP_EXT_BASE), -ENOENT);
+}
+
+ZTEST(calc_ext, test_reload_replaces)
+{
+	struct calculator_task task = {
+		.operation = CALC_OP_EXT_BASE,
+		.mode = FLOAT_MODE,
+		.f_operand_1 = 1.0f,
+		.f_operand_2 = 2.0f,
+	};
+	int32_float_union result;
+
+	zassert_ok(upload(CALC_OP_EXT_BASE));
+	zassert_ok(upload(CALC_OP_EXT_BASE));  // Same opcode, the first one is unloaded
+	zassert_equal(calc_ext_execute(&task, &result), FLOAT_TYPE);
+	zassert_within(result.f, 5.0f, 1e-6f);
+}
+
+ZTEST(calc_ext, test_incomplete_upload)
+{
+	zassert_equal(calc_ext_begin(CALC_OP_EXT_BASE - 1, sizeof(sumsq_elf)), -EINVAL);
+	zassert_equal(calc_ext_begin(CDS_CODEC_V1, sizeof(sumsq_elf)), -EINVAL);
+	zassert_ok(calc_ext_begin(CALC_OP_EXT_BASE, sizeof(sumsq_elf)));
+	zassert_ok(calc_ext_data(0, sumsq_elf, EXT_CHUNK));
+	zassert_equal(calc_ext_load(), -EINVAL);
+	zassert_equal(calc_ext_unload(CALC_OP_EXT_BASE), -ENOENT);
+}
+
+ZTEST_SUITE(calc_ext, NULL, NULL, NULL, after, NULL);